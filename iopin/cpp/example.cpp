@@ -0,0 +1,65 @@
+/*
+ * Waits for the edges of several pins in a single thread and mirrors them on an output pin
+ * Use: example <output-pin> <input-pin> [<input-pin> ...]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <system_error>
+#include <vector>
+#include "iopin.hpp"
+
+static IOPin::STask Watch( IOPin::CPin& clInput, IOPin::CPin& clOutput )
+{
+   for( ;; )
+   {
+      IOPin::SEdgeEvent stEvent = co_await clInput.Edge();
+      
+      if( stEvent.bStorm )
+      {
+         printf( "GPIO%u masked by the rate limit\n", clInput.Number() );
+         co_return;
+      }
+      
+      printf( "GPIO%u = %d\n", clInput.Number(), stEvent.bLevel );
+      clOutput.Write( stEvent.bLevel );
+   }
+}
+
+int main( int argc, char* argv[] )
+{
+   if( 3 > argc )
+   {
+      printf( "Wrong usage!\n" );
+      printf( "Use:\n" );
+      printf( "\t%s <output-pin> <input-pin> [<input-pin> ...]\n", argv[0] );
+      return -1;
+   }
+   
+   try
+   {
+      IOPin::CReactor clReactor;
+      IOPin::CPin clOutput( atoi( argv[1] ) );
+      std::vector<std::unique_ptr<IOPin::CPin>> vecInputs;
+      
+      clOutput.SetFunction( IOPin::EFunction::Output );
+      
+      for( int i = 2; i < argc; i++ )
+      {
+         vecInputs.push_back( std::make_unique<IOPin::CPin>( atoi( argv[i] ), &clReactor ) );
+         vecInputs.back()->SetFunction( IOPin::EFunction::Input );
+         vecInputs.back()->SetPull( IOPin::EPull::Up );
+         vecInputs.back()->SetTrigger( IOPin::ETrigger::Both );
+         Watch( *vecInputs.back(), clOutput );
+      }
+      
+      clReactor.Run();
+   }
+   catch( const std::system_error& clError )
+   {
+      printf( "Error: %s\n", clError.what() );
+      return -1;
+   }
+   
+   return 0;
+}
@@ -0,0 +1,357 @@
+/*
+ *  iopin.cpp - C++20 client of the iopin driver
+ */
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include "iopin.hpp"
+
+namespace IOPin
+{
+
+static void ThrowErrno( const char* szWhat )
+{
+   throw std::system_error( errno, std::generic_category(), szWhat );
+}
+
+//------[ CPin ]------
+CPin::CPin( unsigned int uiPin, CReactor* pclReactor, const std::string& strDevicePrefix ) :
+   m_uiPin( uiPin ),
+   m_iFd( -1 ),
+   m_pclReactor( pclReactor ),
+   m_bRegistered( false ),
+   m_pclAwaiter( nullptr )
+{
+   std::string strDevice = strDevicePrefix + std::to_string( uiPin );
+   
+   m_iFd = open( strDevice.c_str(), O_RDWR | O_CLOEXEC );
+   if( 0 > m_iFd )
+   {
+      ThrowErrno( strDevice.c_str() );
+   }
+}
+
+CPin::~CPin()
+{
+   Close();
+}
+
+CPin::CPin( CPin&& clOther ) noexcept :
+   m_uiPin( clOther.m_uiPin ),
+   m_iFd( -1 ),
+   m_pclReactor( clOther.m_pclReactor ),
+   m_bRegistered( false ),
+   m_pclAwaiter( nullptr )
+{
+   // The epoll points to the old object
+   if( clOther.m_bRegistered )
+   {
+      m_pclReactor->Forget( clOther );
+   }
+   m_iFd = std::exchange( clOther.m_iFd, -1 );
+}
+
+CPin& CPin::operator=( CPin&& clOther ) noexcept
+{
+   if( this != &clOther )
+   {
+      Close();
+      if( clOther.m_bRegistered )
+      {
+         clOther.m_pclReactor->Forget( clOther );
+      }
+      m_uiPin = clOther.m_uiPin;
+      m_iFd = std::exchange( clOther.m_iFd, -1 );
+      m_pclReactor = clOther.m_pclReactor;
+   }
+   
+   return *this;
+}
+
+void CPin::Close()
+{
+   if( 0 > m_iFd )
+   {
+      return;
+   }
+   
+   // A coroutine still waiting on this pin is never resumed
+   if( m_bRegistered )
+   {
+      m_pclReactor->Forget( *this );
+   }
+   
+   close( m_iFd );
+   m_iFd = -1;
+}
+
+void CPin::Ioctl( unsigned long ulRequest, unsigned long ulParam, const char* szName )
+{
+   if( 0 > ioctl( m_iFd, ulRequest, ulParam ) )
+   {
+      ThrowErrno( szName );
+   }
+}
+
+void CPin::Ioctl( unsigned long ulRequest, void* pvParam, const char* szName )
+{
+   if( 0 > ioctl( m_iFd, ulRequest, pvParam ) )
+   {
+      ThrowErrno( szName );
+   }
+}
+
+void CPin::SetFunction( EFunction eFunction )
+{
+   Ioctl( IOCTL_SET_FUNCTION, static_cast<unsigned long>(eFunction), "IOCTL_SET_FUNCTION" );
+}
+
+void CPin::SetPull( EPull ePull )
+{
+   Ioctl( IOCTL_SET_PULL, static_cast<unsigned long>(ePull), "IOCTL_SET_PULL" );
+}
+
+void CPin::SetTrigger( ETrigger eTrigger )
+{
+   Ioctl( IOCTL_SET_INTERRUPTION, static_cast<unsigned long>(eTrigger), "IOCTL_SET_INTERRUPTION" );
+}
+
+void CPin::SetModeration( unsigned int uiMaxEvents, std::chrono::microseconds usMaxDelay )
+{
+   SIOPinModeration stModeration;
+   
+   stModeration.uiMaxEvents = uiMaxEvents;
+   stModeration.uiMaxDelayUs = usMaxDelay.count();
+   
+   Ioctl( IOCTL_SET_MODERATION, &stModeration, "IOCTL_SET_MODERATION" );
+}
+
+std::optional<SEdge> CPin::WaitEdge( EEdge eEdge, std::chrono::microseconds usTimeout )
+{
+   SIOPinWaitEdge stWait = {};
+   
+   stWait.uiEdges = static_cast<uint32_t>( eEdge );
+   stWait.iTimeoutUs = (0 > usTimeout.count())? -1: static_cast<int32_t>( usTimeout.count() );
+   
+   if( 0 > ioctl( m_iFd, IOCTL_WAIT_EDGE, &stWait ) )
+   {
+      if( (ETIMEDOUT == errno) || (EAGAIN == errno) )
+      {
+         return std::nullopt;
+      }
+      ThrowErrno( "IOCTL_WAIT_EDGE" );
+   }
+   
+   return SEdge{ TClock::time_point( std::chrono::nanoseconds( stWait.ullTimestampNs ) ), 0 != stWait.uiLevel, stWait.uiSkipped, stWait.uiMissed };
+}
+
+void CPin::ResetConfig()
+{
+   Ioctl( IOCTL_RESET_CONFIG, 0UL, "IOCTL_RESET_CONFIG" );
+}
+
+void CPin::Write( bool bLevel )
+{
+   char chValue = bLevel? '1': '0';
+   
+   if( 0 > write( m_iFd, &chValue, 1 ) )
+   {
+      ThrowErrno( "write" );
+   }
+}
+
+bool CPin::Read()
+{
+   char chValue;
+   
+   if( 0 > read( m_iFd, &chValue, 1 ) )
+   {
+      ThrowErrno( "read" );
+   }
+   
+   return '1' == chValue;
+}
+
+void CPin::Schedule( bool bLevel, TClock::time_point tpDeadline, uint32_t uiBank, uint32_t uiMask )
+{
+   SIOPinScheduledOutput stEntry = {};
+   
+   stEntry.uiBank = uiBank;
+   stEntry.uiMask = uiMask;
+   stEntry.uiLevel = bLevel;
+   stEntry.ullDeadlineNs = std::chrono::duration_cast<std::chrono::nanoseconds>( tpDeadline.time_since_epoch() ).count();
+   
+   Ioctl( IOCTL_SCHEDULE_OUTPUT, &stEntry, "IOCTL_SCHEDULE_OUTPUT" );
+}
+
+void CPin::CancelSchedule()
+{
+   Ioctl( IOCTL_CANCEL_SCHEDULE, 0UL, "IOCTL_CANCEL_SCHEDULE" );
+}
+
+SIOPinStats CPin::GetStats()
+{
+   SIOPinStats stStats;
+   
+   Ioctl( IOCTL_GET_STATS, &stStats, "IOCTL_GET_STATS" );
+   return stStats;
+}
+
+SIOPinSchedStats CPin::GetSchedStats()
+{
+   SIOPinSchedStats stStats;
+   
+   Ioctl( IOCTL_GET_SCHED_STATS, &stStats, "IOCTL_GET_SCHED_STATS" );
+   return stStats;
+}
+
+SIOPinExportedMask CPin::GetExportedMask()
+{
+   SIOPinExportedMask stMask;
+   
+   Ioctl( IOCTL_GET_EXPORTED_MASK, &stMask, "IOCTL_GET_EXPORTED_MASK" );
+   return stMask;
+}
+
+CPin::CEdgeAwaiter CPin::Edge()
+{
+   if( nullptr == m_pclReactor )
+   {
+      throw std::logic_error( "CPin::Edge() needs a reactor" );
+   }
+   
+   return CEdgeAwaiter( *this );
+}
+
+void CPin::CEdgeAwaiter::await_suspend( std::coroutine_handle<> hCoroutine )
+{
+   m_hCoroutine = hCoroutine;
+   m_pclPin->m_pclReactor->Arm( *m_pclPin, this );
+}
+
+SEdgeEvent CPin::CEdgeAwaiter::await_resume()
+{
+   SEdgeEvent stEvent;
+   
+   if( m_uiEvents & (EPOLLERR | EPOLLHUP) )
+   {
+      throw std::system_error( EIO, std::generic_category(), "epoll" );
+   }
+   
+   // Reading acknowledges the event and re-arms a masked level detection
+   stEvent.bLevel = m_pclPin->Read();
+   stEvent.bStorm = m_uiEvents & EPOLLPRI;
+   
+   return stEvent;
+}
+
+//------[ CReactor ]------
+CReactor::CReactor() :
+   m_bStop( false )
+{
+   m_iEpollFd = epoll_create1( EPOLL_CLOEXEC );
+   if( 0 > m_iEpollFd )
+   {
+      ThrowErrno( "epoll_create1" );
+   }
+}
+
+CReactor::~CReactor()
+{
+   close( m_iEpollFd );
+}
+
+// One shot: the pin reports once per co_await. An event nobody waits for stays in the event log
+// of the driver ahead of the cursor of this file, so the next co_await gets it at once
+void CReactor::Arm( CPin& clPin, CPin::CEdgeAwaiter* pclAwaiter )
+{
+   struct epoll_event stEvent = {};
+   
+   stEvent.events = EPOLLIN | EPOLLPRI | EPOLLONESHOT;
+   stEvent.data.ptr = pclAwaiter;
+   
+   if( 0 > epoll_ctl( m_iEpollFd, clPin.m_bRegistered? EPOLL_CTL_MOD: EPOLL_CTL_ADD, clPin.m_iFd, &stEvent ) )
+   {
+      ThrowErrno( "epoll_ctl" );
+   }
+   clPin.m_bRegistered = true;
+   clPin.m_pclAwaiter = pclAwaiter;
+}
+
+// The awaiter may already be in the batch of RunOnce: it is marked so it isn't resumed
+void CReactor::Forget( CPin& clPin )
+{
+   epoll_ctl( m_iEpollFd, EPOLL_CTL_DEL, clPin.m_iFd, nullptr );
+   clPin.m_bRegistered = false;
+   if( clPin.m_pclAwaiter )
+   {
+      clPin.m_pclAwaiter->m_pclPin = nullptr;
+      clPin.m_pclAwaiter = nullptr;
+   }
+}
+
+int CReactor::RunOnce( int iTimeoutMs )
+{
+   struct epoll_event astEvents[32];
+   int iResumed = 0;
+   int iCount;
+   int i;
+   
+   iCount = epoll_wait( m_iEpollFd, astEvents, sizeof(astEvents) / sizeof(astEvents[0]), iTimeoutMs );
+   if( 0 > iCount )
+   {
+      if( EINTR == errno )
+      {
+         return 0;
+      }
+      ThrowErrno( "epoll_wait" );
+   }
+   
+   for( i = 0; i < iCount; i++ )
+   {
+      CPin::CEdgeAwaiter* pclAwaiter = static_cast<CPin::CEdgeAwaiter*>( astEvents[i].data.ptr );
+      
+      // A coroutine resumed before in the batch may have closed or moved the pin
+      if( nullptr == pclAwaiter->m_pclPin )
+      {
+         continue;
+      }
+      
+      pclAwaiter->m_pclPin->m_pclAwaiter = nullptr;
+      pclAwaiter->m_uiEvents = astEvents[i].events;
+      pclAwaiter->m_hCoroutine.resume();
+      iResumed++;
+   }
+   
+   return iResumed;
+}
+
+void CReactor::Run()
+{
+   m_bStop = false;
+   while( !m_bStop )
+   {
+      RunOnce();
+   }
+}
+
+//------[ CRegisters ]------
+CRegisters::CRegisters()
+{
+   if( 0 > IOPinMapOpen( &m_stMap ) )
+   {
+      ThrowErrno( IOPIN_MEM_DEVICE );
+   }
+}
+
+CRegisters::~CRegisters()
+{
+   IOPinMapClose( &m_stMap );
+}
+
+}
@@ -0,0 +1,226 @@
+#ifndef _IOPIN_HPP_
+#define _IOPIN_HPP_
+
+/*
+ * C++20 client of the iopin driver
+ *
+ * CPin owns the /dev/iopinN device of a pin and wraps its ioctls. CReactor waits on an epoll
+ * for the devices of many pins in one thread, and a coroutine waits for the next event of a pin
+ * with "co_await pin.Edge()". The reactor is single threaded: the pins and the coroutines that
+ * use it must live in the thread that calls Run().
+ * Errors of the driver are thrown as std::system_error with the errno of the call.
+ */
+#include <cstdint>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <string>
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_mmap.h"
+
+namespace IOPin
+{
+
+enum class EFunction : unsigned long
+{
+   Input    = PIN_FUNCTION_INPUT,
+   Output   = PIN_FUNCTION_OUTPUT,
+};
+
+enum class EPull : unsigned long
+{
+   Off      = PIN_PULL_OFF,
+   Down     = PIN_PULL_DOWN,
+   Up       = PIN_PULL_UP,
+};
+
+// PIN_INTERRUPTION_xxx flags, combined with |
+enum class ETrigger : unsigned long
+{
+   None           = 0,
+   Rising         = PIN_INTERRUPTION_RISING,
+   Falling        = PIN_INTERRUPTION_FALLING,
+   High           = PIN_INTERRUPTION_HIGH,
+   Low            = PIN_INTERRUPTION_LOW,
+   AsyncRising    = PIN_INTERRUPTION_ASYNC_RISING,
+   AsyncFalling   = PIN_INTERRUPTION_ASYNC_FALLING,
+   Both           = PIN_INTERRUPTION_RISING | PIN_INTERRUPTION_FALLING,
+};
+
+constexpr ETrigger operator|( ETrigger eA, ETrigger eB )
+{
+   return static_cast<ETrigger>( static_cast<unsigned long>(eA) | static_cast<unsigned long>(eB) );
+}
+
+using TClock = std::chrono::steady_clock;       // CLOCK_MONOTONIC, the clock of the driver
+
+enum class EEdge : uint32_t
+{
+   Rising   = WAIT_EDGE_RISING,
+   Falling  = WAIT_EDGE_FALLING,
+   Any      = WAIT_EDGE_ANY,
+};
+
+// Result of CPin::WaitEdge()
+struct SEdge
+{
+   TClock::time_point   tpTimestamp;   // Time of the interrupt
+   bool                 bLevel;        // Level read in the interrupt handler
+   unsigned int         uiSkipped;     // Events of the other edge before this one
+   unsigned int         uiMissed;      // Events lost because the reader fell behind
+};
+
+// Result of co_await CPin::Edge()
+struct SEdgeEvent
+{
+   bool  bLevel;           // Level of the pin when the event was read
+   bool  bStorm;           // The pin was masked by the rate limit and won't interrupt until SetTrigger()
+};
+
+class CReactor;
+
+class CPin
+{
+public:
+   class CEdgeAwaiter;
+   
+   explicit CPin( unsigned int uiPin, CReactor* pclReactor = nullptr, const std::string& strDevicePrefix = "/dev/iopin" );
+   ~CPin();
+   
+   // The reactor knows the pin by address: moving a pin drops it from the reactor, and a coroutine
+   // waiting on it is never resumed, as when the pin is destroyed
+   CPin( CPin&& clOther ) noexcept;
+   CPin& operator=( CPin&& clOther ) noexcept;
+   CPin( const CPin& ) = delete;
+   CPin& operator=( const CPin& ) = delete;
+   
+   unsigned int Number() const { return m_uiPin; }
+   int Descriptor() const { return m_iFd; }
+   
+   void SetFunction( EFunction eFunction );
+   void SetPull( EPull ePull );
+   void SetTrigger( ETrigger eTrigger );
+   // Wakes the reader after uiMaxEvents events or usMaxDelay after the first one (IOCTL_SET_MODERATION)
+   void SetModeration( unsigned int uiMaxEvents, std::chrono::microseconds usMaxDelay );
+   // The configuration outlives the object (and the process) until this is called
+   void ResetConfig();
+   
+   void Write( bool bLevel );
+   bool Read();            // Also acknowledges a pending event
+   
+   // Changes at an absolute time. uiMask = 0 is this pin, otherwise the exported pins of uiBank
+   void Schedule( bool bLevel, TClock::time_point tpDeadline, uint32_t uiBank = 0, uint32_t uiMask = 0 );
+   void CancelSchedule();
+   
+   SIOPinStats GetStats();
+   SIOPinSchedStats GetSchedStats();
+   SIOPinExportedMask GetExportedMask();
+   
+   // Blocks until the next edge, in one system call (IOCTL_WAIT_EDGE). std::nullopt when the
+   // timeout expires; a negative timeout waits forever. Not for the thread of the reactor
+   std::optional<SEdge> WaitEdge( EEdge eEdge, std::chrono::microseconds usTimeout = std::chrono::microseconds( -1 ) );
+   
+   // Awaitable: resumes in the reactor when the pin has an event (or is masked by a storm)
+   CEdgeAwaiter Edge();
+   
+   class CEdgeAwaiter
+   {
+   public:
+      CEdgeAwaiter( CPin& clPin ) : m_pclPin( &clPin ) {}
+      
+      bool await_ready() const noexcept { return false; }
+      void await_suspend( std::coroutine_handle<> hCoroutine );
+      SEdgeEvent await_resume();
+      
+   private:
+      friend class CReactor;
+      
+      CPin*                   m_pclPin;          // nullptr once the pin is closed or moved
+      std::coroutine_handle<> m_hCoroutine;
+      uint32_t                m_uiEvents = 0;    // EPOLLxxx flags reported by the reactor
+   };
+   
+private:
+   friend class CReactor;
+   
+   void Ioctl( unsigned long ulRequest, unsigned long ulParam, const char* szName );
+   void Ioctl( unsigned long ulRequest, void* pvParam, const char* szName );
+   void Close();
+   
+   unsigned int   m_uiPin;
+   int            m_iFd;
+   CReactor*      m_pclReactor;
+   bool           m_bRegistered;    // Added to the epoll of the reactor
+   CEdgeAwaiter*  m_pclAwaiter;     // Armed in the reactor, waiting for an event
+};
+
+// Dispatches the events of the pins to the coroutines waiting on them
+class CReactor
+{
+public:
+   CReactor();
+   ~CReactor();
+   
+   CReactor( const CReactor& ) = delete;
+   CReactor& operator=( const CReactor& ) = delete;
+   
+   // Resumes the coroutines with events until Stop(). RunOnce() waits at most iTimeoutMs
+   // (-1 = forever) and returns the number of coroutines resumed
+   void Run();
+   int RunOnce( int iTimeoutMs = -1 );
+   void Stop() { m_bStop = true; }
+   
+private:
+   friend class CPin;
+   
+   void Arm( CPin& clPin, CPin::CEdgeAwaiter* pclAwaiter );
+   void Forget( CPin& clPin );
+   
+   int   m_iEpollFd;
+   bool  m_bStop;
+};
+
+// Coroutine started right away and never awaited ("fire and forget"). It runs until the first
+// co_await and is resumed by the reactor from then on. An exception escaping it terminates
+struct STask
+{
+   struct promise_type
+   {
+      STask get_return_object() noexcept { return {}; }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() noexcept {}
+      void unhandled_exception() noexcept { std::terminate(); }
+   };
+};
+
+// Batched access to whole banks through /dev/iopinmem (needs CAP_SYS_RAWIO)
+// Only the exported pins are changed, every pin of uiMask at the same time
+class CRegisters
+{
+public:
+   CRegisters();
+   ~CRegisters();
+   
+   CRegisters( const CRegisters& ) = delete;
+   CRegisters& operator=( const CRegisters& ) = delete;
+   
+   void Set( unsigned int uiPin ) { IOPinMapSet( &m_stMap, uiPin ); }
+   void Clear( unsigned int uiPin ) { IOPinMapClear( &m_stMap, uiPin ); }
+   bool Level( unsigned int uiPin ) const { return IOPinMapLevel( &m_stMap, uiPin ); }
+   bool IsExported( unsigned int uiPin ) const { return IOPinMapIsExported( &m_stMap, uiPin ); }
+   
+   void WriteBank( unsigned int uiBank, uint32_t uiMask, uint32_t uiLevel ) { IOPinMapWriteBank( &m_stMap, uiBank, uiMask, uiLevel ); }
+   uint32_t ReadBank( unsigned int uiBank ) const { return IOPinMapReadBank( &m_stMap, uiBank ); }
+   
+   const SIOPinExportedMask& ExportedMask() const { return m_stMap.stExported; }
+   
+private:
+   SIOPinMap m_stMap;
+};
+
+}
+
+#endif
@@ -1,23 +1,171 @@
 #ifndef _IOPIN_H_
 #define _IOPIN_H_
 
+#define  IOPIN_NUM_PINS    58    // GPIO0 to GPIO57 on the BCM2711, GPIO0 to GPIO53 on the others
+#define  IOPIN_EVENT_QUEUE 64    // Events kept for each pin until they are read
+#define  IOPIN_RATE_WINDOW_NS (10 * NSEC_PER_MSEC)   // Window of the event rate measurements
+#define  IOPIN_CAPTURE_EDGES  96    // Edges of a protocol decoder capture
+
+// Edges recorded by the interrupt handler for a protocol decoder, instead of the event log
+struct SIOPinCapture
+{
+   u64               aullTimestamps[IOPIN_CAPTURE_EDGES];
+   uint8_t           aucLevels[IOPIN_CAPTURE_EDGES];
+   unsigned int      uiCount;
+   unsigned int      uiMax;            // The readers are woken up when it is reached
+};
+
+struct SIOPinUart;
+struct SIOPinMatrix;
+
 struct SIOPinDev
 {
 	struct cdev       stCdev;
    wait_queue_head_t irq_wait;
-   int               irq_flag;
    int               iMinor;
    ulong             ulPin;
+   spinlock_t        lock;
+   ulong             ulInterruption;   // PIN_INTERRUPTION_xxx flags configured
+   unsigned int      uiMaskState;      // PIN_MASKED_xxx flags
+   u64               ullWindowStart;   // Interrupt rate limit window
+   ulong             ulWindowEvents;
+   struct SIOPinStats stStats;
+   struct SIOPinEvent astEvents[IOPIN_EVENT_QUEUE];   // Last events, shared by every open file
+   u64               ullEventSeq;      // Events logged so far
+   u64               ullWakeSeq;       // Events covered by the last wakeup of the readers
+   unsigned int      uiModMaxEvents;   // Interrupt moderation
+   u64               ullModMaxDelayNs;
+   unsigned int      uiPendingSinceWake;
+   u64               ullLastWake;
+   struct hrtimer    stModTimer;
+   unsigned int      uiPolledLevel;    // Last level sampled while polling
+   int               iLastEventLevel;  // Level reported by the last event (-1 = none since configured)
+   atomic_t          stOpenCount;      // Files open on the device
+   int               iPull;            // Last PIN_PULL_xxx set (-1 = never set)
+   struct SIOPinCapture* pstCapture;   // While set, the edges go there and nowhere else
+   struct SIOPinUart* pstUart;         // Soft UART bound to the device: read() and write() go to its FIFOs
+   struct SIOPinMatrix* pstMatrix;     // Key matrix read through the device: read() returns its key events
 };
 
-static int ContructDevice( struct SIOPinDev* pobjDev, int iMinor, int iPin, struct class* pobjClass );
-static irqreturn_t GPIOIntHandler( int iIRQ, void* dev_id );
+// State of each open file of a pin
+struct SIOPinFile
+{
+   struct SIOPinDev* pstDev;
+   u64               ullCursor;        // Sequence of the next event for this reader
+   u64               ullOverruns;      // Events overwritten before this reader got them
+   unsigned int      uiReadMode;       // READ_MODE_xxx
+};
 
 int iopin_open(struct inode *inode, struct file *filp);
 int iopin_release(struct inode *inode, struct file *filp);
 long iopin_ioctl( struct file* filp, unsigned int ioctl_num, unsigned long ioctl_param );
-ssize_t iopin_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos);
+ssize_t iopin_read_iter( struct kiocb* iocb, struct iov_iter* to );
 ssize_t iopin_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos);
 unsigned int iopin_poll( struct file* filp, poll_table* wait_table );
 
+//------[ Shared by all the files of the module ]------
+extern const struct SIOPinSocLayout* g_pstSocLayout;
+extern phys_addr_t g_GpioPhysAddr;
+extern struct SGpioRegistersMap* g_pstGpioRegisters;
+extern uint32_t g_auiExportedMask[2];
+extern struct SIOPinDev* g_apstPinDevices[IOPIN_NUM_PINS];
+
+void IOPinWriteBit( uint32_t* puiRegister, unsigned long ulPin, int iValue );
+int IOPinClaimPins( const uint32_t* puiMask );
+void IOPinReleasePins( const uint32_t* puiMask );
+void IOPinSetFunction( unsigned long ulPin, unsigned int uiFunction );
+void IOPinSetPull( unsigned long ulPin, unsigned long ulPull );
+void IOPinNotifyEvent( struct SIOPinDev* dev, uint32_t uiLevel, u64 ullTimestamp );
+void IOPinResumeInterruptions( struct SIOPinDev* dev );
+void IOPinWriteInterruptions( struct SIOPinDev* dev, ulong ulInterruption );
+
+static inline unsigned int IOPinGetFunction( unsigned long ulPin )
+{
+   return (ioread32( &g_pstGpioRegisters->GPFSEL[ulPin / 10] ) >> ((ulPin % 10) * 3)) & 0b111;
+}
+
+// iopin_sched.c - Output changes at absolute deadlines
+void IOPinSchedInit( void );
+void IOPinSchedExit( void );
+long IOPinSchedIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param );
+int IOPinSchedAdd( const struct SIOPinScheduledOutput* pstEntry );
+int IOPinCheckOutputs( uint32_t uiBank, uint32_t uiMask );
+
+// iopin_reflex.c - Output changes triggered directly by input edges
+void IOPinReflexEvaluate( unsigned long ulPin, const uint32_t* puiLevels, u64 ullTimestamp );
+void IOPinReflexClear( long lPin );
+long IOPinReflexIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param );
+
+// iopin_events.c - Per-pin event queue and interrupt moderation
+void IOPinEventsInit( struct SIOPinDev* dev );
+void IOPinEventsReset( struct SIOPinDev* dev );
+void IOPinFileInit( struct SIOPinFile* pstFile, struct SIOPinDev* dev );
+void IOPinQueueEvent( struct SIOPinDev* dev, uint32_t uiLevel, u64 ullTimestamp );
+int IOPinCaptureEdge( struct SIOPinDev* dev, uint32_t uiLevel, u64 ullTimestamp );
+void IOPinAckEvents( struct SIOPinFile* pstFile );
+int IOPinHasEvents( struct SIOPinFile* pstFile );
+ssize_t IOPinReadEvents( struct SIOPinFile* pstFile, struct kiocb* iocb, struct iov_iter* to );
+long IOPinEventsIoctl( struct SIOPinFile* pstFile, struct file* filp, unsigned int ioctl_num, unsigned long ioctl_param );
+
+// iopin_poll.c - Polling of the pins too fast for interrupts
+void IOPinPollInit( void );
+void IOPinPollExit( void );
+int IOPinPollWanted( ulong ulWindowEvents );
+void IOPinPollStart( struct SIOPinDev* dev, uint32_t uiLevel, u64 ullTimestamp );
+void IOPinPollStop( struct SIOPinDev* dev );
+
+// iopin_stepper.c - Step/direction pulse generator
+void IOPinStepperInit( void );
+void IOPinStepperExit( void );
+void IOPinStepperRelease( unsigned long ulPin );
+long IOPinStepperIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param );
+
+// iopin_gpclk.c - Clock output through the GPCLK generators
+int IOPinGpclkInit( phys_addr_t ulPeriBase );
+void IOPinGpclkExit( void );
+void IOPinGpclkRelease( unsigned long ulPin );
+int IOPinGpclkOwns( unsigned long ulPin );
+long IOPinGpclkIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param );
+
+// iopin_bus.c - Parallel bus
+void IOPinBusInit( void );
+void IOPinBusExit( void );
+long IOPinBusRelease( unsigned long ulPin );
+long IOPinBusIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param );
+
+// iopin_dht.c - DHT11/DHT22 sensors
+long IOPinDhtIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param );
+
+// iopin_uart.c - Software UART
+void IOPinUartInit( void );
+void IOPinUartExit( void );
+void IOPinUartRelease( struct SIOPinDev* dev );
+int IOPinUartEdge( struct SIOPinDev* dev, u64 ullTimestamp );
+ssize_t IOPinUartRead( struct SIOPinDev* dev, struct kiocb* iocb, struct iov_iter* to );
+ssize_t IOPinUartWrite( struct SIOPinDev* dev, struct file* filp, const char __user* buf, size_t count );
+unsigned int IOPinUartPoll( struct SIOPinDev* dev );
+long IOPinUartIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param );
+
+// iopin_matrix.c - Key matrix scanner
+void IOPinMatrixInit( void );
+void IOPinMatrixExit( void );
+void IOPinMatrixRelease( struct SIOPinDev* dev );
+ssize_t IOPinMatrixRead( struct SIOPinDev* dev, struct kiocb* iocb, struct iov_iter* to );
+unsigned int IOPinMatrixPoll( struct SIOPinDev* dev );
+long IOPinMatrixIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param );
+
+// iopin_trace.c - Recording and replay of edge traces (/dev/iopintrace)
+int IOPinTraceInit( struct class* pobjClass, dev_t devno );
+void IOPinTraceExit( struct class* pobjClass );
+void IOPinTraceEdge( unsigned long ulPin, uint32_t uiLevel, u64 ullTimestamp );
+
+// iopin_status.c - /proc/iopin
+int IOPinStatusInit( void );
+void IOPinStatusExit( void );
+
+// iopin_mem.c - Register page mapped into userspace
+int IOPinMemInit( struct class* pobjClass, dev_t devno );
+void IOPinMemExit( struct class* pobjClass );
+long IOPinGetExportedMask( unsigned long ioctl_param );
+
 #endif
@@ -0,0 +1,494 @@
+/*
+ *  iopin_bus.c - Parallel bus with strobe timing
+ *
+ *  The data pins can be anywhere in both banks and in any order, so each byte of a word is
+ *  translated through a table into the GPSET masks of the banks. A word is then written with
+ *  one GPCLR and one GPSET per bank, whatever the width of the bus.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/delay.h>
+#include <linux/mutex.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin.h"
+
+#define  BUS_CHUNK         256      // Words copied from/to userspace at a time
+#define  BUS_SLEEP_NS      20000    // Longer waits sleep instead of spinning
+
+struct SBus
+{
+   struct mutex            stMutex;             // One transfer at a time
+   int                     iBound;
+   unsigned long           ulStrobePin;
+   struct SIOPinBusConfig  stConfig;
+   uint32_t                auiDataMask[2];      // Data pins of each bank
+   uint32_t                auiPinMask[2];       // Every pin of the bus, claimed while bound
+   uint32_t                aauiSet[2][256][2];  // GPSET of each bank for each value of the low and high byte
+   int                     iReading;            // Data pins are inputs
+   uint16_t                ausChunk[BUS_CHUNK];
+};
+
+//------[ Global variables ]------
+static struct SBus g_astBuses[BUS_MAX_BUSES];
+static DEFINE_MUTEX( g_stBusMutex );      // Taken before the mutex of a bus to bind or unbind it
+
+static void AddPin( uint32_t* puiMask, long lPin )
+{
+   puiMask[lPin / 32] |= 1U << (lPin % 32);
+}
+
+static void WritePin( long lPin, int iLevel )
+{
+   if( iLevel )
+   {
+      iowrite32( 1U << (lPin % 32), &g_pstGpioRegisters->GPSET[lPin / 32] );
+   }
+   else
+   {
+      iowrite32( 1U << (lPin % 32), &g_pstGpioRegisters->GPCLR[lPin / 32] );
+   }
+}
+
+static void Wait( uint32_t uiNs )
+{
+   if( BUS_SLEEP_NS <= uiNs )
+   {
+      usleep_range( uiNs / 1000, uiNs / 1000 + uiNs / 4000 );
+   }
+   else if( uiNs )
+   {
+      ndelay( uiNs );
+   }
+}
+
+static void Strobe( struct SBus* pstBus, int iActive )
+{
+   WritePin( pstBus->ulStrobePin, (!iActive) == (!(pstBus->stConfig.uiFlags & BUS_STROBE_ACTIVE_LOW)) );
+}
+
+// Called with pstBus->stMutex held
+static void SetDirection( struct SBus* pstBus, int iReading )
+{
+   unsigned int i;
+   
+   if( iReading == pstBus->iReading )
+   {
+      return;
+   }
+   
+   // The device only drives the bus while RW is high and the strobe active
+   if( !iReading && (0 <= pstBus->stConfig.iRwPin) )
+   {
+      WritePin( pstBus->stConfig.iRwPin, 0 );
+   }
+   
+   for( i = 0; i < pstBus->stConfig.uiWidth; i++ )
+   {
+      IOPinSetFunction( pstBus->stConfig.aiDataPins[i], iReading? PIN_FUNCTION_INPUT: PIN_FUNCTION_OUTPUT );
+   }
+   
+   if( iReading && (0 <= pstBus->stConfig.iRwPin) )
+   {
+      WritePin( pstBus->stConfig.iRwPin, 1 );
+   }
+   
+   pstBus->iReading = iReading;
+}
+
+static void WriteWord( struct SBus* pstBus, uint16_t usWord )
+{
+   const uint32_t* puiLow = pstBus->aauiSet[0][usWord & 0xFF];
+   const uint32_t* puiHigh = pstBus->aauiSet[1][usWord >> 8];
+   uint32_t uiSet;
+   unsigned int i;
+   
+   for( i = 0; i < 2; i++ )
+   {
+      if( pstBus->auiDataMask[i] )
+      {
+         uiSet = puiLow[i] | puiHigh[i];
+         iowrite32( pstBus->auiDataMask[i] & ~uiSet, &g_pstGpioRegisters->GPCLR[i] );
+         if( uiSet )
+         {
+            iowrite32( uiSet, &g_pstGpioRegisters->GPSET[i] );
+         }
+      }
+   }
+   
+   Wait( pstBus->stConfig.uiSetupNs );
+   Strobe( pstBus, 1 );
+   Wait( pstBus->stConfig.uiPulseNs );
+   Strobe( pstBus, 0 );
+   Wait( pstBus->stConfig.uiHoldNs );
+}
+
+static uint16_t ReadWord( struct SBus* pstBus )
+{
+   uint32_t auiLevels[2];
+   uint16_t usWord = 0;
+   unsigned int i;
+   long lPin;
+   
+   Wait( pstBus->stConfig.uiSetupNs );
+   Strobe( pstBus, 1 );
+   Wait( pstBus->stConfig.uiPulseNs );
+   
+   // Sampled before the strobe is released, while the device still drives the bus
+   auiLevels[0] = pstBus->auiDataMask[0]? ioread32( &g_pstGpioRegisters->GPLEV[0] ): 0;
+   auiLevels[1] = pstBus->auiDataMask[1]? ioread32( &g_pstGpioRegisters->GPLEV[1] ): 0;
+   
+   Strobe( pstBus, 0 );
+   Wait( pstBus->stConfig.uiHoldNs );
+   
+   for( i = 0; i < pstBus->stConfig.uiWidth; i++ )
+   {
+      lPin = pstBus->stConfig.aiDataPins[i];
+      if( auiLevels[lPin / 32] & (1U << (lPin % 32)) )
+      {
+         usWord |= 1 << i;
+      }
+   }
+   
+   return usWord;
+}
+
+static long Transfer( struct SBus* pstBus, const struct SIOPinBusTransfer* pstTransfer )
+{
+   unsigned int uiWordSize = (8 < pstBus->stConfig.uiWidth)? 2: 1;
+   uint8_t* pucChunk = (uint8_t*)pstBus->ausChunk;
+   char __user* pchBuffer = (char __user*)(uintptr_t)pstTransfer->ullBuffer;
+   uint32_t uiDone = 0;
+   uint32_t uiWords;
+   unsigned int i;
+   
+   if( BUS_READ < pstTransfer->uiDirection )
+   {
+      return -EINVAL;
+   }
+   
+   SetDirection( pstBus, BUS_READ == pstTransfer->uiDirection );
+   if( 0 <= pstBus->stConfig.iRsPin )
+   {
+      WritePin( pstBus->stConfig.iRsPin, pstTransfer->uiRs );
+   }
+   
+   while( uiDone < pstTransfer->uiCount )
+   {
+      uiWords = min( pstTransfer->uiCount - uiDone, (uint32_t)BUS_CHUNK );
+      
+      if( BUS_WRITE == pstTransfer->uiDirection )
+      {
+         if( copy_from_user( pstBus->ausChunk, pchBuffer + uiDone * uiWordSize, uiWords * uiWordSize ) )
+         {
+            return -EFAULT;
+         }
+         
+         for( i = 0; i < uiWords; i++ )
+         {
+            WriteWord( pstBus, (2 == uiWordSize)? pstBus->ausChunk[i]: pucChunk[i] );
+            Wait( pstBus->stConfig.uiGapNs );
+         }
+      }
+      else
+      {
+         for( i = 0; i < uiWords; i++ )
+         {
+            if( 2 == uiWordSize )
+            {
+               pstBus->ausChunk[i] = ReadWord( pstBus );
+            }
+            else
+            {
+               pucChunk[i] = ReadWord( pstBus );
+            }
+            Wait( pstBus->stConfig.uiGapNs );
+         }
+         
+         if( copy_to_user( pchBuffer + uiDone * uiWordSize, pstBus->ausChunk, uiWords * uiWordSize ) )
+         {
+            return -EFAULT;
+         }
+      }
+      
+      uiDone += uiWords;
+      
+      if( signal_pending( current ) )
+      {  // A long refresh can be interrupted between chunks
+         return -EINTR;
+      }
+   }
+   
+   return 0;
+}
+
+// Called with g_stBusMutex or the mutex of the bus held
+static int IsBusOf( const struct SBus* pstBus, unsigned long ulStrobePin )
+{
+   return pstBus->iBound && (pstBus->ulStrobePin == ulStrobePin);
+}
+
+// Called with g_stBusMutex held
+static struct SBus* FindBus( unsigned long ulStrobePin )
+{
+   unsigned int i;
+   
+   for( i = 0; i < BUS_MAX_BUSES; i++ )
+   {
+      if( IsBusOf( &g_astBuses[i], ulStrobePin ) )
+      {
+         return &g_astBuses[i];
+      }
+   }
+   
+   return NULL;
+}
+
+static int IsExported( long lPin )
+{
+   return (0 <= lPin) && (IOPIN_NUM_PINS > lPin) && (NULL != g_apstPinDevices[lPin]);
+}
+
+// Every pin exported and used once. Fills the mask of the pins of the bus
+static int CheckPins( unsigned long ulStrobePin, const struct SIOPinBusConfig* pstConfig, uint32_t* puiUsed )
+{
+   long alPins[BUS_MAX_WIDTH + 3];
+   unsigned int uiNumPins = 0;
+   unsigned int i;
+   
+   alPins[uiNumPins++] = ulStrobePin;
+   for( i = 0; i < pstConfig->uiWidth; i++ )
+   {
+      alPins[uiNumPins++] = pstConfig->aiDataPins[i];
+   }
+   if( -1 != pstConfig->iRsPin )
+   {
+      alPins[uiNumPins++] = pstConfig->iRsPin;
+   }
+   if( -1 != pstConfig->iRwPin )
+   {
+      alPins[uiNumPins++] = pstConfig->iRwPin;
+   }
+   
+   for( i = 0; i < uiNumPins; i++ )
+   {
+      if( !IsExported( alPins[i] ) || (puiUsed[alPins[i] / 32] & (1U << (alPins[i] % 32))) )
+      {
+         return -EINVAL;
+      }
+      AddPin( puiUsed, alPins[i] );
+   }
+   
+   return 0;
+}
+
+static long Bind( struct SIOPinDev* dev, const struct SIOPinBusConfig* pstConfig )
+{
+   struct SBus* pstBus = NULL;
+   uint32_t auiPinMask[2] = { 0, 0 };
+   unsigned int uiSlot;
+   unsigned int uiByte;
+   unsigned int uiValue;
+   unsigned int uiBit;
+   long lRet;
+   
+   if( (0 == pstConfig->uiWidth) || (BUS_MAX_WIDTH < pstConfig->uiWidth) || (pstConfig->uiFlags & ~BUS_STROBE_ACTIVE_LOW) )
+   {
+      return -EINVAL;
+   }
+   
+   mutex_lock( &g_stBusMutex );
+   
+   for( uiSlot = 0; uiSlot < BUS_MAX_BUSES; uiSlot++ )
+   {
+      if( !g_astBuses[uiSlot].iBound )
+      {
+         pstBus = &g_astBuses[uiSlot];
+         break;
+      }
+   }
+   if( NULL == pstBus )
+   {
+      mutex_unlock( &g_stBusMutex );
+      return -ENOSPC;
+   }
+   
+   // Not used by another bus, a UART, a matrix, a stepper axis or a clock generator
+   lRet = CheckPins( dev->ulPin, pstConfig, auiPinMask );
+   if( 0 == lRet )
+   {
+      lRet = IOPinClaimPins( auiPinMask );
+   }
+   if( lRet )
+   {
+      mutex_unlock( &g_stBusMutex );
+      return lRet;
+   }
+   
+   mutex_lock( &pstBus->stMutex );
+   
+   pstBus->ulStrobePin = dev->ulPin;
+   pstBus->auiPinMask[0] = auiPinMask[0];
+   pstBus->auiPinMask[1] = auiPinMask[1];
+   pstBus->stConfig = *pstConfig;
+   
+   memset( pstBus->auiDataMask, 0, sizeof(pstBus->auiDataMask) );
+   memset( pstBus->aauiSet, 0, sizeof(pstBus->aauiSet) );
+   for( uiBit = 0; uiBit < pstConfig->uiWidth; uiBit++ )
+   {
+      AddPin( pstBus->auiDataMask, pstConfig->aiDataPins[uiBit] );
+   }
+   
+   // Remap the pins once, so a word costs two table lookups
+   for( uiByte = 0; uiByte < 2; uiByte++ )
+   {
+      for( uiValue = 0; uiValue < 256; uiValue++ )
+      {
+         for( uiBit = 0; (uiBit < 8) && ((uiByte * 8 + uiBit) < pstConfig->uiWidth); uiBit++ )
+         {
+            if( uiValue & (1 << uiBit) )
+            {
+               AddPin( pstBus->aauiSet[uiByte][uiValue], pstConfig->aiDataPins[uiByte * 8 + uiBit] );
+            }
+         }
+      }
+   }
+   
+   // Idle: strobe inactive, writing
+   Strobe( pstBus, 0 );
+   IOPinSetFunction( dev->ulPin, PIN_FUNCTION_OUTPUT );
+   if( -1 != pstConfig->iRsPin )
+   {
+      IOPinSetFunction( pstConfig->iRsPin, PIN_FUNCTION_OUTPUT );
+   }
+   if( -1 != pstConfig->iRwPin )
+   {
+      IOPinSetFunction( pstConfig->iRwPin, PIN_FUNCTION_OUTPUT );
+   }
+   pstBus->iReading = 1;
+   SetDirection( pstBus, 0 );
+   pstBus->iBound = 1;
+   
+   mutex_unlock( &pstBus->stMutex );
+   mutex_unlock( &g_stBusMutex );
+   
+   return 0;
+}
+
+// Called with g_stBusMutex held. Waits for the transfer in progress. The data pins are left as inputs
+static void Unbind( struct SBus* pstBus )
+{
+   mutex_lock( &pstBus->stMutex );
+   SetDirection( pstBus, 1 );
+   pstBus->iBound = 0;
+   mutex_unlock( &pstBus->stMutex );
+   
+   IOPinReleasePins( pstBus->auiPinMask );
+}
+
+void IOPinBusInit( void )
+{
+   unsigned int i;
+   
+   for( i = 0; i < BUS_MAX_BUSES; i++ )
+   {
+      mutex_init( &g_astBuses[i].stMutex );
+   }
+}
+
+void IOPinBusExit( void )
+{
+   unsigned int i;
+   
+   mutex_lock( &g_stBusMutex );
+   for( i = 0; i < BUS_MAX_BUSES; i++ )
+   {
+      if( g_astBuses[i].iBound )
+      {
+         Unbind( &g_astBuses[i] );
+      }
+   }
+   mutex_unlock( &g_stBusMutex );
+}
+
+// Unbinds the bus strobed by the pin. Returns -ENODEV when there is none
+long IOPinBusRelease( unsigned long ulPin )
+{
+   struct SBus* pstBus;
+   
+   mutex_lock( &g_stBusMutex );
+   pstBus = FindBus( ulPin );
+   if( pstBus )
+   {
+      Unbind( pstBus );
+   }
+   mutex_unlock( &g_stBusMutex );
+   
+   return pstBus? 0: -ENODEV;
+}
+
+long IOPinBusIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   struct SIOPinBusConfig stConfig;
+   struct SIOPinBusTransfer stTransfer;
+   struct SBus* pstBus;
+   long lRet;
+   
+   switch( ioctl_num )
+   {
+      case IOCTL_BUS_BIND:
+      {
+         if( copy_from_user( &stConfig, (void __user*)ioctl_param, sizeof(stConfig) ) )
+         {
+            return -EFAULT;
+         }
+         
+         return Bind( dev, &stConfig );
+      }
+      
+      case IOCTL_BUS_UNBIND:
+      {
+         return IOPinBusRelease( dev->ulPin );
+      }
+      
+      case IOCTL_BUS_TRANSFER:
+      {
+         if( copy_from_user( &stTransfer, (void __user*)ioctl_param, sizeof(stTransfer) ) )
+         {
+            return -EFAULT;
+         }
+         
+         mutex_lock( &g_stBusMutex );
+         pstBus = FindBus( dev->ulPin );
+         mutex_unlock( &g_stBusMutex );
+         if( NULL == pstBus )
+         {
+            return -ENODEV;
+         }
+         
+         // The slot may have been unbound (or bound again) while waiting for it
+         mutex_lock( &pstBus->stMutex );
+         lRet = IsBusOf( pstBus, dev->ulPin )? Transfer( pstBus, &stTransfer ): -ENODEV;
+         mutex_unlock( &pstBus->stMutex );
+         
+         return lRet;
+      }
+      
+      default:
+      {
+         return -EINVAL;
+      }
+   }
+   
+   return 0;
+}
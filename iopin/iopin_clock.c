@@ -0,0 +1,160 @@
+/*
+ *  iopin_clock.c - General purpose clock generators (GPCLK0-2)
+ *
+ *  Divisor math and the stop/start sequence of the CTL and DIV registers
+ */
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/delay.h>
+#include <linux/math64.h>
+#include <asm/io.h>
+#define  CLOCK_DIV( a, b )       div_u64( (a), (b) )
+#else
+#include <stdint.h>
+#define  CLOCK_DIV( a, b )       ((a) / (b))
+#endif
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin_clock.h"
+
+#define  CLOCK_STOP_TIMEOUT_US   1000
+
+struct SClockPin
+{
+   unsigned long  ulPin;
+   unsigned int   uiClock;
+   unsigned int   uiFunction;
+};
+
+static const struct SClockPin g_astClockPins[] =
+{
+   { 4, 0, GPIO_ALT0 }, { 20, 0, GPIO_ALT5 }, { 32, 0, GPIO_ALT0 }, { 34, 0, GPIO_ALT0 },
+   { 5, 1, GPIO_ALT0 }, { 21, 1, GPIO_ALT5 }, { 42, 1, GPIO_ALT0 }, { 44, 1, GPIO_ALT0 },
+   { 6, 2, GPIO_ALT0 }, { 43, 2, GPIO_ALT0 },
+};
+
+// Indexed by the MASH order: smallest DIVI and how far below DIVI the dithering goes
+static const uint32_t g_auiMinDivI[] = { 1, 2, 3, 5 };
+static const uint32_t g_auiDitherBelow[] = { 0, 0, 1, 3 };
+
+int IOPinClockFindPin( unsigned long ulPin, unsigned int* puiClock, unsigned int* puiFunction )
+{
+   unsigned int i;
+   
+   for( i = 0; i < sizeof(g_astClockPins) / sizeof(g_astClockPins[0]); i++ )
+   {
+      if( g_astClockPins[i].ulPin == ulPin )
+      {
+         *puiClock = g_astClockPins[i].uiClock;
+         *puiFunction = g_astClockPins[i].uiFunction;
+         return 0;
+      }
+   }
+   
+   return -1;
+}
+
+int IOPinClockCheckDivisor( uint32_t uiSourceFreq, uint32_t uiMash, uint32_t uiDivI, uint32_t uiDivF )
+{
+   if( (PIN_CLOCK_MAX_MASH < uiMash) || (g_auiMinDivI[uiMash] > uiDivI) || (CLOCK_MAX_DIVI < uiDivI) || (CLOCK_DIVF_ONE <= uiDivF) )
+   {
+      return -1;
+   }
+   
+   // The fastest period of the dithering sets the highest frequency on the pin
+   if( (uiSourceFreq / (uiDivI - g_auiDitherBelow[uiMash])) > CLOCK_MAX_FREQ )
+   {
+      return -1;
+   }
+   
+   return 0;
+}
+
+int IOPinClockDivisor( uint32_t uiSourceFreq, uint32_t uiFrequency, uint32_t uiMash, uint32_t* puiDivI, uint32_t* puiDivF )
+{
+   uint64_t ullDivisor;
+   
+   if( (0 == uiFrequency) || (PIN_CLOCK_MAX_MASH < uiMash) )
+   {
+      return -1;
+   }
+   
+   if( 0 == uiMash )
+   {  // Integer divider, rounded to the nearest
+      *puiDivI = (uiSourceFreq + uiFrequency / 2) / uiFrequency;
+      *puiDivF = 0;
+   }
+   else
+   {  // Divisor in 1/4096, rounded to the nearest
+      ullDivisor = CLOCK_DIV( ((uint64_t)uiSourceFreq * CLOCK_DIVF_ONE) + uiFrequency / 2, uiFrequency );
+      if( ullDivisor >= ((uint64_t)(CLOCK_MAX_DIVI + 1) * CLOCK_DIVF_ONE) )
+      {
+         return -1;
+      }
+      *puiDivI = (uint32_t)(ullDivisor / CLOCK_DIVF_ONE);
+      *puiDivF = (uint32_t)(ullDivisor % CLOCK_DIVF_ONE);
+   }
+   
+   return IOPinClockCheckDivisor( uiSourceFreq, uiMash, *puiDivI, *puiDivF );
+}
+
+uint32_t IOPinClockFrequency( uint32_t uiSourceFreq, uint32_t uiMash, uint32_t uiDivI, uint32_t uiDivF )
+{
+   uint64_t ullDivisor = (uint64_t)uiDivI * CLOCK_DIVF_ONE + (uiMash? uiDivF: 0);
+   
+   return (uint32_t)CLOCK_DIV( ((uint64_t)uiSourceFreq * CLOCK_DIVF_ONE) + ullDivisor / 2, ullDivisor );
+}
+
+// CM_GPnCTL and CM_GPnDIV of the generator
+static volatile uint32_t* ControlRegister( struct SClockManagerRegistersMap* pstRegisters, unsigned int uiClock )
+{
+   return &pstRegisters->CM_GP0CTL + 2 * uiClock;
+}
+
+static int WaitStopped( volatile uint32_t* puiCTL )
+{
+   int iTimeout;
+   
+   for( iTimeout = CLOCK_STOP_TIMEOUT_US / 10; (SOC_READ( *puiCTL ) & (1 << CM_BUSY)) && iTimeout; iTimeout-- )
+   {
+      SOC_DELAY_US( 10 );
+   }
+   
+   return (SOC_READ( *puiCTL ) & (1 << CM_BUSY))? -1: 0;
+}
+
+int IOPinClockStop( struct SClockManagerRegistersMap* pstRegisters, unsigned int uiClock )
+{
+   volatile uint32_t* puiCTL = ControlRegister( pstRegisters, uiClock );
+   
+   // Disabling lets the generator finish its cycle, so the pin doesn't glitch. Kill it if it doesn't
+   SOC_WRITE( CM_PASSWD | (SOC_READ( *puiCTL ) & ~((1 << CM_ENAB) | (1 << CM_KILL) | (1 << CM_BUSY) | 0xFF000000)), *puiCTL );
+   if( 0 == WaitStopped( puiCTL ) )
+   {
+      return 0;
+   }
+   
+   SOC_WRITE( CM_PASSWD | (1 << CM_KILL), *puiCTL );
+   return WaitStopped( puiCTL );
+}
+
+int IOPinClockStart( struct SClockManagerRegistersMap* pstRegisters, unsigned int uiClock, uint32_t uiSource, uint32_t uiMash,
+                     uint32_t uiDivI, uint32_t uiDivF )
+{
+   volatile uint32_t* puiCTL = ControlRegister( pstRegisters, uiClock );
+   
+   // The divisor and the source can only change while the generator is stopped
+   if( IOPinClockStop( pstRegisters, uiClock ) )
+   {
+      return -1;
+   }
+   
+   SOC_WRITE( CM_PASSWD | (uiDivI << CM_DIVI) | (uiDivF << CM_DIVF), *(puiCTL + 1) );
+   SOC_WRITE( CM_PASSWD | (uiMash << CM_MASH) | (uiSource << CM_SRC), *puiCTL );
+   SOC_WRITE( CM_PASSWD | (uiMash << CM_MASH) | (uiSource << CM_SRC) | (1 << CM_ENAB), *puiCTL );
+   
+   return 0;
+}
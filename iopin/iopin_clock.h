@@ -0,0 +1,31 @@
+#ifndef _IOPIN_CLOCK_H_
+#define _IOPIN_CLOCK_H_
+
+/*
+ * General purpose clock generators of the clock manager. A generator is stopped and waited for
+ * before its divisor or source is changed, as the clock manager requires
+ */
+#define  CLOCK_NUM_GENERATORS    3        // GPCLK0 to GPCLK2
+#define  CLOCK_MAX_DIVI          4095
+#define  CLOCK_DIVF_ONE          4096     // DIVF is in 1/4096 of the divisor
+#define  CLOCK_MAX_FREQ          125000000
+
+// Generator (GPCLKn) and GPFSEL function of the pin. Returns -1 when the pin can't output a clock
+int IOPinClockFindPin( unsigned long ulPin, unsigned int* puiClock, unsigned int* puiFunction );
+
+// Divisor closest to the frequency. Returns -1 when it is out of range for the MASH order
+int IOPinClockDivisor( uint32_t uiSourceFreq, uint32_t uiFrequency, uint32_t uiMash, uint32_t* puiDivI, uint32_t* puiDivF );
+
+// Returns -1 when the divisor isn't valid for the MASH order or the output would be too fast
+int IOPinClockCheckDivisor( uint32_t uiSourceFreq, uint32_t uiMash, uint32_t uiDivI, uint32_t uiDivF );
+
+// Average output frequency of a valid divisor
+uint32_t IOPinClockFrequency( uint32_t uiSourceFreq, uint32_t uiMash, uint32_t uiDivI, uint32_t uiDivF );
+
+// Stop the generator and restart it with the new settings. Returns -1 when it doesn't stop
+int IOPinClockStart( struct SClockManagerRegistersMap* pstRegisters, unsigned int uiClock, uint32_t uiSource, uint32_t uiMash,
+                     uint32_t uiDivI, uint32_t uiDivF );
+// Returns -1 when it doesn't stop
+int IOPinClockStop( struct SClockManagerRegistersMap* pstRegisters, unsigned int uiClock );
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ *  iopin_debounce.c - Debouncing of the keys of a matrix
+ */
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/string.h>
+#else
+#include <stdint.h>
+#include <string.h>
+#endif
+
+#include "iopin_debounce.h"
+
+void IOPinDebounceInit( struct SIOPinDebounce* pstDebounce, uint8_t ucScans )
+{
+   memset( pstDebounce, 0, sizeof(*pstDebounce) );
+   pstDebounce->ucScans = ucScans? ucScans: 1;
+}
+
+uint64_t IOPinDebounceScan( struct SIOPinDebounce* pstDebounce, uint64_t ullSamples )
+{
+   uint64_t ullDiffer = ullSamples ^ pstDebounce->ullState;
+   uint64_t ullPending;
+   uint64_t ullChanged = 0;
+   uint64_t ullBit;
+   unsigned int i;
+   
+   // Only the keys that disagree now or did on the previous scans need a look
+   ullPending = ullDiffer | pstDebounce->ullCounting;
+   for( i = 0; ullPending; i++, ullPending >>= 1 )
+   {
+      if( !(ullPending & 1) )
+      {
+         continue;
+      }
+      
+      ullBit = 1ULL << i;
+      if( !(ullDiffer & ullBit) )
+      {  // Back to the debounced state: it was a bounce
+         pstDebounce->aucCount[i] = 0;
+         pstDebounce->ullCounting &= ~ullBit;
+      }
+      else if( ++pstDebounce->aucCount[i] >= pstDebounce->ucScans )
+      {
+         pstDebounce->aucCount[i] = 0;
+         pstDebounce->ullCounting &= ~ullBit;
+         ullChanged |= ullBit;
+      }
+      else
+      {
+         pstDebounce->ullCounting |= ullBit;
+      }
+   }
+   
+   pstDebounce->ullState ^= ullChanged;
+   
+   return ullChanged;
+}
@@ -0,0 +1,30 @@
+#ifndef _IOPIN_DEBOUNCE_H_
+#define _IOPIN_DEBOUNCE_H_
+
+/*
+ * Debouncing of up to 64 keys sampled together. A key changes state once it has read the new
+ * state uiScans times in a row; any scan back in the old state starts the count again, so the
+ * bounces of a contact and glitches shorter than uiScans scans never make an event
+ */
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+#define  DEBOUNCE_MAX_KEYS       64
+
+struct SIOPinDebounce
+{
+   uint64_t ullState;                        // Debounced, a bit set per key down
+   uint64_t ullCounting;                     // Keys whose samples disagree with ullState
+   uint8_t  aucCount[DEBOUNCE_MAX_KEYS];     // Scans in a row that disagreed
+   uint8_t  ucScans;
+};
+
+void IOPinDebounceInit( struct SIOPinDebounce* pstDebounce, uint8_t ucScans );
+
+// Takes the samples of one scan and returns the keys that changed state (now in ullState)
+uint64_t IOPinDebounceScan( struct SIOPinDebounce* pstDebounce, uint64_t ullSamples );
+
+#endif
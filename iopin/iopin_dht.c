@@ -0,0 +1,142 @@
+/*
+ *  iopin_dht.c - DHT11/DHT22 temperature and humidity sensors
+ *
+ *  The bits of the answer are 26-28us or 70us high pulses, too short to be timed from userspace.
+ *  The interrupt handler captures the edges of the answer with their timestamps and the widths
+ *  are decoded here (iopin_pulse.c), so a measurement is a single call.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin_pulse.h"
+#include "iopin.h"
+
+// Release edge, answer (low, high), low before the first bit and the 40 bits
+#define  DHT_EDGES            (1 + 2 + 1 + 2 * DHT_BITS)
+#define  DHT_ANSWER_TIMEOUT   (10 * NSEC_PER_MSEC)     // The answer takes ~5ms
+#define  DHT_MAX_START_US     50000
+
+static int IsCaptureDone( struct SIOPinDev* dev )
+{
+   unsigned long ulFlags;
+   int iDone;
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   iDone = dev->pstCapture->uiCount >= dev->pstCapture->uiMax;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   return iDone;
+}
+
+static long ReadSensor( struct SIOPinDev* dev, struct SIOPinDht* pstDht )
+{
+   struct SIOPinCapture* pstCapture;
+   unsigned long ulFlags;
+   long lRet;
+   
+   if( 0 == pstDht->uiStartUs )
+   {
+      pstDht->uiStartUs = DHT_START_US_DHT22;
+   }
+   if( 0 == pstDht->uiThresholdNs )
+   {
+      pstDht->uiThresholdNs = DHT_THRESHOLD_NS;
+   }
+   if( DHT_MAX_START_US < pstDht->uiStartUs )
+   {
+      return -EINVAL;
+   }
+   
+   pstCapture = kzalloc( sizeof(struct SIOPinCapture), GFP_KERNEL );
+   if( NULL == pstCapture )
+   {
+      return -ENOMEM;
+   }
+   pstCapture->uiMax = DHT_EDGES;
+   
+   // The detection is borrowed, so nothing else may be using it
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   if( dev->pstCapture || dev->ulInterruption || dev->pstUart || dev->pstMatrix )
+   {
+      spin_unlock_irqrestore( &dev->lock, ulFlags );
+      kfree( pstCapture );
+      return -EBUSY;
+   }
+   dev->pstCapture = pstCapture;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   // Start pulse: the sensor wakes up on a long low
+   iowrite32( 1 << (dev->ulPin % 32), &g_pstGpioRegisters->GPCLR[dev->ulPin / 32] );
+   IOPinSetFunction( dev->ulPin, PIN_FUNCTION_OUTPUT );
+   usleep_range( pstDht->uiStartUs, pstDht->uiStartUs + pstDht->uiStartUs / 10 );
+   
+   // Every edge from the release of the line on
+   IOPinWriteInterruptions( dev, PIN_INTERRUPTION_RISING | PIN_INTERRUPTION_FALLING );
+   IOPinSetFunction( dev->ulPin, PIN_FUNCTION_INPUT );
+   
+   lRet = wait_event_interruptible_hrtimeout( dev->irq_wait, IsCaptureDone( dev ), ns_to_ktime( DHT_ANSWER_TIMEOUT ) );
+   
+   IOPinWriteInterruptions( dev, 0 );
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   dev->pstCapture = NULL;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   // Without the release edge the capture isn't full, so a timeout is normal
+   pstDht->uiEdges = pstCapture->uiCount;
+   if( -ERESTARTSYS != lRet )
+   {
+      if( 3 > pstCapture->uiCount )
+      {
+         lRet = -ETIMEDOUT;
+      }
+      else
+      {
+         lRet = IOPinDhtDecode( pstCapture->aullTimestamps, pstCapture->aucLevels, pstCapture->uiCount, pstDht->uiThresholdNs,
+                                pstDht->aucData )? -EIO: 0;
+      }
+   }
+   
+   kfree( pstCapture );
+   
+   return lRet;
+}
+
+long IOPinDhtIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   struct SIOPinDht stDht;
+   long lRet;
+   
+   if( IOCTL_DHT_READ != ioctl_num )
+   {
+      return -EINVAL;
+   }
+   
+   if( copy_from_user( &stDht, (void __user*)ioctl_param, sizeof(stDht) ) )
+   {
+      return -EFAULT;
+   }
+   
+   lRet = ReadSensor( dev, &stDht );
+   
+   // The edges are returned on an error too
+   if( (-ERESTARTSYS != lRet) && copy_to_user( (void __user*)ioctl_param, &stDht, sizeof(stDht) ) )
+   {
+      return -EFAULT;
+   }
+   
+   return lRet;
+}
@@ -0,0 +1,402 @@
+/*
+ *  iopin_events.c - Per-pin event log and interrupt moderation
+ *
+ *  Every event served by the interrupt handler goes to a log per pin with its timestamp and a
+ *  sequence number. Each open file has its own cursor in the log, so every reader sees every
+ *  event. The readers are only woken up once enough events are pending or the oldest one has
+ *  waited long enough, like the interrupt coalescing of a network card. Events far apart wake
+ *  them up at once.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/jiffies.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin.h"
+
+#define  READ_CHUNK     8        // Events copied to userspace at a time
+
+// Called with dev->lock held
+static void WakeReaders( struct SIOPinDev* dev, u64 ullNow )
+{
+   dev->uiPendingSinceWake = 0;
+   dev->ullLastWake = ullNow;
+   dev->ullWakeSeq = dev->ullEventSeq;
+   dev->stStats.ullWakeups++;
+   wake_up_interruptible( &dev->irq_wait );
+}
+
+static enum hrtimer_restart ModerationTimerHandler( struct hrtimer* pstTimer )
+{
+   struct SIOPinDev* dev = container_of( pstTimer, struct SIOPinDev, stModTimer );
+   unsigned long ulFlags;
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   if( dev->uiPendingSinceWake )
+   {  // The count wasn't reached in time
+      WakeReaders( dev, ktime_get_ns() );
+   }
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   return HRTIMER_NORESTART;
+}
+
+void IOPinEventsInit( struct SIOPinDev* dev )
+{
+   hrtimer_init( &dev->stModTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL );
+   dev->stModTimer.function = ModerationTimerHandler;
+}
+
+// Back to no moderation. The log is kept, the open files still have their events
+void IOPinEventsReset( struct SIOPinDev* dev )
+{
+   unsigned long ulFlags;
+   
+   hrtimer_cancel( &dev->stModTimer );
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   dev->uiModMaxEvents = 0;
+   dev->ullModMaxDelayNs = 0;
+   if( dev->uiPendingSinceWake )
+   {
+      WakeReaders( dev, ktime_get_ns() );
+   }
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+}
+
+// A new file only sees the events that come after it was open
+void IOPinFileInit( struct SIOPinFile* pstFile, struct SIOPinDev* dev )
+{
+   unsigned long ulFlags;
+   
+   pstFile->pstDev = dev;
+   pstFile->uiReadMode = READ_MODE_LEVEL;
+   pstFile->ullOverruns = 0;
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   pstFile->ullCursor = dev->ullEventSeq;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+}
+
+// Called from the interrupt handler
+void IOPinQueueEvent( struct SIOPinDev* dev, uint32_t uiLevel, u64 ullTimestamp )
+{
+   struct SIOPinEvent* pstEvent;
+   
+   spin_lock( &dev->lock );
+   
+   // The oldest event is overwritten, the readers that didn't get it count an overrun
+   pstEvent = &dev->astEvents[dev->ullEventSeq % IOPIN_EVENT_QUEUE];
+   pstEvent->ullTimestampNs = ullTimestamp;
+   pstEvent->uiPin = dev->ulPin;
+   pstEvent->uiLevel = uiLevel? 1: 0;
+   dev->ullEventSeq++;
+   dev->uiPendingSinceWake++;
+   
+   if( 1 >= dev->uiModMaxEvents )
+   {  // No moderation
+      WakeReaders( dev, ullTimestamp );
+   }
+   else if( 1 == dev->uiPendingSinceWake )
+   {
+      if( (ullTimestamp - dev->ullLastWake) >= dev->ullModMaxDelayNs )
+      {  // Quiet pin, no reason to wait
+         WakeReaders( dev, ullTimestamp );
+      }
+      else
+      {  // Start of a burst, the readers get it when the count or the delay is reached
+         hrtimer_start( &dev->stModTimer, ns_to_ktime( dev->ullModMaxDelayNs ), HRTIMER_MODE_REL );
+      }
+   }
+   else if( dev->uiPendingSinceWake >= dev->uiModMaxEvents )
+   {  // A running callback waits for the lock and finds nothing pending
+      hrtimer_try_to_cancel( &dev->stModTimer );
+      WakeReaders( dev, ullTimestamp );
+   }
+   
+   spin_unlock( &dev->lock );
+}
+
+// Called from the interrupt handler. Returns 1 when the edge was taken by a protocol decoder
+int IOPinCaptureEdge( struct SIOPinDev* dev, uint32_t uiLevel, u64 ullTimestamp )
+{
+   struct SIOPinCapture* pstCapture;
+   
+   spin_lock( &dev->lock );
+   
+   pstCapture = dev->pstCapture;
+   if( pstCapture && (pstCapture->uiCount < pstCapture->uiMax) )
+   {
+      pstCapture->aullTimestamps[pstCapture->uiCount] = ullTimestamp;
+      pstCapture->aucLevels[pstCapture->uiCount] = uiLevel? 1: 0;
+      pstCapture->uiCount++;
+      if( pstCapture->uiCount == pstCapture->uiMax )
+      {
+         wake_up_interruptible( &dev->irq_wait );
+      }
+   }
+   
+   spin_unlock( &dev->lock );
+   
+   return NULL != pstCapture;
+}
+
+// The events are acknowledged by a level read
+void IOPinAckEvents( struct SIOPinFile* pstFile )
+{
+   struct SIOPinDev* dev = pstFile->pstDev;
+   unsigned long ulFlags;
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   pstFile->ullCursor = dev->ullEventSeq;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+}
+
+// True when the readers were woken up for events this file didn't read yet
+int IOPinHasEvents( struct SIOPinFile* pstFile )
+{
+   struct SIOPinDev* dev = pstFile->pstDev;
+   unsigned long ulFlags;
+   int iRet;
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   iRet = pstFile->ullCursor < dev->ullWakeSeq;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   return iRet;
+}
+
+// The destination is a user buffer for read() or the pages of a pipe for splice()
+ssize_t IOPinReadEvents( struct SIOPinFile* pstFile, struct kiocb* iocb, struct iov_iter* to )
+{
+   struct SIOPinDev* dev = pstFile->pstDev;
+   struct SIOPinEvent astChunk[READ_CHUNK];
+   unsigned long ulFlags;
+   unsigned int uiEvents;
+   unsigned int i;
+   size_t szCount = iov_iter_count( to );
+   size_t szChunk;
+   ssize_t iCopied = 0;
+   u64 ullLost;
+   
+   if( sizeof(struct SIOPinEvent) > szCount )
+   {
+      return -EINVAL;
+   }
+   
+   if( !IOPinHasEvents( pstFile ) )
+   {
+      if( (iocb->ki_filp->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT) )
+      {
+         return -EAGAIN;
+      }
+      
+      if( wait_event_interruptible( dev->irq_wait, IOPinHasEvents( pstFile ) ) )
+      {
+         return -ERESTARTSYS;
+      }
+   }
+   
+   while( sizeof(struct SIOPinEvent) <= szCount )
+   {
+      spin_lock_irqsave( &dev->lock, ulFlags );
+      
+      if( (dev->ullEventSeq - pstFile->ullCursor) > IOPIN_EVENT_QUEUE )
+      {  // This reader fell behind the log
+         ullLost = dev->ullEventSeq - IOPIN_EVENT_QUEUE - pstFile->ullCursor;
+         pstFile->ullOverruns += ullLost;
+         dev->stStats.ullDroppedEvents += ullLost;
+         pstFile->ullCursor = dev->ullEventSeq - IOPIN_EVENT_QUEUE;
+      }
+      
+      uiEvents = min3( (unsigned int)(szCount / sizeof(struct SIOPinEvent)), (unsigned int)(dev->ullEventSeq - pstFile->ullCursor),
+                       (unsigned int)READ_CHUNK );
+      for( i = 0; i < uiEvents; i++ )
+      {
+         astChunk[i] = dev->astEvents[pstFile->ullCursor % IOPIN_EVENT_QUEUE];
+         pstFile->ullCursor++;
+      }
+      
+      spin_unlock_irqrestore( &dev->lock, ulFlags );
+      
+      if( 0 == uiEvents )
+      {
+         break;
+      }
+      
+      szChunk = uiEvents * sizeof(struct SIOPinEvent);
+      if( szChunk != copy_to_iter( astChunk, szChunk, to ) )
+      {  // The events that didn't fit are lost for this file, like a fault in the middle of read()
+         return iCopied? iCopied: -EFAULT;
+      }
+      iCopied += szChunk;
+      szCount -= szChunk;
+   }
+   
+   return iCopied;
+}
+
+// Consumes the log of the file up to the first event of the edges. Returns 1 when it was found
+static int FindEdge( struct SIOPinFile* pstFile, struct SIOPinWaitEdge* pstWait )
+{
+   struct SIOPinDev* dev = pstFile->pstDev;
+   struct SIOPinEvent* pstEvent;
+   unsigned long ulFlags;
+   int iFound = 0;
+   u64 ullLost;
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   
+   if( (dev->ullEventSeq - pstFile->ullCursor) > IOPIN_EVENT_QUEUE )
+   {
+      ullLost = dev->ullEventSeq - IOPIN_EVENT_QUEUE - pstFile->ullCursor;
+      pstFile->ullOverruns += ullLost;
+      dev->stStats.ullDroppedEvents += ullLost;
+      pstFile->ullCursor = dev->ullEventSeq - IOPIN_EVENT_QUEUE;
+      pstWait->uiMissed += ullLost;
+   }
+   
+   // Moderation only delays the wakeups, an event already logged is returned at once
+   while( pstFile->ullCursor < dev->ullEventSeq )
+   {
+      pstEvent = &dev->astEvents[pstFile->ullCursor % IOPIN_EVENT_QUEUE];
+      pstFile->ullCursor++;
+      
+      if( pstWait->uiEdges & (pstEvent->uiLevel? WAIT_EDGE_RISING: WAIT_EDGE_FALLING) )
+      {
+         pstWait->ullTimestampNs = pstEvent->ullTimestampNs;
+         pstWait->uiLevel = pstEvent->uiLevel;
+         iFound = 1;
+         break;
+      }
+      pstWait->uiSkipped++;
+   }
+   
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   return iFound;
+}
+
+static long WaitEdge( struct SIOPinFile* pstFile, struct file* filp, unsigned long ioctl_param )
+{
+   struct SIOPinDev* dev = pstFile->pstDev;
+   struct SIOPinWaitEdge stWait;
+   long lRet;
+   
+   if( copy_from_user( &stWait, (void __user*)ioctl_param, sizeof(stWait) ) )
+   {
+      return -EFAULT;
+   }
+   
+   if( (0 == (stWait.uiEdges & WAIT_EDGE_ANY)) || (stWait.uiEdges & ~WAIT_EDGE_ANY) || (-1 > stWait.iTimeoutUs) )
+   {
+      return -EINVAL;
+   }
+   
+   stWait.uiLevel = 0;
+   stWait.ullTimestampNs = 0;
+   stWait.uiSkipped = 0;
+   stWait.uiMissed = 0;
+   
+   if( FindEdge( pstFile, &stWait ) )
+   {
+      lRet = 0;
+   }
+   else if( (0 == stWait.iTimeoutUs) || (filp->f_flags & O_NONBLOCK) )
+   {
+      lRet = -EAGAIN;
+   }
+   else if( 0 > stWait.iTimeoutUs )
+   {
+      lRet = wait_event_interruptible( dev->irq_wait, FindEdge( pstFile, &stWait ) )? -ERESTARTSYS: 0;
+   }
+   else
+   {
+      lRet = wait_event_interruptible_timeout( dev->irq_wait, FindEdge( pstFile, &stWait ), usecs_to_jiffies( stWait.iTimeoutUs ) );
+      lRet = (0 < lRet)? 0: ((0 == lRet)? -ETIMEDOUT: lRet);
+   }
+   
+   // The counters are returned on a timeout too
+   if( ((0 == lRet) || (-ETIMEDOUT == lRet) || (-EAGAIN == lRet)) &&
+       copy_to_user( (void __user*)ioctl_param, &stWait, sizeof(stWait) ) )
+   {
+      return -EFAULT;
+   }
+   
+   return lRet;
+}
+
+long IOPinEventsIoctl( struct SIOPinFile* pstFile, struct file* filp, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   struct SIOPinDev* dev = pstFile->pstDev;
+   struct SIOPinModeration stModeration;
+   unsigned long ulFlags;
+   
+   switch( ioctl_num )
+   {
+      case IOCTL_WAIT_EDGE:
+      {
+         return WaitEdge( pstFile, filp, ioctl_param );
+      }
+      
+      case IOCTL_SET_READ_MODE:
+      {
+         if( (READ_MODE_LEVEL != ioctl_param) && (READ_MODE_EVENTS != ioctl_param) )
+         {
+            printk( KERN_WARNING "[IOPin] ioctl: Invalid read mode %lu\n", ioctl_param );
+            return -EINVAL;
+         }
+         
+         pstFile->uiReadMode = ioctl_param;
+         break;
+      }
+      
+      case IOCTL_SET_MODERATION:
+      {
+         if( copy_from_user( &stModeration, (void __user*)ioctl_param, sizeof(stModeration) ) )
+         {
+            return -EFAULT;
+         }
+         
+         if( (IOPIN_EVENT_QUEUE < stModeration.uiMaxEvents) ||
+             ((1 < stModeration.uiMaxEvents) && (0 == stModeration.uiMaxDelayUs)) )
+         {
+            printk( KERN_WARNING "[IOPin] ioctl: Invalid moderation %u events / %uus\n", stModeration.uiMaxEvents, stModeration.uiMaxDelayUs );
+            return -EINVAL;
+         }
+         
+         hrtimer_cancel( &dev->stModTimer );
+         
+         spin_lock_irqsave( &dev->lock, ulFlags );
+         dev->uiModMaxEvents = stModeration.uiMaxEvents;
+         dev->ullModMaxDelayNs = stModeration.uiMaxDelayUs * (u64)NSEC_PER_USEC;
+         if( dev->uiPendingSinceWake )
+         {  // Don't leave the events of the old setting waiting
+            WakeReaders( dev, ktime_get_ns() );
+         }
+         spin_unlock_irqrestore( &dev->lock, ulFlags );
+         break;
+      }
+      
+      default:
+      {
+         return -EINVAL;
+      }
+   }
+   
+   return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ *  iopin_gpclk.c - Clock output on the pins that can take a GPCLK generator
+ *
+ *  The generator runs on its own once it is started, so a reference clock for an external chip
+ *  doesn't cost any CPU. The divisor math and the register sequence are in iopin_clock.c
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/mutex.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin_clock.h"
+#include "iopin.h"
+
+//------[ Global variables ]------
+static struct SClockManagerRegistersMap* g_pstClockRegisters = NULL;
+static long g_alClockOwner[CLOCK_NUM_GENERATORS] = { -1, -1, -1 };      // Pin driven by each generator
+static DEFINE_MUTEX( g_stClockMutex );     // Starting and stopping a generator waits for it
+
+int IOPinGpclkInit( phys_addr_t ulPeriBase )
+{
+   g_pstClockRegisters = (struct SClockManagerRegistersMap*) ioremap( ulPeriBase + CLOCK_OFFSET, sizeof(struct SClockManagerRegistersMap) );
+   if( NULL == g_pstClockRegisters )
+   {
+      printk( KERN_ERR "[IOPin] Failed to map clock manager registers\n" );
+      return -ENOMEM;
+   }
+   
+   return 0;
+}
+
+void IOPinGpclkExit( void )
+{
+   unsigned int i;
+   
+   if( NULL == g_pstClockRegisters )
+   {
+      return;
+   }
+   
+   for( i = 0; i < CLOCK_NUM_GENERATORS; i++ )
+   {
+      if( 0 <= g_alClockOwner[i] )
+      {
+         IOPinGpclkRelease( g_alClockOwner[i] );
+      }
+   }
+   
+   iounmap( g_pstClockRegisters );
+   g_pstClockRegisters = NULL;
+}
+
+// Stops the generator driven by the pin, if any, and sets the pin as input
+void IOPinGpclkRelease( unsigned long ulPin )
+{
+   uint32_t auiPinMask[2] = { 0, 0 };
+   unsigned int uiClock;
+   unsigned int uiFunction;
+   
+   if( IOPinClockFindPin( ulPin, &uiClock, &uiFunction ) )
+   {
+      return;
+   }
+   
+   mutex_lock( &g_stClockMutex );
+   if( g_alClockOwner[uiClock] == ulPin )
+   {
+      IOPinSetFunction( ulPin, PIN_FUNCTION_INPUT );
+      if( IOPinClockStop( g_pstClockRegisters, uiClock ) )
+      {
+         printk( KERN_WARNING "[IOPin] GPCLK%u didn't stop\n", uiClock );
+      }
+      g_alClockOwner[uiClock] = -1;
+      auiPinMask[ulPin / 32] = 1U << (ulPin % 32);
+      IOPinReleasePins( auiPinMask );
+   }
+   mutex_unlock( &g_stClockMutex );
+}
+
+// True when one of the generators drives the pin, which is then in its alternate function
+int IOPinGpclkOwns( unsigned long ulPin )
+{
+   unsigned int uiClock;
+   unsigned int uiFunction;
+   int iOwns;
+   
+   if( IOPinClockFindPin( ulPin, &uiClock, &uiFunction ) )
+   {
+      return 0;
+   }
+   
+   mutex_lock( &g_stClockMutex );
+   iOwns = (g_alClockOwner[uiClock] == ulPin);
+   mutex_unlock( &g_stClockMutex );
+   
+   return iOwns;
+}
+
+static long StartClock( struct SIOPinDev* dev, struct SIOPinClock* pstClock )
+{
+   uint32_t auiPinMask[2] = { 0, 0 };
+   unsigned int uiClock;
+   unsigned int uiFunction;
+   uint32_t uiSourceFreq;
+   
+   if( IOPinClockFindPin( dev->ulPin, &uiClock, &uiFunction ) )
+   {
+      printk( KERN_WARNING "[IOPin] GPIO%lu can't output a clock\n", dev->ulPin );
+      return -EINVAL;
+   }
+   
+   switch( pstClock->uiSource )
+   {
+      case PIN_CLOCK_SRC_OSC:    uiSourceFreq = g_pstSocLayout->uiOscFreq;    break;
+      case PIN_CLOCK_SRC_PLLD:   uiSourceFreq = g_pstSocLayout->uiPlldFreq;   break;
+      default:                   return -EINVAL;
+   }
+   
+   if( pstClock->uiFrequency )
+   {
+      if( IOPinClockDivisor( uiSourceFreq, pstClock->uiFrequency, pstClock->uiMash, &pstClock->uiDivI, &pstClock->uiDivF ) )
+      {
+         return -ERANGE;
+      }
+   }
+   else if( IOPinClockCheckDivisor( uiSourceFreq, pstClock->uiMash, pstClock->uiDivI, pstClock->uiDivF ) )
+   {
+      return -EINVAL;
+   }
+   
+   if( 0 == pstClock->uiMash )
+   {  // Ignored by the hardware
+      pstClock->uiDivF = 0;
+   }
+   pstClock->uiActualFrequency = IOPinClockFrequency( uiSourceFreq, pstClock->uiMash, pstClock->uiDivI, pstClock->uiDivF );
+   
+   mutex_lock( &g_stClockMutex );
+   
+   if( (0 <= g_alClockOwner[uiClock]) && (g_alClockOwner[uiClock] != dev->ulPin) )
+   {
+      mutex_unlock( &g_stClockMutex );
+      printk( KERN_WARNING "[IOPin] GPCLK%u is already driving GPIO%ld\n", uiClock, g_alClockOwner[uiClock] );
+      return -EBUSY;
+   }
+   
+   // Claimed once, a restart only changes the frequency
+   auiPinMask[dev->ulPin / 32] = 1U << (dev->ulPin % 32);
+   if( (g_alClockOwner[uiClock] != dev->ulPin) && IOPinClaimPins( auiPinMask ) )
+   {
+      mutex_unlock( &g_stClockMutex );
+      printk( KERN_WARNING "[IOPin] GPIO%lu is used by a bus, a UART, a matrix or a stepper axis\n", dev->ulPin );
+      return -EBUSY;
+   }
+   
+   if( IOPinClockStart( g_pstClockRegisters, uiClock, pstClock->uiSource, pstClock->uiMash, pstClock->uiDivI, pstClock->uiDivF ) )
+   {
+      if( g_alClockOwner[uiClock] != dev->ulPin )
+      {
+         IOPinReleasePins( auiPinMask );
+      }
+      mutex_unlock( &g_stClockMutex );
+      printk( KERN_ERR "[IOPin] GPCLK%u didn't stop\n", uiClock );
+      return -EIO;
+   }
+   
+   IOPinSetFunction( dev->ulPin, uiFunction );
+   g_alClockOwner[uiClock] = dev->ulPin;
+   
+   mutex_unlock( &g_stClockMutex );
+   
+   printk( KERN_INFO "[IOPin] GPIO%lu outputs GPCLK%u at %uHz\n", dev->ulPin, uiClock, pstClock->uiActualFrequency );
+   
+   return 0;
+}
+
+long IOPinGpclkIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   struct SIOPinClock stClock;
+   long lRet;
+   
+   switch( ioctl_num )
+   {
+      case IOCTL_CLOCK_START:
+      {
+         if( copy_from_user( &stClock, (void __user*)ioctl_param, sizeof(stClock) ) )
+         {
+            return -EFAULT;
+         }
+         
+         lRet = StartClock( dev, &stClock );
+         if( lRet )
+         {
+            return lRet;
+         }
+         
+         if( copy_to_user( (void __user*)ioctl_param, &stClock, sizeof(stClock) ) )
+         {
+            return -EFAULT;
+         }
+         break;
+      }
+      
+      case IOCTL_CLOCK_STOP:
+      {
+         IOPinGpclkRelease( dev->ulPin );
+         break;
+      }
+      
+      default:
+      {
+         return -EINVAL;
+      }
+   }
+   
+   return 0;
+}
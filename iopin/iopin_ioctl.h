@@ -1,6 +1,12 @@
 #ifndef _IOPIN_IOCTL_H_
 #define _IOPIN_IOCTL_H_
 
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
 #define  IOPIN_IOCTL_IDENTIFIER     'G'
 
 /*
@@ -16,10 +22,527 @@
 #define  PIN_INTERRUPTION_FALLING   0x00000002     // Set interruption to falling edge
 #define  PIN_INTERRUPTION_HIGH      0x00000004     // Set interruption to high state detected
 #define  PIN_INTERRUPTION_LOW       0x00000008     // Set interruption to low state detected
+#define  PIN_INTERRUPTION_ASYNC_RISING    0x00000010  // Set interruption to asynchronous rising edge
+#define  PIN_INTERRUPTION_ASYNC_FALLING   0x00000020  // Set interruption to asynchronous falling edge
+// The asynchronous detectors are not sampled by the system clock, so they catch pulses too narrow
+// for the synchronous ones (RISING/FALLING)
 
 #define  IOCTL_SET_PULL             _IOW( IOPIN_IOCTL_IDENTIFIER, 2, ulong )
 #define  PIN_PULL_OFF               0
 #define  PIN_PULL_DOWN              1
 #define  PIN_PULL_UP                2
 
+/*
+ * Change output pins at an absolute CLOCK_MONOTONIC time (in ns)
+ * uiMask selects the pins of uiBank (bank 0 = GPIO0-31, bank 1 = GPIO32-53). If uiMask is 0,
+ * the pin of the device is used. Every pin must be exported and configured as output.
+ * A deadline that has already passed is applied right away (and counted as late).
+ * Fails with ENOSPC when the queue is full
+ */
+struct SIOPinScheduledOutput
+{
+   uint32_t uiBank;
+   uint32_t uiMask;
+   uint32_t uiLevel;                // 0 = clear, anything else = set
+   uint32_t uiReserved;
+   uint64_t ullDeadlineNs;
+};
+#define  IOCTL_SCHEDULE_OUTPUT      _IOW( IOPIN_IOCTL_IDENTIFIER, 3, struct SIOPinScheduledOutput )
+
+/*
+ * Discard every pending scheduled output
+ */
+#define  IOCTL_CANCEL_SCHEDULE      _IO( IOPIN_IOCTL_IDENTIFIER, 4 )
+
+/*
+ * Get the state of the scheduled output queue
+ * An entry is late when it is applied more than sched_late_ns (module parameter) after its deadline
+ */
+struct SIOPinSchedStats
+{
+   uint32_t uiDepth;                // Entries waiting in the queue
+   uint32_t uiCapacity;             // Maximum number of entries
+   uint64_t ullFired;               // Entries applied
+   uint64_t ullLate;                // Entries applied late
+   uint64_t ullRejected;            // Entries refused because the queue was full
+   uint64_t ullMaxLatenessNs;       // Worst delay between deadline and application
+   uint64_t ullTotalLatenessNs;     // Sum of the delays, to compute the average
+};
+#define  IOCTL_GET_SCHED_STATS      _IOR( IOPIN_IOCTL_IDENTIFIER, 5, struct SIOPinSchedStats )
+
+/*
+ * Interlocks evaluated in the interrupt handler: when the pin of the device sees one of the
+ * uiEdge edges (PIN_INTERRUPTION_RISING and/or PIN_INTERRUPTION_FALLING) and, if iGatePin is
+ * not -1, iGatePin is at uiGateLevel, the uiMask pins of uiBank are set (uiAction = REFLEX_SET)
+ * or cleared (REFLEX_CLEAR). With a ullDelayNs, the change goes through the scheduled output
+ * queue, ullDelayNs after the edge.
+ * The edge is told by the level of the pin when the interrupt is served, and it is only seen
+ * if it is enabled with IOCTL_SET_INTERRUPTION. Userspace is still notified of the event.
+ * The rules of a pin stay until IOCTL_RESET_CONFIG.
+ *
+ * IOCTL_ADD_REFLEX returns the index of the new rule (ENOSPC if the table is full)
+ * IOCTL_DEL_REFLEX removes the rule with the index given (EPERM if its trigger is another pin)
+ * IOCTL_GET_REFLEX reads back the rule at uiIndex, with the number of times it fired
+ */
+#define  REFLEX_CLEAR               0
+#define  REFLEX_SET                 1
+#define  REFLEX_MAX_RULES           16
+
+struct SIOPinReflexRule
+{
+   uint32_t uiIndex;                // Only used by IOCTL_GET_REFLEX
+   uint32_t uiEdge;
+   int32_t  iGatePin;
+   uint32_t uiGateLevel;
+   uint32_t uiBank;
+   uint32_t uiMask;
+   uint32_t uiAction;
+   uint32_t uiTriggerPin;           // Filled by the driver
+   uint64_t ullDelayNs;
+   uint64_t ullFired;               // Filled by the driver
+};
+#define  IOCTL_ADD_REFLEX           _IOW( IOPIN_IOCTL_IDENTIFIER, 6, struct SIOPinReflexRule )
+#define  IOCTL_DEL_REFLEX           _IOW( IOPIN_IOCTL_IDENTIFIER, 7, ulong )
+#define  IOCTL_GET_REFLEX           _IOWR( IOPIN_IOCTL_IDENTIFIER, 8, struct SIOPinReflexRule )
+
+/*
+ * Get the event counters of the pin
+ * Both detectors latch the same status bit, so the driver can't tell which one fired:
+ * ullSyncEvents and ullAsyncEvents count the events while each detection was enabled. With the
+ * asynchronous detection on, the level of the pin when the interrupt is served gives the pulses
+ * narrower than the interrupt latency: the level matches no enabled edge, or both edges are
+ * enabled and the level is the one of the previous event. ullMissedPulses counts these events,
+ * an estimate (an upper bound) of the pulses that the synchronous detectors or polling would
+ * probably have missed
+ *
+ * A high/low level detection is masked after each event and re-armed when the device is read,
+ * so a level that holds doesn't keep interrupting. A pin interrupting faster than irq_rate_limit
+ * (module parameter) is masked completely, reports POLLPRI and stays masked until
+ * IOCTL_SET_INTERRUPTION is called again
+ *
+ * Before that, a pin interrupting faster than poll_threshold (module parameter) is switched to
+ * polling: its detection is masked and a timer samples GPLEV every poll_period_us, making up the
+ * events from the changes of level (PIN_MASKED_POLLING). The pin goes back to interrupts when the
+ * events found by polling drop below a quarter of poll_threshold. Changes between two samples are
+ * not seen, so the events degrade to the sampling rate instead of loading the CPU.
+ * uiEventRate is the rate of the pin in the last 10ms, in events per second
+ */
+#define  PIN_MASKED_LEVEL           0x00000001     // Level detection masked until the next read
+#define  PIN_MASKED_STORM           0x00000002     // Every detection masked by the rate limit
+#define  PIN_MASKED_POLLING         0x00000004     // Detection masked, the pin is polled instead
+
+struct SIOPinStats
+{
+   uint64_t ullEvents;              // Interrupts served for this pin
+   uint64_t ullSyncEvents;          // Events while a synchronous detection of their level was enabled
+   uint64_t ullAsyncEvents;         // Events while an asynchronous detection was enabled
+   uint64_t ullMissedPulses;        // Asynchronous events whose pulse was over when served
+   uint64_t ullLevelMasks;          // Times the level detection was masked waiting for a read
+   uint64_t ullStorms;              // Times the pin was masked by the rate limit
+   uint32_t uiMaskState;            // PIN_MASKED_xxx flags
+   uint32_t uiReserved;
+   uint64_t ullWakeups;             // Times the reader was woken up (see IOCTL_SET_MODERATION)
+   uint64_t ullDroppedEvents;       // Events this file lost because it fell more than 64 events behind
+   uint64_t ullPollingSwitches;     // Times the pin was switched from interrupts to polling
+   uint64_t ullPolledEvents;        // Events found by polling
+   uint32_t uiEventRate;
+   uint32_t uiReserved2;
+};
+#define  IOCTL_GET_STATS            _IOR( IOPIN_IOCTL_IDENTIFIER, 9, struct SIOPinStats )
+
+/*
+ * Get the pins exported by the driver (the pins module parameter), one bit per pin for each bank
+ * Works on every pin device and on /dev/iopinmem. uiMapOffset is the offset of the GPIO registers
+ * inside the page mapped by /dev/iopinmem (see iopin_mmap.h)
+ */
+struct SIOPinExportedMask
+{
+   uint32_t auiMask[2];             // Bank 0 = GPIO0-31, bank 1 = GPIO32-57
+   uint32_t uiNumPins;              // GPIO lines of the SoC
+   uint32_t uiMapOffset;
+};
+#define  IOCTL_GET_EXPORTED_MASK    _IOR( IOPIN_IOCTL_IDENTIFIER, 10, struct SIOPinExportedMask )
+
+/*
+ * What read() returns
+ * READ_MODE_LEVEL (default): one character, '0' or '1', with the current level of the pin.
+ *    It acknowledges the events received so far
+ * READ_MODE_EVENTS: as many SIOPinEvent records as fit in the buffer, oldest first. Blocks
+ *    until the reader is woken up (see IOCTL_SET_MODERATION) unless the file is O_NONBLOCK.
+ *    The buffer must hold at least one record
+ * The events go to a log of the last 64 events of the pin, and every open file has its own
+ * position in it: several processes can open the same pin and each one sees every event
+ * (from the moment it opened the device). The mode is set for each open file
+ */
+#define  READ_MODE_LEVEL            0
+#define  READ_MODE_EVENTS           1
+
+struct SIOPinEvent
+{
+   uint64_t ullTimestampNs;         // CLOCK_MONOTONIC, when the interrupt was served
+   uint32_t uiPin;
+   uint32_t uiLevel;                // Level of the pin when the interrupt was served
+};
+#define  IOCTL_SET_READ_MODE        _IOW( IOPIN_IOCTL_IDENTIFIER, 11, ulong )
+
+/*
+ * Interrupt moderation: the reader is woken up (poll/read) once uiMaxEvents events are pending
+ * or uiMaxDelayUs after the first pending one, whichever comes first. An event that comes more
+ * than uiMaxDelayUs after the previous wakeup wakes the reader right away, so the moderation
+ * only delays events that come in bursts.
+ * uiMaxEvents 0 or 1 wakes the reader on every event (default). With more, uiMaxDelayUs can't be 0
+ */
+struct SIOPinModeration
+{
+   uint32_t uiMaxEvents;
+   uint32_t uiMaxDelayUs;
+};
+#define  IOCTL_SET_MODERATION       _IOW( IOPIN_IOCTL_IDENTIFIER, 12, struct SIOPinModeration )
+
+/*
+ * The configuration of a pin (function, interruptions, interlocks, moderation) is shared by all
+ * the files open on it and stays when they are closed, so a process can restart without
+ * reconfiguring the pin. This sets it back as after loading the module: input, no interruptions,
+ * no interlocks and no moderation. The pull and the scheduled outputs are not changed.
+ * A pin belongs to one stepper axis, bus, UART, key matrix or clock generator at a time: binding
+ * a pin already used by any of them fails with EBUSY
+ */
+#define  IOCTL_RESET_CONFIG         _IO( IOPIN_IOCTL_IDENTIFIER, 13 )
+
+/*
+ * Stepper motors: the pin of the device becomes the step pin of an axis, with a direction pin
+ * and optionally an enable pin (-1 = none). Every pin must be exported; they are set as outputs.
+ * The enable pin is asserted while the axis is bound. Every axis is driven by one timer ticking
+ * every stepper_tick_ns (module parameter, default 10us), so the axes move in phase, and a step
+ * is a pulse of one tick: the highest rate is 1 / (2 * stepper_tick_ns).
+ *
+ * IOCTL_STEPPER_MOVE queues moves (up to 16 per axis). iSteps gives the direction, the rate
+ * ramps up by uiAccel steps/s^2 to uiMaxRate steps/s and down again to stop on the last step
+ * (uiAccel = 0: the whole move at uiMaxRate). uiAccel is at most STEPPER_MAX_ACCEL. The moves
+ * of one call are queued together, so axes that are idle start them on the same tick.
+ * IOCTL_STEPPER_STOP stops the axis at once and discards its queue (the position is kept).
+ * Any exported device can move, stop and read a bound axis, so one call can coordinate several
+ * of them; only the device of its step pin unbinds it (EPERM otherwise), with
+ * IOCTL_STEPPER_UNBIND or IOCTL_RESET_CONFIG
+ */
+#define  STEPPER_MAX_AXES           4
+#define  STEPPER_QUEUE_DEPTH        16
+#define  STEPPER_MAX_ACCEL          100000000      // Steps/s^2, full rate within a tick or two
+#define  STEPPER_DIR_INVERT         0x00000001     // Direction pin low for positive steps
+#define  STEPPER_ENABLE_ACTIVE_LOW  0x00000002
+
+struct SIOPinStepperBind
+{
+   uint32_t uiAxis;
+   int32_t  iDirPin;
+   int32_t  iEnablePin;
+   uint32_t uiFlags;                // STEPPER_xxx
+};
+
+struct SIOPinStepperMove
+{
+   uint32_t uiAxis;
+   int32_t  iSteps;
+   uint32_t uiMaxRate;              // Steps per second
+   uint32_t uiAccel;                // Steps per second^2
+};
+
+struct SIOPinStepperMoves
+{
+   uint32_t uiCount;
+   uint32_t uiReserved;
+   struct SIOPinStepperMove astMoves[STEPPER_MAX_AXES];
+};
+
+struct SIOPinStepperStatus
+{
+   uint32_t uiAxis;                 // Filled by the caller
+   uint32_t uiQueued;               // Moves waiting, the current one not included
+   int64_t  llPosition;             // Steps since the axis was bound
+   uint32_t uiRemaining;            // Steps left in the current move
+   uint32_t uiRate;                 // Current rate, steps per second
+};
+
+#define  IOCTL_STEPPER_BIND         _IOW( IOPIN_IOCTL_IDENTIFIER, 14, struct SIOPinStepperBind )
+#define  IOCTL_STEPPER_UNBIND       _IOW( IOPIN_IOCTL_IDENTIFIER, 15, ulong )
+#define  IOCTL_STEPPER_MOVE         _IOW( IOPIN_IOCTL_IDENTIFIER, 16, struct SIOPinStepperMoves )
+#define  IOCTL_STEPPER_STOP         _IOW( IOPIN_IOCTL_IDENTIFIER, 17, ulong )
+#define  IOCTL_STEPPER_STATUS       _IOWR( IOPIN_IOCTL_IDENTIFIER, 18, struct SIOPinStepperStatus )
+
+/*
+ * General purpose clocks: the pin of the device outputs one of the GPCLK generators of the clock
+ * manager, so a reference clock costs no CPU. GPIO4/20/32/34 can output GPCLK0, GPIO5/21/42/44
+ * GPCLK1 and GPIO6/43 GPCLK2 (GPCLK1 is used by the ethernet chip of some boards). A generator
+ * drives one pin at a time.
+ *
+ * The frequency is source / (DIVI + DIVF / 4096). With MASH 0 the fraction is ignored and the
+ * output is a plain divider with a 50% duty cycle. MASH 1 to 3 dither between neighbouring
+ * divisors to get the fraction on average, with more jitter on each order, and need DIVI of at
+ * least 2, 3 and 5. The output can't go above 125MHz (including the fastest dithered period).
+ *
+ * IOCTL_CLOCK_START: when uiFrequency isn't 0 the divisor is computed for it, otherwise uiDivI
+ * and uiDivF are used as given. The divisor used and the average frequency are returned.
+ * IOCTL_CLOCK_STOP stops the generator and sets the pin as input, as IOCTL_RESET_CONFIG does.
+ */
+#define  PIN_CLOCK_SRC_OSC          1     // Oscillator (19.2MHz, 54MHz on the BCM2711)
+#define  PIN_CLOCK_SRC_PLLD         6     // PLLD (500MHz, 750MHz on the BCM2711)
+#define  PIN_CLOCK_MAX_MASH         3
+
+struct SIOPinClock
+{
+   uint32_t uiSource;               // PIN_CLOCK_SRC_xxx
+   uint32_t uiMash;                 // 0 to PIN_CLOCK_MAX_MASH
+   uint32_t uiFrequency;            // Hz, 0 = use uiDivI and uiDivF
+   uint32_t uiDivI;                 // Integer part of the divisor (1 to 4095)
+   uint32_t uiDivF;                 // Fractional part of the divisor, in 1/4096
+   uint32_t uiActualFrequency;      // Returned: average frequency (Hz)
+};
+
+#define  IOCTL_CLOCK_START          _IOWR( IOPIN_IOCTL_IDENTIFIER, 19, struct SIOPinClock )
+#define  IOCTL_CLOCK_STOP           _IO( IOPIN_IOCTL_IDENTIFIER, 20 )
+
+/*
+ * Wait for the next edge and get it in one call, instead of poll() and read(). The event comes
+ * from the log of the file (see READ_MODE_EVENTS), so its timestamp and level are the ones taken
+ * in the interrupt handler. Events of the other edge are consumed and counted in uiSkipped, and
+ * uiMissed counts the events this file lost because it fell behind the log. The edges must be
+ * enabled with IOCTL_SET_INTERRUPTION.
+ * iTimeoutUs: -1 waits forever, 0 doesn't wait (EAGAIN when there is no edge). ETIMEDOUT when
+ * the timeout expires
+ */
+#define  WAIT_EDGE_RISING           0x00000001     // Event with the pin high
+#define  WAIT_EDGE_FALLING          0x00000002     // Event with the pin low
+#define  WAIT_EDGE_ANY              (WAIT_EDGE_RISING | WAIT_EDGE_FALLING)
+
+struct SIOPinWaitEdge
+{
+   uint32_t uiEdges;                // WAIT_EDGE_xxx
+   int32_t  iTimeoutUs;
+   uint64_t ullTimestampNs;         // Returned: CLOCK_MONOTONIC time of the interrupt
+   uint32_t uiLevel;                // Returned: level read in the interrupt handler
+   uint32_t uiSkipped;              // Returned: events of the other edge before this one
+   uint32_t uiMissed;               // Returned: events lost since the last read or wait
+   uint32_t uiReserved;
+};
+
+#define  IOCTL_WAIT_EDGE            _IOWR( IOPIN_IOCTL_IDENTIFIER, 21, struct SIOPinWaitEdge )
+
+/*
+ * Parallel bus (HD44780 displays, parallel ADCs...): the pin of the device is the strobe and up
+ * to 16 exported pins carry the data, bit i of each word on aiDataPins[i]. RS and RW are optional
+ * (-1 = none). A word is written with one GPCLR and one GPSET per bank, then the strobe is pulsed:
+ * uiSetupNs after the data, active during uiPulseNs, and uiHoldNs before the data changes again.
+ * A read samples GPLEV at the end of the pulse, with the data pins as inputs and RW high. uiGapNs
+ * is waited after every word, for devices that need time to process it (the HD44780 needs ~40us).
+ * The times are minimums: the transfer can be interrupted, which makes them longer.
+ *
+ * IOCTL_BUS_TRANSFER writes or reads uiCount words of the user buffer (bytes up to 8 data pins,
+ * uint16_t above) in one call, with RS at uiRs.
+ * A bus is unbound by IOCTL_BUS_UNBIND or IOCTL_RESET_CONFIG on the device of its strobe
+ */
+#define  BUS_MAX_WIDTH              16
+#define  BUS_MAX_BUSES              4
+#define  BUS_STROBE_ACTIVE_LOW      0x00000001     // Idle high, pulsed low (/RD, /WR of an ADC)
+
+struct SIOPinBusConfig
+{
+   uint32_t uiWidth;                // Number of data pins
+   int32_t  aiDataPins[BUS_MAX_WIDTH];
+   int32_t  iRsPin;
+   int32_t  iRwPin;
+   uint32_t uiFlags;                // BUS_xxx
+   uint32_t uiSetupNs;
+   uint32_t uiPulseNs;
+   uint32_t uiHoldNs;
+   uint32_t uiGapNs;
+};
+
+#define  BUS_WRITE                  0
+#define  BUS_READ                   1
+
+struct SIOPinBusTransfer
+{
+   uint32_t uiDirection;            // BUS_WRITE or BUS_READ
+   uint32_t uiRs;                   // Level of the RS pin
+   uint32_t uiCount;                // Words
+   uint32_t uiReserved;
+   uint64_t ullBuffer;              // User pointer
+};
+
+#define  IOCTL_BUS_BIND             _IOW( IOPIN_IOCTL_IDENTIFIER, 22, struct SIOPinBusConfig )
+#define  IOCTL_BUS_UNBIND           _IO( IOPIN_IOCTL_IDENTIFIER, 23 )
+#define  IOCTL_BUS_TRANSFER         _IOW( IOPIN_IOCTL_IDENTIFIER, 24, struct SIOPinBusTransfer )
+
+/*
+ * DHT11/DHT22 sensors: one call sends the start pulse (the pin low for uiStartUs), captures every
+ * edge of the answer in the interrupt handler and decodes the 40 bits from the width of the high
+ * pulses (26-28us a 0, 70us a 1). The bytes are returned as sent by the sensor, checksum included:
+ * for a DHT22 the humidity is (aucData[0] << 8 | aucData[1]) / 10 % and the temperature
+ * ((aucData[2] & 0x7F) << 8 | aucData[3]) / 10 C, negative when bit 7 of aucData[2] is set.
+ * The line needs a pull-up and the pin no interruptions configured (EBUSY otherwise). ETIMEDOUT
+ * when the sensor doesn't answer, EIO when an edge was lost or the checksum is wrong. The sensors
+ * can't be read more often than every 1s (DHT11) or 2s (DHT22)
+ */
+#define  DHT_START_US_DHT22         1100
+#define  DHT_START_US_DHT11         18000
+
+struct SIOPinDht
+{
+   uint32_t uiStartUs;              // 0 = DHT_START_US_DHT22
+   uint32_t uiThresholdNs;          // High pulses longer than this are 1 (0 = 48000)
+   uint8_t  aucData[5];             // Returned
+   uint8_t  aucReserved[3];
+   uint32_t uiEdges;                // Returned: edges captured, for diagnostics
+};
+
+#define  IOCTL_DHT_READ             _IOWR( IOPIN_IOCTL_IDENTIFIER, 25, struct SIOPinDht )
+
+/*
+ * Software UART, 8 data bits, no parity, for extra low speed ports. The pin of the device receives
+ * and iTxPin (an exported pin, -1 = receive only) transmits; with UART_TX_ONLY the pin of the
+ * device transmits and there is no receiver. Once bound, read() and write() on the device go
+ * through 1KB receive and transmit FIFOs instead of reading or writing the level, and poll()
+ * reports POLLIN/POLLOUT for them. Both block unless the file is O_NONBLOCK.
+ * The transmitter changes the pin from an hrtimer at each transition of the frame, and the
+ * receiver timestamps the falling edge of the start bit in the interrupt handler and then samples
+ * the middle of each bit with an hrtimer, so the timing depends on the timer latency: up to 38400
+ * baud. A byte whose stop bit isn't high is dropped as a framing error, and so is a byte whose
+ * samples were too late to be in their bit.
+ * The receiving pin must have no interruptions configured (EBUSY otherwise). IOCTL_UART_UNBIND or
+ * IOCTL_RESET_CONFIG on the device release the port
+ */
+#define  UART_MAX_PORTS             4
+#define  UART_MIN_BAUD              300
+#define  UART_MAX_BAUD              38400
+#define  UART_TWO_STOP_BITS         0x00000001
+#define  UART_TX_ONLY               0x00000002
+
+struct SIOPinUartConfig
+{
+   uint32_t uiBaud;
+   int32_t  iTxPin;                 // -1 = none
+   uint32_t uiFlags;                // UART_xxx
+};
+
+struct SIOPinUartStats
+{
+   uint64_t ullRxBytes;
+   uint64_t ullTxBytes;
+   uint32_t uiFramingErrors;        // Stop bit low
+   uint32_t uiLateSamples;          // Bytes dropped because the timer was too late
+   uint32_t uiOverruns;             // Bytes dropped with the receive FIFO full
+   uint32_t uiRxPending;            // Bytes in the FIFOs
+   uint32_t uiTxPending;
+   uint32_t uiReserved;
+};
+
+#define  IOCTL_UART_BIND            _IOW( IOPIN_IOCTL_IDENTIFIER, 26, struct SIOPinUartConfig )
+#define  IOCTL_UART_UNBIND          _IO( IOPIN_IOCTL_IDENTIFIER, 27 )
+#define  IOCTL_UART_STATS           _IOR( IOPIN_IOCTL_IDENTIFIER, 28, struct SIOPinUartStats )
+
+/*
+ * Edge traces, through /dev/iopintrace. IOCTL_TRACE_RECORD starts recording the edges of the
+ * pins of the mask (their detection must be enabled on their devices) and read() returns them as
+ * SIOPinTraceEdge records, blocking until there is one and returning 0 once the recording is
+ * stopped (a zero mask) and everything was read. Writing records replays them: each one happens
+ * uiDeltaNs after the previous one (the first one after the write), on the output that
+ * IOCTL_TRACE_MAP gives to its pin (by default the same pin, which must then be an output). The
+ * records with the same time are applied together, with one GPSET and one GPCLR per bank.
+ * A trace file is just the records, so "cat trace > /dev/iopintrace" replays what
+ * "cat /dev/iopintrace > trace" recorded, and a trace can be edited or generated as an array of
+ * records. Longer gaps than a uiDeltaNs can hold go in TRACE_PIN_DELAY records, which only wait.
+ * The write blocks while the playback FIFO is full, and the playback continues after the file is
+ * closed; when the FIFO runs dry before the end, the next record plays as soon as it is written
+ * and counts as an underrun. IOCTL_TRACE_STOP drops the records not played yet
+ */
+#define  TRACE_PIN_DELAY            0xFF
+#define  TRACE_NO_OUTPUT            0xFF
+#define  TRACE_MAX_PINS             64
+
+struct SIOPinTraceEdge
+{
+   uint32_t uiDeltaNs;              // Since the previous record
+   uint8_t  ucPin;                  // Or TRACE_PIN_DELAY
+   uint8_t  ucLevel;
+   uint16_t usReserved;
+};
+
+struct SIOPinTraceRecord
+{
+   uint32_t auiMask[2];             // Pins to record, 0 = stop
+};
+
+struct SIOPinTraceMap
+{
+   uint8_t  aucOutput[TRACE_MAX_PINS];    // Output of each recorded pin, TRACE_NO_OUTPUT = skipped
+};
+
+struct SIOPinTraceStatus
+{
+   uint64_t ullRecorded;
+   uint64_t ullPlayed;
+   uint32_t uiLost;                 // Edges not recorded because nobody read them
+   uint32_t uiUnderruns;            // Times the playback FIFO ran dry
+   uint32_t uiRecordPending;        // Records not read yet
+   uint32_t uiPlayPending;          // Records not played yet
+   uint32_t uiMaxLateNs;            // Worst delay of the playback timer
+   uint32_t uiReserved;
+};
+
+#define  IOCTL_TRACE_RECORD         _IOW( IOPIN_IOCTL_IDENTIFIER, 29, struct SIOPinTraceRecord )
+#define  IOCTL_TRACE_MAP            _IOW( IOPIN_IOCTL_IDENTIFIER, 30, struct SIOPinTraceMap )
+#define  IOCTL_TRACE_STOP           _IO( IOPIN_IOCTL_IDENTIFIER, 31 )
+#define  IOCTL_TRACE_STATUS         _IOR( IOPIN_IOCTL_IDENTIFIER, 32, struct SIOPinTraceStatus )
+
+/*
+ * Key matrix (keypads, switch panels): every pin is an input with its pull-up enabled, and the
+ * rows are open drain. Every uiScanUs a timer makes each row an output low in turn, waits
+ * uiSettleNs and reads all the columns with one GPLEV read: a low column is a key down. A key
+ * changes state after uiDebounceScans scans in a row that agree, and only the changes are queued
+ * (64 events). The matrix is bound through the device of one of its pins, whose read() then
+ * returns SIOPinKeyEvent records instead of the level (blocking unless the file is O_NONBLOCK)
+ * and whose poll() reports POLLIN for them. Key numbers are row * MATRIX_MAX_COLUMNS + column.
+ * A row is never driven high, so keys down together can't short two rows. Without diodes three
+ * keys on the corners of a rectangle still show the fourth one (ghost key); diodes with their
+ * cathodes on the rows avoid it.
+ * IOCTL_MATRIX_UNBIND or IOCTL_RESET_CONFIG on that device release it
+ */
+#define  MATRIX_MAX_ROWS            8
+#define  MATRIX_MAX_COLUMNS         8
+#define  MATRIX_MAX_MATRICES        2
+#define  MATRIX_EVENT_QUEUE         64
+
+struct SIOPinMatrixConfig
+{
+   uint32_t uiRows;
+   uint32_t uiColumns;
+   int32_t  aiRowPins[MATRIX_MAX_ROWS];
+   int32_t  aiColumnPins[MATRIX_MAX_COLUMNS];
+   uint32_t uiScanUs;               // 0 = 1000 (from 100 to 100000)
+   uint32_t uiSettleNs;             // 0 = 1000 (up to 20000)
+   uint32_t uiDebounceScans;        // 0 = 5 (up to 255)
+};
+
+struct SIOPinKeyEvent
+{
+   uint64_t ullTimestampNs;         // CLOCK_MONOTONIC of the scan that accepted the change
+   uint8_t  ucKey;
+   uint8_t  ucRow;
+   uint8_t  ucColumn;
+   uint8_t  ucPressed;              // 1 = down, 0 = up
+   uint32_t uiReserved;
+};
+
+struct SIOPinMatrixState
+{
+   uint64_t ullPressed;             // Bit of each key down
+   uint64_t ullScans;
+   uint32_t uiOverruns;             // Events lost with the queue full
+   uint32_t uiPending;              // Events not read yet
+};
+
+#define  IOCTL_MATRIX_BIND          _IOW( IOPIN_IOCTL_IDENTIFIER, 33, struct SIOPinMatrixConfig )
+#define  IOCTL_MATRIX_UNBIND        _IO( IOPIN_IOCTL_IDENTIFIER, 34 )
+#define  IOCTL_MATRIX_STATE         _IOR( IOPIN_IOCTL_IDENTIFIER, 35, struct SIOPinMatrixState )
+
 #endif
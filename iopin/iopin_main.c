@@ -0,0 +1,1090 @@
+/*  
+ *  iopin_main.c - A simple IO module for the raspberry pi
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/err.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/slab.h>
+#include <linux/interrupt.h>
+#include <linux/sched.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/delay.h>
+#include <linux/spinlock.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/uio.h>
+#include <linux/version.h>
+#ifdef CONFIG_OF
+#include <linux/of.h>
+#include <linux/of_address.h>
+#include <linux/of_irq.h>
+#endif
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin.h"
+
+#define  DRIVER_AUTHOR  "Bruno La Pastina <brunolap@gmail.com>"
+#define  DRIVER_DESC    "A basic GPIO module for the Raspberry PI"
+#define  DEVICE_NAME    "iopin"        // Dev name as it appears in /proc/devices
+
+MODULE_LICENSE( "GPL" );
+MODULE_AUTHOR( DRIVER_AUTHOR );
+MODULE_DESCRIPTION( DRIVER_DESC );
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 12, 0)
+MODULE_SUPPORTED_DEVICE( DEVICE_NAME );
+#endif
+
+static int ContructDevice( struct SIOPinDev* pobjDev, int iMinor, int iPin, struct class* pobjClass );
+static irqreturn_t GPIOIntHandler( int iIRQ, void* dev_id );
+static void iopin_exit(void);
+static long SetInterruptions( struct SIOPinDev* dev, ulong ulInterruption );
+
+//-----[ Module parameters ]------
+static unsigned long pins[40];
+static int NumOfDevices;
+module_param_array( pins, ulong, &NumOfDevices, S_IRUGO );
+MODULE_PARM_DESC( pins, "Comma-separated list of pins to be exported" );
+
+static ulong irq_rate_limit = 50000;
+module_param( irq_rate_limit, ulong, S_IRUGO );
+MODULE_PARM_DESC( irq_rate_limit, "Interrupts per second above which a pin is masked (default 50000, 0 = no limit)" );
+
+//------[ Module operations ]------
+// splice() from a device goes through read_iter straight into the pages of the pipe
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+#define  IOPIN_SPLICE_READ    copy_splice_read
+#else
+#define  IOPIN_SPLICE_READ    generic_file_splice_read
+#endif
+
+struct file_operations g_stIOPinFops =
+{
+   .owner            = THIS_MODULE,
+   .open             = iopin_open,
+   .release          = iopin_release,
+   .unlocked_ioctl   = iopin_ioctl,
+   .read_iter        = iopin_read_iter,
+   .splice_read      = IOPIN_SPLICE_READ,
+   .write            = iopin_write,
+   .poll             = iopin_poll,
+};
+
+//------[ Global variables ]------
+static int g_iIOPinMajor;
+static struct class* g_pobjIOPinClass = NULL;
+static struct SIOPinDev* g_astIOPinDevices = NULL;
+// The GPIO interrupts aren't per bank but per group of pins: GPIO0-27, GPIO28-45 and GPIO46-57
+#define  IRQ_GROUPS  3
+static const uint32_t g_aauiGroupPins[IRQ_GROUPS][2] = { { 0x0FFFFFFF, 0 }, { 0xF0000000, 0x00003FFF }, { 0, 0x03FFC000 } };
+static int g_aiIRQRequested[IRQ_GROUPS];
+static int g_aiGroupIRQ[IRQ_GROUPS];   // IRQ of each group (-1 if unknown)
+const struct SIOPinSocLayout* g_pstSocLayout = NULL;
+phys_addr_t g_GpioPhysAddr;         // Physical address of the GPIO block
+struct SGpioRegistersMap* g_pstGpioRegisters = NULL;
+uint32_t g_auiExportedMask[2];      // Exported pins of each bank
+struct SIOPinDev* g_apstPinDevices[IOPIN_NUM_PINS];      // Device of each exported pin
+static DEFINE_SPINLOCK( g_stRegLock );    // Serializes read-modify-write of the registers shared by several pins
+static uint32_t g_auiClaimedMask[2];      // Pins used by a bus, UART, matrix, stepper axis or clock generator
+static DEFINE_SPINLOCK( g_stClaimLock );
+
+static int IsMachineCompatible( const char* szCompatible )
+{
+#ifdef CONFIG_OF
+   return of_machine_is_compatible( szCompatible );
+#else
+   return 0;
+#endif
+}
+
+// Identify the SoC and find its GPIO block and interrupts. The device tree wins over the defaults of the layout
+static void ProbeSoc( void )
+{
+#ifdef CONFIG_OF
+   struct device_node* pstNode;
+   struct resource stResource;
+   unsigned int uiIRQ;
+#endif
+   int i;
+   
+   g_pstSocLayout = IOPinFindSocLayout( IsMachineCompatible );
+   g_GpioPhysAddr = g_pstSocLayout->ulPeriBase + GPIO_OFFSET;
+   for( i = 0; i < IRQ_GROUPS; i++ )
+   {
+      g_aiGroupIRQ[i] = (0 <= g_pstSocLayout->iLegacyIRQ)? (g_pstSocLayout->iLegacyIRQ + i): -1;
+   }
+   
+#ifdef CONFIG_OF
+   pstNode = of_find_compatible_node( NULL, NULL, g_pstSocLayout->szGpioCompatible );
+   if( pstNode )
+   {
+      if( 0 == of_address_to_resource( pstNode, 0, &stResource ) )
+      {
+         g_GpioPhysAddr = stResource.start;
+      }
+      
+      // The first interrupts of the node are the ones of the groups, in order
+      for( i = 0; i < IRQ_GROUPS; i++ )
+      {
+         uiIRQ = irq_of_parse_and_map( pstNode, i );
+         if( uiIRQ )
+         {
+            g_aiGroupIRQ[i] = uiIRQ;
+         }
+      }
+      
+      of_node_put( pstNode );
+   }
+#endif
+   
+   printk( KERN_INFO "[IOPin] %s - GPIO at 0x%08lx, IRQs %d, %d and %d\n", g_pstSocLayout->szName, (unsigned long)g_GpioPhysAddr,
+           g_aiGroupIRQ[0], g_aiGroupIRQ[1], g_aiGroupIRQ[2] );
+}
+
+static int IRQGroup( unsigned long ulPin )
+{
+   return (28 > ulPin)? 0: ((46 > ulPin)? 1: 2);
+}
+
+static int __init iopin_init(void)
+{
+   dev_t dev = 0;
+   int   iRet;
+   int   i;
+   
+   printk( KERN_INFO "[IOPin] Loading module to export %d pin%s...\n", NumOfDevices, ((1 < NumOfDevices)? "s": "") );
+   
+   if( 0 >= NumOfDevices )
+   {
+      printk( KERN_ERR "[IOPin] FAILED TO LOAD: No pin specified\n" );
+      return -EINVAL;
+   }
+   
+   ProbeSoc();
+   
+   for( i = 0; i < NumOfDevices; i++ )
+   {
+      if( g_pstSocLayout->uiNumPins <= pins[i] )
+      {
+         printk( KERN_ERR "[IOPin] FAILED TO LOAD: Invalid pin %lu\n", pins[i] );
+         return -EINVAL;
+      }
+      
+      if( 0 > g_aiGroupIRQ[IRQGroup( pins[i] )] )
+      {
+         printk( KERN_ERR "[IOPin] FAILED TO LOAD: Unknown IRQ for GPIO%lu\n", pins[i] );
+         return -ENODEV;
+      }
+      
+      g_auiExportedMask[pins[i] / 32] |= (1 << (pins[i] % 32));
+   }
+   
+   g_pstGpioRegisters = (struct SGpioRegistersMap*) ioremap( g_GpioPhysAddr, sizeof(struct SGpioRegistersMap) );
+   if( NULL == g_pstGpioRegisters )
+   {
+      printk( KERN_ERR "[IOPin] Failed to map GPIO registers\n" );
+      return -ENOMEM;
+   }
+   
+   // Allocate the array of devices
+   g_astIOPinDevices = (struct SIOPinDev *)kzalloc( NumOfDevices * sizeof(struct SIOPinDev), GFP_KERNEL );
+   if ( NULL == g_astIOPinDevices )
+   {
+      printk( KERN_ERR "[IOPin] Failed to allocate memory\n" );
+      iounmap( g_pstGpioRegisters );
+      g_pstGpioRegisters = NULL;
+      return -ENOMEM;
+   }
+   
+   // Register the driver, let the kernel assing a major number and request some minors (one per pin, then iopinmem and iopintrace)
+   iRet = alloc_chrdev_region( &dev, 0, NumOfDevices + 2, DEVICE_NAME );
+   if ( 0 > iRet )
+   {
+      printk( KERN_ERR "[IOPin] Error registering driver - ret=%d\n", iRet );
+      kfree( g_astIOPinDevices );
+      g_astIOPinDevices = NULL;
+      iounmap( g_pstGpioRegisters );
+      g_pstGpioRegisters = NULL;
+      return iRet;
+   }
+   g_iIOPinMajor = MAJOR(dev);
+   
+   // Create device class (before allocation of the array of devices)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+   g_pobjIOPinClass = class_create( DEVICE_NAME );
+#else
+   g_pobjIOPinClass = class_create( THIS_MODULE, DEVICE_NAME );
+#endif
+   if ( IS_ERR( g_pobjIOPinClass ) )
+   {
+      iRet = PTR_ERR( g_pobjIOPinClass );
+      unregister_chrdev_region( MKDEV(g_iIOPinMajor, 0), NumOfDevices + 2 );
+      kfree( g_astIOPinDevices );
+      g_astIOPinDevices = NULL;
+      iounmap( g_pstGpioRegisters );
+      g_pstGpioRegisters = NULL;
+      return iRet;
+   }
+   
+   // A device can be opened as soon as it is created, so everything its ioctls use must be ready.
+   // The clock manager is at a fixed offset of the GPIO block in the peripheral area
+   iRet = IOPinGpclkInit( g_GpioPhysAddr - GPIO_OFFSET );
+   if( iRet )
+   {
+      class_destroy( g_pobjIOPinClass );
+      unregister_chrdev_region( MKDEV(g_iIOPinMajor, 0), NumOfDevices + 2 );
+      kfree( g_astIOPinDevices );
+      g_astIOPinDevices = NULL;
+      iounmap( g_pstGpioRegisters );
+      g_pstGpioRegisters = NULL;
+      return iRet;
+   }
+   IOPinSchedInit();
+   IOPinPollInit();
+   IOPinStepperInit();
+   IOPinBusInit();
+   IOPinUartInit();
+   IOPinMatrixInit();
+   
+   for( i = 0; i < NumOfDevices; i++ )
+   {  // Create /dev devices
+      iRet = ContructDevice( &g_astIOPinDevices[i], i, pins[i], g_pobjIOPinClass );
+      if ( iRet )
+      {  // Error
+         for( i -= 1; i >= 0; i-- )
+         {  // Destroy the devices that have been created successfully
+            device_destroy( g_pobjIOPinClass, MKDEV( g_iIOPinMajor, i ) );
+            cdev_del(&g_astIOPinDevices[i].stCdev);
+         }
+         IOPinGpclkExit();
+         class_destroy( g_pobjIOPinClass );
+         unregister_chrdev_region( MKDEV(g_iIOPinMajor, 0), NumOfDevices + 2 );
+         kfree( g_astIOPinDevices );
+         g_astIOPinDevices = NULL;
+         iounmap( g_pstGpioRegisters );
+         g_pstGpioRegisters = NULL;
+         return iRet;
+      }
+   }
+   
+   iRet = IOPinMemInit( g_pobjIOPinClass, MKDEV( g_iIOPinMajor, NumOfDevices ) );
+   if( iRet )
+   {
+      iopin_exit();
+      return iRet;
+   }
+   
+   iRet = IOPinTraceInit( g_pobjIOPinClass, MKDEV( g_iIOPinMajor, NumOfDevices + 1 ) );
+   if( iRet )
+   {
+      iopin_exit();
+      return iRet;
+   }
+   
+   iRet = IOPinStatusInit();
+   if( iRet )
+   {
+      iopin_exit();
+      return iRet;
+   }
+   
+   // The IRQ of each group is shared by all the exported pins of that group
+   for( i = 0; i < IRQ_GROUPS; i++ )
+   {
+      if( (g_auiExportedMask[0] & g_aauiGroupPins[i][0]) || (g_auiExportedMask[1] & g_aauiGroupPins[i][1]) )
+      {
+         iRet = request_irq( g_aiGroupIRQ[i], GPIOIntHandler, IRQF_SHARED, "iopin", (void*)g_aauiGroupPins[i] );
+         if( iRet )
+         {
+            printk( KERN_ERR "[IOPin] Couln't get assigned irq %d = Ret=%d\n", g_aiGroupIRQ[i], iRet );
+            iopin_exit();
+            return iRet;
+         }
+         g_aiIRQRequested[i] = 1;
+      }
+   }
+   
+   printk( KERN_INFO "[IOPin] Module loaded\n" );
+   
+   return 0;
+}
+
+static void iopin_exit(void)
+{
+   int i;
+   
+   // The UARTs and matrices first, SetInterruptions refuses their pins
+   IOPinUartExit();
+   IOPinMatrixExit();
+   
+   // The configuration outlives the files, so the detection may still be enabled
+   if( g_astIOPinDevices )
+   {
+      for( i = 0; i < NumOfDevices; i++ )
+      {
+         SetInterruptions( &g_astIOPinDevices[i], 0 );
+      }
+   }
+   
+   for( i = 0; i < IRQ_GROUPS; i++ )
+   {
+      if( g_aiIRQRequested[i] )
+      {
+         free_irq( g_aiGroupIRQ[i], (void*)g_aauiGroupPins[i] );
+         g_aiIRQRequested[i] = 0;
+      }
+   }
+   
+   IOPinStatusExit();
+   IOPinSchedExit();
+   IOPinPollExit();
+   IOPinStepperExit();
+   IOPinGpclkExit();
+   IOPinBusExit();
+   IOPinReflexClear( -1 );
+   
+   // Get rid of all the /dev devices created on the __init
+   if (g_astIOPinDevices)
+   {
+      for ( i = 0; i < NumOfDevices; i++ )
+      {
+         hrtimer_cancel( &g_astIOPinDevices[i].stModTimer );
+         device_destroy( g_pobjIOPinClass, MKDEV( g_iIOPinMajor, i ) );
+         cdev_del(&g_astIOPinDevices[i].stCdev);
+      }
+      kfree( g_astIOPinDevices );
+      g_astIOPinDevices = NULL;
+   }
+   
+   if ( g_pobjIOPinClass )
+   {
+      IOPinMemExit( g_pobjIOPinClass );
+      IOPinTraceExit( g_pobjIOPinClass );
+      class_destroy( g_pobjIOPinClass );
+      g_pobjIOPinClass = NULL;
+   }
+   
+   unregister_chrdev_region( MKDEV(g_iIOPinMajor, 0), NumOfDevices + 2 );
+   
+   if ( g_pstGpioRegisters )
+   {
+      iounmap( g_pstGpioRegisters );
+      g_pstGpioRegisters = NULL;
+   }
+   
+   printk( KERN_INFO "[IOPin] Module removed\n" );
+}
+
+module_init( iopin_init );
+module_exit( iopin_exit );
+
+static int ContructDevice( struct SIOPinDev* pobjDev, int iMinor, int iPin, struct class* pobjClass )
+{
+   int iRet;
+   dev_t devno = MKDEV( g_iIOPinMajor, iMinor );
+   struct device* pstDevice = NULL;
+   
+   BUG_ON( (NULL == pobjDev) || (NULL == pobjClass) );
+   
+   printk( KERN_INFO "[IOPin] Exporting GPIO %d to /dev/%s%d\n", iPin, DEVICE_NAME, iPin );
+   
+   cdev_init( &pobjDev->stCdev, &g_stIOPinFops );
+   pobjDev->stCdev.owner = THIS_MODULE;
+   init_waitqueue_head( &pobjDev->irq_wait );
+   spin_lock_init( &pobjDev->lock );
+   IOPinEventsInit( pobjDev );
+   atomic_set( &pobjDev->stOpenCount, 0 );
+   pobjDev->iPull = -1;
+   pobjDev->iLastEventLevel = -1;
+   pobjDev->iMinor = iMinor;
+   pobjDev->ulPin = iPin;
+   g_apstPinDevices[iPin] = pobjDev;
+   
+   iRet = cdev_add( &pobjDev->stCdev, devno, 1 );
+   if (iRet)
+   {
+      printk( KERN_WARNING "[IOPin] Error %d while trying to add %s%d\n", iRet, DEVICE_NAME, iMinor );
+      return iRet;
+   }
+
+   pstDevice = device_create( pobjClass, NULL, devno, NULL, DEVICE_NAME "%d", iPin);
+   if ( IS_ERR( pstDevice ) )
+   {
+      iRet = PTR_ERR( pstDevice );
+      printk(KERN_WARNING "[IOPin] Error %d while trying to create %s%d\n", iRet, DEVICE_NAME, iMinor);
+      cdev_del( &pobjDev->stCdev );
+      return iRet;
+   }
+   
+   return 0;
+}
+
+// Update the counters of the pin. The status bit doesn't tell which detector fired, so the
+// synchronous and asynchronous counters only say which detection was enabled
+static void CountEvent( struct SIOPinDev* dev, uint32_t uiLevel )
+{
+   ulong ulSyncMatch = uiLevel? (PIN_INTERRUPTION_RISING | PIN_INTERRUPTION_HIGH): (PIN_INTERRUPTION_FALLING | PIN_INTERRUPTION_LOW);
+   ulong ulAsyncMatch = uiLevel? PIN_INTERRUPTION_ASYNC_RISING: PIN_INTERRUPTION_ASYNC_FALLING;
+   ulong ulRising = PIN_INTERRUPTION_RISING | PIN_INTERRUPTION_ASYNC_RISING;
+   ulong ulFalling = PIN_INTERRUPTION_FALLING | PIN_INTERRUPTION_ASYNC_FALLING;
+   int iLevel = uiLevel? 1: 0;
+   int iBothEdges;
+   
+   spin_lock( &dev->lock );
+   
+   iBothEdges = (dev->ulInterruption & ulRising) && (dev->ulInterruption & ulFalling) &&
+                !(dev->ulInterruption & (PIN_INTERRUPTION_HIGH | PIN_INTERRUPTION_LOW));
+   
+   dev->stStats.ullEvents++;
+   if( dev->ulInterruption & ulSyncMatch )
+   {
+      dev->stStats.ullSyncEvents++;
+   }
+   if( dev->ulInterruption & (PIN_INTERRUPTION_ASYNC_RISING | PIN_INTERRUPTION_ASYNC_FALLING) )
+   {
+      dev->stStats.ullAsyncEvents++;
+      
+      // Either no enabled edge leads to the current level, or both edges are enabled and the pin is
+      // at the level of the previous event: the pulse ended before we got here
+      if( !(dev->ulInterruption & (ulSyncMatch | ulAsyncMatch)) || (iBothEdges && (iLevel == dev->iLastEventLevel)) )
+      {
+         dev->stStats.ullMissedPulses++;
+      }
+   }
+   dev->iLastEventLevel = iLevel;
+   
+   spin_unlock( &dev->lock );
+}
+
+/*
+ * A level detection keeps latching the event while the level holds, so it is masked after each
+ * event and re-armed when userspace reads. Any pin that goes over the rate limit is masked
+ * completely until its interruptions are configured again
+ */
+// Counts the event and hands it to the reader. Also used for the events found by polling
+void IOPinNotifyEvent( struct SIOPinDev* dev, uint32_t uiLevel, u64 ullTimestamp )
+{
+   CountEvent( dev, uiLevel );
+   
+   IOPinTraceEdge( dev->ulPin, uiLevel, ullTimestamp );
+   
+   // Queued one by one, the reader is woken up as the moderation of the pin says
+   IOPinQueueEvent( dev, uiLevel, ullTimestamp );
+}
+
+static void ProtectFromStorm( struct SIOPinDev* dev, uint32_t uiLevel, u64 ullTimestamp )
+{
+   ulong ulMask = 0;
+   
+   spin_lock( &dev->lock );
+   
+   if( (ullTimestamp - dev->ullWindowStart) >= IOPIN_RATE_WINDOW_NS )
+   {
+      dev->stStats.uiEventRate = dev->ulWindowEvents * (NSEC_PER_SEC / IOPIN_RATE_WINDOW_NS);
+      dev->ullWindowStart = ullTimestamp;
+      dev->ulWindowEvents = 0;
+   }
+   dev->ulWindowEvents++;
+   
+   if( !(dev->uiMaskState & PIN_MASKED_POLLING) && IOPinPollWanted( dev->ulWindowEvents ) )
+   {  // Too fast for interrupts but not a storm yet: sample the pin instead
+      IOPinPollStart( dev, uiLevel, ullTimestamp );
+      ulMask = dev->ulInterruption;
+   }
+   else if( irq_rate_limit && (dev->ulWindowEvents > (irq_rate_limit / (NSEC_PER_SEC / IOPIN_RATE_WINDOW_NS))) &&
+       !(dev->uiMaskState & PIN_MASKED_STORM) )
+   {
+      dev->uiMaskState |= PIN_MASKED_STORM;
+      dev->stStats.ullStorms++;
+      ulMask = dev->ulInterruption;
+      printk( KERN_WARNING "[IOPin] GPIO%lu: interrupt storm, masking the pin\n", dev->ulPin );
+   }
+   else if( (dev->ulInterruption & (PIN_INTERRUPTION_HIGH | PIN_INTERRUPTION_LOW)) && !(dev->uiMaskState & PIN_MASKED_LEVEL) )
+   {
+      dev->uiMaskState |= PIN_MASKED_LEVEL;
+      dev->stStats.ullLevelMasks++;
+      ulMask = PIN_INTERRUPTION_HIGH | PIN_INTERRUPTION_LOW;
+   }
+   
+   spin_unlock( &dev->lock );
+   
+   if( ulMask )
+   {
+      IOPinWriteInterruptions( dev, dev->ulInterruption & ~ulMask );
+      
+      // The level may have latched the event again before it was masked
+      iowrite32( 1 << (dev->ulPin % 32), &g_pstGpioRegisters->GPEDS[dev->ulPin / 32] );
+   }
+}
+
+// Re-enable the level detection masked by the last event
+static void RearmLevel( struct SIOPinDev* dev )
+{
+   unsigned long ulFlags;
+   int iRearm;
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   iRearm = (PIN_MASKED_LEVEL == dev->uiMaskState);
+   dev->uiMaskState &= ~PIN_MASKED_LEVEL;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   if( iRearm )
+   {
+      IOPinWriteBit( g_pstGpioRegisters->GPHEN, dev->ulPin, dev->ulInterruption & PIN_INTERRUPTION_HIGH );
+      IOPinWriteBit( g_pstGpioRegisters->GPLEN, dev->ulPin, dev->ulInterruption & PIN_INTERRUPTION_LOW );
+   }
+}
+
+// dev_id is the pins of the group of the IRQ in each bank, GPIO28-45 span both
+static irqreturn_t GPIOIntHandler( int iIRQ, void* dev_id )
+{
+   const uint32_t* puiGroupPins = (const uint32_t*)dev_id;
+   uint32_t auiPending[2];
+   uint32_t auiLevels[2];
+   unsigned int uiBank;
+   unsigned long ulPin;
+   struct SIOPinDev* dev;
+   u64 ullTimestamp;
+   
+   for( uiBank = 0; uiBank < 2; uiBank++ )
+   {
+      auiPending[uiBank] = 0;
+      if( g_auiExportedMask[uiBank] & puiGroupPins[uiBank] )
+      {
+         auiPending[uiBank] = ioread32( &g_pstGpioRegisters->GPEDS[uiBank] ) & g_auiExportedMask[uiBank] & puiGroupPins[uiBank];
+      }
+   }
+   if( (0 == auiPending[0]) && (0 == auiPending[1]) )
+   {  // The interrupt was not generated by any of the IOs that I am handling
+      return IRQ_NONE;
+   }
+   
+   //printk( KERN_WARNING "[IOPin] GPIOIntHandler: IRQ=%d\n", iIRQ );
+   
+   for( uiBank = 0; uiBank < 2; uiBank++ )
+   {
+      if( auiPending[uiBank] )
+      {
+         iowrite32( auiPending[uiBank], &g_pstGpioRegisters->GPEDS[uiBank] );
+      }
+   }
+   
+   ullTimestamp = ktime_get_ns();
+   auiLevels[0] = ioread32( &g_pstGpioRegisters->GPLEV[0] );
+   auiLevels[1] = ioread32( &g_pstGpioRegisters->GPLEV[1] );
+   
+   for( uiBank = 0; uiBank < 2; uiBank++ )
+   {
+      while( auiPending[uiBank] )
+      {
+         ulPin = (uiBank * 32) + __ffs( auiPending[uiBank] );
+         auiPending[uiBank] &= auiPending[uiBank] - 1;
+         
+         // A protocol decoder needs every edge: no interlocks, rate limit nor events
+         dev = g_apstPinDevices[ulPin];
+         if( IOPinCaptureEdge( dev, auiLevels[uiBank] & (1 << (ulPin % 32)), ullTimestamp ) )
+         {
+            continue;
+         }
+         
+         // Start bit of a soft UART, the rest of the frame is sampled by its timer
+         if( IOPinUartEdge( dev, ullTimestamp ) )
+         {
+            continue;
+         }
+         
+         // Interlocks first, userspace is notified afterwards
+         IOPinReflexEvaluate( ulPin, auiLevels, ullTimestamp );
+         
+         ProtectFromStorm( dev, auiLevels[uiBank] & (1 << (ulPin % 32)), ullTimestamp );
+         IOPinNotifyEvent( dev, auiLevels[uiBank] & (1 << (ulPin % 32)), ullTimestamp );
+      }
+   }
+   
+   return IRQ_HANDLED;
+}
+
+// Set or clear the bit of a pin in one of the registers shared by the whole bank
+void IOPinWriteBit( uint32_t* puiRegister, unsigned long ulPin, int iValue )
+{
+   unsigned long ulFlags;
+   uint32_t uiValue;
+   
+   spin_lock_irqsave( &g_stRegLock, ulFlags );
+   uiValue = ioread32( &puiRegister[ulPin / 32] );
+   if( iValue )
+   {
+      uiValue |= (1 << (ulPin % 32));
+   }
+   else
+   {
+      uiValue &= ~(1 << (ulPin % 32));
+   }
+   iowrite32( uiValue, &puiRegister[ulPin / 32] );
+   spin_unlock_irqrestore( &g_stRegLock, ulFlags );
+}
+
+// Uses the native mechanism of the SoC (clocked sequence on the BCM2835, direct register on the BCM2711)
+void IOPinSetPull( unsigned long ulPin, unsigned long ulPull )
+{
+   unsigned long ulFlags;
+   
+   spin_lock_irqsave( &g_stRegLock, ulFlags );
+   g_pstSocLayout->pfnSetPull( g_pstGpioRegisters, ulPin, ulPull );
+   spin_unlock_irqrestore( &g_stRegLock, ulFlags );
+}
+
+// Claims all the pins of the mask at once, or none when one of them is already used. Can be called with a spinlock held
+int IOPinClaimPins( const uint32_t* puiMask )
+{
+   unsigned long ulFlags;
+   int iRet = 0;
+   
+   spin_lock_irqsave( &g_stClaimLock, ulFlags );
+   if( (g_auiClaimedMask[0] & puiMask[0]) || (g_auiClaimedMask[1] & puiMask[1]) )
+   {
+      iRet = -EBUSY;
+   }
+   else
+   {
+      g_auiClaimedMask[0] |= puiMask[0];
+      g_auiClaimedMask[1] |= puiMask[1];
+   }
+   spin_unlock_irqrestore( &g_stClaimLock, ulFlags );
+   
+   return iRet;
+}
+
+void IOPinReleasePins( const uint32_t* puiMask )
+{
+   unsigned long ulFlags;
+   
+   spin_lock_irqsave( &g_stClaimLock, ulFlags );
+   g_auiClaimedMask[0] &= ~puiMask[0];
+   g_auiClaimedMask[1] &= ~puiMask[1];
+   spin_unlock_irqrestore( &g_stClaimLock, ulFlags );
+}
+
+void IOPinSetFunction( unsigned long ulPin, unsigned int uiFunction )
+{
+   unsigned int uiRegisterIndex = ulPin / 10;
+   unsigned int uiBit = (ulPin % 10) * 3;
+   unsigned long ulFlags;
+   uint32_t uiOldValue;
+   
+   spin_lock_irqsave( &g_stRegLock, ulFlags );
+   uiOldValue = ioread32( &g_pstGpioRegisters->GPFSEL[uiRegisterIndex] );
+   iowrite32( (uiOldValue & ~(0b111 << uiBit)) | ((uiFunction & 0b111) << uiBit), &g_pstGpioRegisters->GPFSEL[uiRegisterIndex] );
+   spin_unlock_irqrestore( &g_stRegLock, ulFlags );
+}
+
+// Write the detection enables of the pin. dev->ulInterruption keeps the configuration requested
+void IOPinWriteInterruptions( struct SIOPinDev* dev, ulong ulInterruption )
+{
+   IOPinWriteBit( g_pstGpioRegisters->GPREN, dev->ulPin, ulInterruption & PIN_INTERRUPTION_RISING );
+   IOPinWriteBit( g_pstGpioRegisters->GPFEN, dev->ulPin, ulInterruption & PIN_INTERRUPTION_FALLING );
+   IOPinWriteBit( g_pstGpioRegisters->GPHEN, dev->ulPin, ulInterruption & PIN_INTERRUPTION_HIGH );
+   IOPinWriteBit( g_pstGpioRegisters->GPLEN, dev->ulPin, ulInterruption & PIN_INTERRUPTION_LOW );
+   IOPinWriteBit( g_pstGpioRegisters->GPAREN, dev->ulPin, ulInterruption & PIN_INTERRUPTION_ASYNC_RISING );
+   IOPinWriteBit( g_pstGpioRegisters->GPAFEN, dev->ulPin, ulInterruption & PIN_INTERRUPTION_ASYNC_FALLING );
+}
+
+// Back from polling to the interrupts configured on the pin
+void IOPinResumeInterruptions( struct SIOPinDev* dev )
+{
+   unsigned long ulFlags;
+   ulong ulInterruption;
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   dev->uiMaskState &= ~PIN_MASKED_POLLING;
+   ulInterruption = dev->ulInterruption;
+   if( dev->uiMaskState & PIN_MASKED_LEVEL )
+   {  // Still waiting for a read
+      ulInterruption &= ~(PIN_INTERRUPTION_HIGH | PIN_INTERRUPTION_LOW);
+   }
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   // Forget what was latched before the detection was masked
+   iowrite32( 1 << (dev->ulPin % 32), &g_pstGpioRegisters->GPEDS[dev->ulPin / 32] );
+   IOPinWriteInterruptions( dev, ulInterruption );
+}
+
+// EBUSY while the detection belongs to a capture, a UART or a key matrix
+static long SetInterruptions( struct SIOPinDev* dev, ulong ulInterruption )
+{
+   unsigned long ulFlags;
+   
+   IOPinPollStop( dev );
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   if( dev->pstCapture || dev->pstUart || dev->pstMatrix )
+   {
+      spin_unlock_irqrestore( &dev->lock, ulFlags );
+      return -EBUSY;
+   }
+   dev->ulInterruption = ulInterruption;
+   dev->uiMaskState = 0;
+   dev->iLastEventLevel = -1;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   IOPinWriteInterruptions( dev, ulInterruption );
+   
+   return 0;
+}
+
+int iopin_open(struct inode* inode, struct file* filp)
+{
+   unsigned int iMajor = imajor(inode);
+   unsigned int iMinor = iminor(inode);
+   unsigned int uiFunction;
+   struct SIOPinDev* dev = NULL;
+   struct SIOPinFile* pstFile;
+   
+   //printk(KERN_INFO "[IOPin] open on %d:%d\n", iMajor, iMinor);
+   
+   if ( (iMajor != g_iIOPinMajor) || (0 > iMinor) || (iMinor >= NumOfDevices) )
+   {
+      printk(KERN_WARNING "[IOPin] open: No device found with Major=%d and Minor=%d\n", iMajor, iMinor);
+      return -ENODEV;
+   }
+   
+   dev = &g_astIOPinDevices[iMinor];
+   
+   if (inode->i_cdev != &dev->stCdev)
+   {
+      printk(KERN_WARNING "[IOPin] open: internal error\n");
+      return -ENODEV;
+   }
+   
+   // Check the current configuration. If it is not input nor output, it is probably been used by another driver.
+   // In that case, we are going to fail the open. A clock started through the device is ours: it must
+   // be possible to open the device again to stop it
+   uiFunction = IOPinGetFunction( dev->ulPin );
+   if( (PIN_FUNCTION_INPUT != uiFunction) && (PIN_FUNCTION_OUTPUT != uiFunction ) && !IOPinGpclkOwns( dev->ulPin ) )
+   {  // Neither input nor output
+      printk( KERN_WARNING "[IOPin] open: GPIO%lu it no configures as an alternate function (%u)\n", dev->ulPin, uiFunction );
+      return -EIO;
+   }
+   
+   // Each file has its own cursor in the events of the pin. The configuration of the pin is
+   // shared and kept as it is: another file may be using it
+   pstFile = (struct SIOPinFile*)kzalloc( sizeof(struct SIOPinFile), GFP_KERNEL );
+   if( NULL == pstFile )
+   {
+      return -ENOMEM;
+   }
+   IOPinFileInit( pstFile, dev );
+   
+   // Store a pointer to struct SIOPinFile here for other methods
+   filp->private_data = pstFile;
+   atomic_inc( &dev->stOpenCount );
+   
+   return 0;
+}
+
+int iopin_release(struct inode* inode, struct file* filp)
+{
+   struct SIOPinFile* pstFile = (struct SIOPinFile*)filp->private_data;
+   struct SIOPinDev* dev = pstFile->pstDev;
+   
+   //printk( KERN_INFO "[IOPin] release: Releasing minor %d\n", dev->iMinor );
+   
+   if (inode->i_cdev != &dev->stCdev)
+   {
+      printk( KERN_WARNING "[IOPin] release: internal error\n" );
+      return -ENODEV;
+   }
+   
+   // The configuration stays until IOCTL_RESET_CONFIG, so a process can restart without
+   // reconfiguring the pin or blinding the others
+   atomic_dec( &dev->stOpenCount );
+   kfree( pstFile );
+   
+   return 0;
+}
+
+long iopin_ioctl( struct file* filp, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   struct SIOPinFile* pstFile = (struct SIOPinFile*)filp->private_data;
+   struct SIOPinDev* dev = pstFile->pstDev;
+   long lRet;
+   
+   switch (ioctl_num)
+   {
+      case IOCTL_SET_FUNCTION:
+      {  // Configure the pin function
+         if( (PIN_FUNCTION_INPUT != ioctl_param) && (PIN_FUNCTION_OUTPUT != ioctl_param) )
+         {
+            printk( KERN_WARNING "[IOPin] ioctl: Invalid pin function %lu\n", ioctl_param );
+            return -EINVAL;
+         }
+         
+         printk( KERN_INFO "[IOPin] ioctl: Changing function of GPIO%lu from %x to %lx\n", dev->ulPin, IOPinGetFunction( dev->ulPin ), ioctl_param );
+         IOPinSetFunction( dev->ulPin, ioctl_param );
+         
+         break;
+      }
+      
+      case IOCTL_SET_INTERRUPTION:
+      {
+         return SetInterruptions( dev, ioctl_param );
+      }
+      
+      case IOCTL_GET_STATS:
+      {
+         struct SIOPinStats stStats;
+         unsigned long ulFlags;
+         
+         spin_lock_irqsave( &dev->lock, ulFlags );
+         stStats = dev->stStats;
+         stStats.uiMaskState = dev->uiMaskState;
+         stStats.ullDroppedEvents = pstFile->ullOverruns;
+         spin_unlock_irqrestore( &dev->lock, ulFlags );
+         
+         if( copy_to_user( (void __user*)ioctl_param, &stStats, sizeof(stStats) ) )
+         {
+            return -EFAULT;
+         }
+         break;
+      }
+      
+      case IOCTL_SET_PULL:
+      {
+         if( (PIN_PULL_OFF  != ioctl_param) &&
+             (PIN_PULL_UP   != ioctl_param) &&
+             (PIN_PULL_DOWN != ioctl_param) )
+         {
+            printk( KERN_WARNING "[IOPin] ioctl: Invalid pull state %lu\n", ioctl_param );
+            return -EINVAL;
+         }
+         
+         IOPinSetPull( dev->ulPin, ioctl_param );
+         dev->iPull = ioctl_param;
+         break;
+      }
+      
+      case IOCTL_SCHEDULE_OUTPUT:
+      case IOCTL_CANCEL_SCHEDULE:
+      case IOCTL_GET_SCHED_STATS:
+      {
+         return IOPinSchedIoctl( dev, ioctl_num, ioctl_param );
+      }
+      
+      case IOCTL_ADD_REFLEX:
+      case IOCTL_DEL_REFLEX:
+      case IOCTL_GET_REFLEX:
+      {
+         return IOPinReflexIoctl( dev, ioctl_num, ioctl_param );
+      }
+      
+      case IOCTL_SET_READ_MODE:
+      case IOCTL_SET_MODERATION:
+      {
+         return IOPinEventsIoctl( pstFile, filp, ioctl_num, ioctl_param );
+      }
+      
+      case IOCTL_WAIT_EDGE:
+      {  // Like a read, it re-arms the level detection
+         lRet = IOPinEventsIoctl( pstFile, filp, ioctl_num, ioctl_param );
+         RearmLevel( dev );
+         return lRet;
+      }
+      
+      case IOCTL_RESET_CONFIG:
+      {
+         // As after loading the module: input, no interruptions, interlocks, steppers, bus, clock, UART, key matrix nor moderation
+         IOPinUartRelease( dev );
+         IOPinMatrixRelease( dev );
+         SetInterruptions( dev, 0 );
+         IOPinReflexClear( dev->ulPin );
+         IOPinStepperRelease( dev->ulPin );
+         IOPinGpclkRelease( dev->ulPin );
+         IOPinBusRelease( dev->ulPin );
+         IOPinEventsReset( dev );
+         IOPinSetFunction( dev->ulPin, PIN_FUNCTION_INPUT );
+         break;
+      }
+      
+      case IOCTL_STEPPER_BIND:
+      case IOCTL_STEPPER_UNBIND:
+      case IOCTL_STEPPER_MOVE:
+      case IOCTL_STEPPER_STOP:
+      case IOCTL_STEPPER_STATUS:
+      {
+         return IOPinStepperIoctl( dev, ioctl_num, ioctl_param );
+      }
+      
+      case IOCTL_DHT_READ:
+      {
+         return IOPinDhtIoctl( dev, ioctl_num, ioctl_param );
+      }
+      
+      case IOCTL_UART_BIND:
+      case IOCTL_UART_UNBIND:
+      case IOCTL_UART_STATS:
+      {
+         return IOPinUartIoctl( dev, ioctl_num, ioctl_param );
+      }
+      
+      case IOCTL_MATRIX_BIND:
+      case IOCTL_MATRIX_UNBIND:
+      case IOCTL_MATRIX_STATE:
+      {
+         return IOPinMatrixIoctl( dev, ioctl_num, ioctl_param );
+      }
+      
+      case IOCTL_BUS_BIND:
+      case IOCTL_BUS_UNBIND:
+      case IOCTL_BUS_TRANSFER:
+      {
+         return IOPinBusIoctl( dev, ioctl_num, ioctl_param );
+      }
+      
+      case IOCTL_CLOCK_START:
+      case IOCTL_CLOCK_STOP:
+      {
+         return IOPinGpclkIoctl( dev, ioctl_num, ioctl_param );
+      }
+      
+      case IOCTL_GET_EXPORTED_MASK:
+      {
+         return IOPinGetExportedMask( ioctl_param );
+      }
+      
+      default:
+      {
+         printk( KERN_WARNING "[IOPin] Unkown ioctl %u\n", ioctl_num );
+         return -EINVAL;
+      }
+   }
+   
+   return 0;
+}
+
+// Serves read() and splice()
+ssize_t iopin_read_iter( struct kiocb* iocb, struct iov_iter* to )
+{
+   struct SIOPinFile* pstFile = (struct SIOPinFile*)iocb->ki_filp->private_data;
+   struct SIOPinDev* dev = pstFile->pstDev;
+   unsigned int uiValue;
+   ssize_t iRet;
+   char chValue;
+   
+   //printk(KERN_INFO "[IOPin] Read on minor %d\n", dev->iMinor );
+   
+   if( dev->pstUart )
+   {
+      return IOPinUartRead( dev, iocb, to );
+   }
+   if( dev->pstMatrix )
+   {
+      return IOPinMatrixRead( dev, iocb, to );
+   }
+   
+   if( READ_MODE_EVENTS == pstFile->uiReadMode )
+   {
+      iRet = IOPinReadEvents( pstFile, iocb, to );
+      RearmLevel( dev );
+      return iRet;
+   }
+   
+   if( 1 > iov_iter_count( to ) )
+   {
+      return 0;
+   }
+   
+   uiValue = ioread32( &g_pstGpioRegisters->GPLEV[dev->ulPin / 32] );
+   uiValue &= (1 << (dev->ulPin % 32));      // Mask the desired bit
+   
+   chValue = uiValue? '1': '0';
+   if( 1 != copy_to_iter( &chValue, 1, to ) )
+   {
+      return -EFAULT;
+   }
+   
+   // Acknowledge the events to signal that this file read the current state
+   IOPinAckEvents( pstFile );
+   RearmLevel( dev );
+   
+   return 1;
+}
+
+ssize_t iopin_write(struct file* filp, const char __user* buf, size_t count, loff_t* f_pos)
+{
+   struct SIOPinFile* pstFile = (struct SIOPinFile*)filp->private_data;
+   struct SIOPinDev* dev = pstFile->pstDev;
+   unsigned int uiFunction;
+   char  chValue;
+   
+   //printk(KERN_INFO "[IOPin] Write on minor %d\n", dev->iMinor );
+   
+   if( dev->pstUart )
+   {
+      return IOPinUartWrite( dev, filp, buf, count );
+   }
+   
+   // Get configured function
+   uiFunction = IOPinGetFunction( dev->ulPin );
+   
+   // Check if pin is output
+   if( PIN_FUNCTION_OUTPUT != uiFunction )
+   {
+      printk(KERN_INFO "[IOPin] GPIO%lu not configure as output (%x)\n", dev->ulPin, uiFunction );
+      return -EPERM;
+   }
+   else if( 1 <= count )
+   {
+      // The first byte is the only one that matters for us
+      get_user( chValue, buf );
+      
+      if( '1' == chValue )
+      {
+         iowrite32( (1 << (dev->ulPin % 32)), &g_pstGpioRegisters->GPSET[dev->ulPin / 32] );
+      }
+      else
+      {
+         iowrite32( (1 << (dev->ulPin % 32)), &g_pstGpioRegisters->GPCLR[dev->ulPin / 32] );
+      }
+   }
+   
+   return count;
+}
+
+unsigned int iopin_poll( struct file* filp, poll_table* wait_table )
+{
+   struct SIOPinFile* pstFile = (struct SIOPinFile*)filp->private_data;
+   struct SIOPinDev* dev = pstFile->pstDev;
+   unsigned int mask = 0;
+   
+   poll_wait( filp, &dev->irq_wait, wait_table );
+   
+   if( dev->pstUart )
+   {  // The FIFOs instead of the events
+      return IOPinUartPoll( dev );
+   }
+   if( dev->pstMatrix )
+   {  // The key events instead of the pin events
+      return IOPinMatrixPoll( dev );
+   }
+   
+   if( IOPinHasEvents( pstFile ) )
+   {  // There is an event that this file has not read yet
+      mask |= (POLLIN | POLLRDNORM);
+   }
+   
+   if( dev->uiMaskState & PIN_MASKED_STORM )
+   {  // The pin was masked and won't generate events until it is configured again
+      mask |= POLLPRI;
+   }
+   
+   return mask;
+}
@@ -0,0 +1,506 @@
+/*
+ *  iopin_matrix.c - Key matrix scanner
+ *
+ *  One hrtimer per matrix scans it: each row is pulled low (GPCLR, then switched to output), the
+ *  columns of every key of the row are read at once from GPLEV and the row goes back to input.
+ *  The rows are open drain, never driven high, so two keys down can't short two rows. The samples
+ *  of the whole matrix are debounced together (iopin_debounce.c) and only the keys that change
+ *  make an event, so userspace sleeps until a key goes down or up.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/uio.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin_debounce.h"
+#include "iopin.h"
+
+#define  MATRIX_DEFAULT_SCAN_US     1000
+#define  MATRIX_DEFAULT_SETTLE_NS   1000
+#define  MATRIX_DEFAULT_DEBOUNCE    5
+#define  MATRIX_MIN_SCAN_US         100
+#define  MATRIX_MAX_SCAN_US         100000
+#define  MATRIX_MAX_SETTLE_NS       20000
+
+struct SIOPinMatrix
+{
+   spinlock_t           lock;
+   int                  iBound;
+   struct SIOPinDev*    pstDev;              // Its read() returns the key events
+   struct SIOPinMatrixConfig stConfig;
+   uint32_t             auiColumnMask[2];    // Column pins of each bank
+   uint32_t             auiPinMask[2];       // Every pin of the matrix, claimed while bound
+   struct hrtimer       stTimer;
+   struct SIOPinDebounce stDebounce;
+   struct SIOPinKeyEvent astEvents[MATRIX_EVENT_QUEUE];
+   unsigned int         uiHead;
+   unsigned int         uiCount;
+   u64                  ullScans;
+   uint32_t             uiOverruns;
+};
+
+//------[ Global variables ]------
+static struct SIOPinMatrix g_astMatrices[MATRIX_MAX_MATRICES];
+static DEFINE_MUTEX( g_stMatrixMutex );   // Bind and unbind
+
+// The keys down of the whole matrix, one bit per key. Doesn't need the lock: the pins don't change while bound
+static uint64_t Scan( struct SIOPinMatrix* pstMatrix )
+{
+   const struct SIOPinMatrixConfig* pstConfig = &pstMatrix->stConfig;
+   uint32_t auiLevels[2] = { ~0U, ~0U };
+   uint64_t ullSamples = 0;
+   unsigned int uiRow;
+   unsigned int uiColumn;
+   unsigned int i;
+   long lPin;
+   
+   for( uiRow = 0; uiRow < pstConfig->uiRows; uiRow++ )
+   {
+      lPin = pstConfig->aiRowPins[uiRow];
+      iowrite32( 1U << (lPin % 32), &g_pstGpioRegisters->GPCLR[lPin / 32] );
+      IOPinSetFunction( lPin, PIN_FUNCTION_OUTPUT );
+      ndelay( pstConfig->uiSettleNs );
+      
+      // One read for all the columns (two if they are in both banks)
+      for( i = 0; i < 2; i++ )
+      {
+         if( pstMatrix->auiColumnMask[i] )
+         {
+            auiLevels[i] = ioread32( &g_pstGpioRegisters->GPLEV[i] );
+         }
+      }
+      IOPinSetFunction( lPin, PIN_FUNCTION_INPUT );
+      
+      for( uiColumn = 0; uiColumn < pstConfig->uiColumns; uiColumn++ )
+      {
+         lPin = pstConfig->aiColumnPins[uiColumn];
+         if( !(auiLevels[lPin / 32] & (1U << (lPin % 32))) )
+         {
+            ullSamples |= 1ULL << (uiRow * MATRIX_MAX_COLUMNS + uiColumn);
+         }
+      }
+   }
+   
+   return ullSamples;
+}
+
+// Called with pstMatrix->lock held
+static void QueueKey( struct SIOPinMatrix* pstMatrix, unsigned int uiKey, u64 ullTimestamp )
+{
+   struct SIOPinKeyEvent* pstEvent;
+   
+   if( MATRIX_EVENT_QUEUE == pstMatrix->uiCount )
+   {
+      pstMatrix->uiOverruns++;
+      return;
+   }
+   
+   pstEvent = &pstMatrix->astEvents[(pstMatrix->uiHead + pstMatrix->uiCount) % MATRIX_EVENT_QUEUE];
+   pstEvent->ullTimestampNs = ullTimestamp;
+   pstEvent->ucKey = uiKey;
+   pstEvent->ucRow = uiKey / MATRIX_MAX_COLUMNS;
+   pstEvent->ucColumn = uiKey % MATRIX_MAX_COLUMNS;
+   pstEvent->ucPressed = (pstMatrix->stDebounce.ullState >> uiKey) & 1;
+   pstEvent->uiReserved = 0;
+   pstMatrix->uiCount++;
+}
+
+static enum hrtimer_restart MatrixTimerHandler( struct hrtimer* pstTimer )
+{
+   struct SIOPinMatrix* pstMatrix = container_of( pstTimer, struct SIOPinMatrix, stTimer );
+   unsigned long ulFlags;
+   uint64_t ullSamples;
+   uint64_t ullChanged;
+   uint64_t ullPending;
+   u64 ullTimestamp;
+   unsigned int i;
+   
+   if( !pstMatrix->iBound )
+   {
+      return HRTIMER_NORESTART;
+   }
+   
+   ullSamples = Scan( pstMatrix );
+   ullTimestamp = ktime_get_ns();
+   
+   spin_lock_irqsave( &pstMatrix->lock, ulFlags );
+   pstMatrix->ullScans++;
+   ullChanged = IOPinDebounceScan( &pstMatrix->stDebounce, ullSamples );
+   for( i = 0, ullPending = ullChanged; ullPending; i++, ullPending >>= 1 )
+   {
+      if( ullPending & 1 )
+      {
+         QueueKey( pstMatrix, i, ullTimestamp );
+      }
+   }
+   spin_unlock_irqrestore( &pstMatrix->lock, ulFlags );
+   
+   if( ullChanged )
+   {
+      wake_up_interruptible( &pstMatrix->pstDev->irq_wait );
+   }
+   
+   hrtimer_forward_now( pstTimer, ns_to_ktime( (u64)pstMatrix->stConfig.uiScanUs * NSEC_PER_USEC ) );
+   return HRTIMER_RESTART;
+}
+
+static int IsPort( struct SIOPinMatrix* pstMatrix, struct SIOPinDev* dev )
+{
+   return pstMatrix->iBound && (pstMatrix->pstDev == dev);
+}
+
+static int HasEvents( struct SIOPinMatrix* pstMatrix, struct SIOPinDev* dev )
+{
+   return !IsPort( pstMatrix, dev ) || pstMatrix->uiCount;
+}
+
+// Fills the defaults and checks the configuration. The pins must be exported and all different
+static long CheckConfig( struct SIOPinDev* dev, struct SIOPinMatrixConfig* pstConfig )
+{
+   uint64_t ullUsed = 0;
+   int iOwnPin = 0;
+   long lPin;
+   unsigned int i;
+   
+   if( 0 == pstConfig->uiScanUs )
+   {
+      pstConfig->uiScanUs = MATRIX_DEFAULT_SCAN_US;
+   }
+   if( 0 == pstConfig->uiSettleNs )
+   {
+      pstConfig->uiSettleNs = MATRIX_DEFAULT_SETTLE_NS;
+   }
+   if( 0 == pstConfig->uiDebounceScans )
+   {
+      pstConfig->uiDebounceScans = MATRIX_DEFAULT_DEBOUNCE;
+   }
+   
+   // The scan must not take more than half of the CPU
+   if( (0 == pstConfig->uiRows) || (MATRIX_MAX_ROWS < pstConfig->uiRows) ||
+       (0 == pstConfig->uiColumns) || (MATRIX_MAX_COLUMNS < pstConfig->uiColumns) ||
+       (MATRIX_MIN_SCAN_US > pstConfig->uiScanUs) || (MATRIX_MAX_SCAN_US < pstConfig->uiScanUs) ||
+       (MATRIX_MAX_SETTLE_NS < pstConfig->uiSettleNs) ||
+       ((pstConfig->uiRows * pstConfig->uiSettleNs) > (pstConfig->uiScanUs * NSEC_PER_USEC / 2)) ||
+       (255 < pstConfig->uiDebounceScans) )
+   {
+      return -EINVAL;
+   }
+   
+   for( i = 0; i < pstConfig->uiRows + pstConfig->uiColumns; i++ )
+   {
+      lPin = (i < pstConfig->uiRows)? pstConfig->aiRowPins[i]: pstConfig->aiColumnPins[i - pstConfig->uiRows];
+      if( (0 > lPin) || (IOPIN_NUM_PINS <= lPin) || (NULL == g_apstPinDevices[lPin]) || (ullUsed & (1ULL << lPin)) )
+      {
+         return -EINVAL;
+      }
+      ullUsed |= 1ULL << lPin;
+      iOwnPin |= (lPin == dev->ulPin);
+   }
+   
+   // The events are read through the device of one of the pins
+   return iOwnPin? 0: -EINVAL;
+}
+
+static long Bind( struct SIOPinDev* dev, struct SIOPinMatrixConfig* pstConfig )
+{
+   struct SIOPinMatrix* pstMatrix = NULL;
+   uint32_t auiPinMask[2] = { 0, 0 };
+   unsigned long ulFlags;
+   unsigned int i;
+   long lRet;
+   long lPin;
+   
+   lRet = CheckConfig( dev, pstConfig );
+   if( lRet )
+   {
+      return lRet;
+   }
+   
+   for( i = 0; i < pstConfig->uiRows + pstConfig->uiColumns; i++ )
+   {
+      lPin = (i < pstConfig->uiRows)? pstConfig->aiRowPins[i]: pstConfig->aiColumnPins[i - pstConfig->uiRows];
+      auiPinMask[lPin / 32] |= 1U << (lPin % 32);
+   }
+   
+   mutex_lock( &g_stMatrixMutex );
+   
+   if( dev->pstMatrix || dev->pstUart )
+   {
+      mutex_unlock( &g_stMatrixMutex );
+      return -EBUSY;
+   }
+   
+   for( i = 0; (i < MATRIX_MAX_MATRICES) && (NULL == pstMatrix); i++ )
+   {
+      if( !g_astMatrices[i].iBound )
+      {
+         pstMatrix = &g_astMatrices[i];
+      }
+   }
+   if( NULL == pstMatrix )
+   {
+      mutex_unlock( &g_stMatrixMutex );
+      return -ENOSPC;
+   }
+   
+   // Not used by another matrix, a UART, a bus, a stepper axis or a clock generator
+   lRet = IOPinClaimPins( auiPinMask );
+   if( lRet )
+   {
+      mutex_unlock( &g_stMatrixMutex );
+      return lRet;
+   }
+   
+   // Every pin is an input pulled up while idle: the scan only makes one row an output, low
+   for( i = 0; i < pstConfig->uiRows + pstConfig->uiColumns; i++ )
+   {
+      lPin = (i < pstConfig->uiRows)? pstConfig->aiRowPins[i]: pstConfig->aiColumnPins[i - pstConfig->uiRows];
+      IOPinSetFunction( lPin, PIN_FUNCTION_INPUT );
+      IOPinSetPull( lPin, PIN_PULL_UP );
+      g_apstPinDevices[lPin]->iPull = PIN_PULL_UP;
+   }
+   
+   spin_lock_irqsave( &pstMatrix->lock, ulFlags );
+   pstMatrix->pstDev = dev;
+   pstMatrix->stConfig = *pstConfig;
+   pstMatrix->auiPinMask[0] = auiPinMask[0];
+   pstMatrix->auiPinMask[1] = auiPinMask[1];
+   pstMatrix->auiColumnMask[0] = 0;
+   pstMatrix->auiColumnMask[1] = 0;
+   for( i = 0; i < pstConfig->uiColumns; i++ )
+   {
+      lPin = pstConfig->aiColumnPins[i];
+      pstMatrix->auiColumnMask[lPin / 32] |= 1U << (lPin % 32);
+   }
+   IOPinDebounceInit( &pstMatrix->stDebounce, pstConfig->uiDebounceScans );
+   pstMatrix->uiHead = 0;
+   pstMatrix->uiCount = 0;
+   pstMatrix->ullScans = 0;
+   pstMatrix->uiOverruns = 0;
+   pstMatrix->iBound = 1;
+   spin_unlock_irqrestore( &pstMatrix->lock, ulFlags );
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   dev->pstMatrix = pstMatrix;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   hrtimer_start( &pstMatrix->stTimer, ns_to_ktime( (u64)pstConfig->uiScanUs * NSEC_PER_USEC ), HRTIMER_MODE_REL );
+   
+   mutex_unlock( &g_stMatrixMutex );
+   
+   return 0;
+}
+
+// Called with g_stMatrixMutex held
+static void Unbind( struct SIOPinMatrix* pstMatrix )
+{
+   struct SIOPinDev* dev = pstMatrix->pstDev;
+   unsigned long ulFlags;
+   
+   spin_lock_irqsave( &pstMatrix->lock, ulFlags );
+   pstMatrix->iBound = 0;
+   spin_unlock_irqrestore( &pstMatrix->lock, ulFlags );
+   
+   // The scan leaves every row as an input, so nothing drives the panel afterwards
+   hrtimer_cancel( &pstMatrix->stTimer );
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   dev->pstMatrix = NULL;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   IOPinReleasePins( pstMatrix->auiPinMask );
+   
+   // Readers still waiting on the matrix
+   wake_up_interruptible( &dev->irq_wait );
+}
+
+ssize_t IOPinMatrixRead( struct SIOPinDev* dev, struct kiocb* iocb, struct iov_iter* to )
+{
+   struct SIOPinMatrix* pstMatrix = dev->pstMatrix;
+   struct SIOPinKeyEvent astEvents[MATRIX_EVENT_QUEUE];
+   unsigned long ulFlags;
+   size_t szMax = iov_iter_count( to ) / sizeof(struct SIOPinKeyEvent);
+   size_t szCount;
+   size_t i;
+   
+   if( NULL == pstMatrix )
+   {
+      return -ENODEV;
+   }
+   if( 0 == szMax )
+   {
+      return -EINVAL;
+   }
+   
+   for( ;; )
+   {
+      spin_lock_irqsave( &pstMatrix->lock, ulFlags );
+      if( !IsPort( pstMatrix, dev ) )
+      {
+         spin_unlock_irqrestore( &pstMatrix->lock, ulFlags );
+         return -ENODEV;
+      }
+      szCount = min_t( size_t, szMax, pstMatrix->uiCount );
+      for( i = 0; i < szCount; i++ )
+      {
+         astEvents[i] = pstMatrix->astEvents[pstMatrix->uiHead];
+         pstMatrix->uiHead = (pstMatrix->uiHead + 1) % MATRIX_EVENT_QUEUE;
+      }
+      pstMatrix->uiCount -= szCount;
+      spin_unlock_irqrestore( &pstMatrix->lock, ulFlags );
+      
+      if( szCount )
+      {
+         break;
+      }
+      
+      if( (iocb->ki_filp->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT) )
+      {
+         return -EAGAIN;
+      }
+      if( wait_event_interruptible( dev->irq_wait, HasEvents( pstMatrix, dev ) ) )
+      {
+         return -ERESTARTSYS;
+      }
+   }
+   
+   if( (szCount * sizeof(struct SIOPinKeyEvent)) != copy_to_iter( astEvents, szCount * sizeof(struct SIOPinKeyEvent), to ) )
+   {
+      return -EFAULT;
+   }
+   
+   return szCount * sizeof(struct SIOPinKeyEvent);
+}
+
+unsigned int IOPinMatrixPoll( struct SIOPinDev* dev )
+{
+   struct SIOPinMatrix* pstMatrix = dev->pstMatrix;
+   
+   if( (NULL == pstMatrix) || !IsPort( pstMatrix, dev ) || (0 == pstMatrix->uiCount) )
+   {
+      return 0;
+   }
+   
+   return (POLLIN | POLLRDNORM);
+}
+
+void IOPinMatrixInit( void )
+{
+   unsigned int i;
+   
+   for( i = 0; i < MATRIX_MAX_MATRICES; i++ )
+   {
+      spin_lock_init( &g_astMatrices[i].lock );
+      hrtimer_init( &g_astMatrices[i].stTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL );
+      g_astMatrices[i].stTimer.function = MatrixTimerHandler;
+   }
+}
+
+void IOPinMatrixExit( void )
+{
+   unsigned int i;
+   
+   mutex_lock( &g_stMatrixMutex );
+   for( i = 0; i < MATRIX_MAX_MATRICES; i++ )
+   {
+      if( g_astMatrices[i].iBound )
+      {
+         Unbind( &g_astMatrices[i] );
+      }
+   }
+   mutex_unlock( &g_stMatrixMutex );
+}
+
+// Unbinds the matrix read through the device
+void IOPinMatrixRelease( struct SIOPinDev* dev )
+{
+   mutex_lock( &g_stMatrixMutex );
+   if( dev->pstMatrix )
+   {
+      Unbind( dev->pstMatrix );
+   }
+   mutex_unlock( &g_stMatrixMutex );
+}
+
+long IOPinMatrixIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   struct SIOPinMatrixConfig stConfig;
+   struct SIOPinMatrixState stState;
+   struct SIOPinMatrix* pstMatrix;
+   unsigned long ulFlags;
+   
+   switch( ioctl_num )
+   {
+      case IOCTL_MATRIX_BIND:
+      {
+         if( copy_from_user( &stConfig, (void __user*)ioctl_param, sizeof(stConfig) ) )
+         {
+            return -EFAULT;
+         }
+         
+         return Bind( dev, &stConfig );
+      }
+      
+      case IOCTL_MATRIX_UNBIND:
+      {
+         mutex_lock( &g_stMatrixMutex );
+         if( NULL == dev->pstMatrix )
+         {
+            mutex_unlock( &g_stMatrixMutex );
+            return -ENODEV;
+         }
+         Unbind( dev->pstMatrix );
+         mutex_unlock( &g_stMatrixMutex );
+         break;
+      }
+      
+      case IOCTL_MATRIX_STATE:
+      {
+         pstMatrix = dev->pstMatrix;
+         if( NULL == pstMatrix )
+         {
+            return -ENODEV;
+         }
+         
+         spin_lock_irqsave( &pstMatrix->lock, ulFlags );
+         if( !IsPort( pstMatrix, dev ) )
+         {
+            spin_unlock_irqrestore( &pstMatrix->lock, ulFlags );
+            return -ENODEV;
+         }
+         stState.ullPressed = pstMatrix->stDebounce.ullState;
+         stState.ullScans = pstMatrix->ullScans;
+         stState.uiOverruns = pstMatrix->uiOverruns;
+         stState.uiPending = pstMatrix->uiCount;
+         spin_unlock_irqrestore( &pstMatrix->lock, ulFlags );
+         
+         if( copy_to_user( (void __user*)ioctl_param, &stState, sizeof(stState) ) )
+         {
+            return -EFAULT;
+         }
+         break;
+      }
+      
+      default:
+      {
+         return -EINVAL;
+      }
+   }
+   
+   return 0;
+}
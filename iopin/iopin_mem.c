@@ -0,0 +1,137 @@
+/*
+ *  iopin_mem.c - Direct access to the GPIO registers from userspace
+ *
+ *  /dev/iopinmem maps the page of the GPIO block into a process with CAP_SYS_RAWIO. The
+ *  helpers of iopin_mmap.h only use GPSET, GPCLR and GPLEV, which don't need a read-modify-write,
+ *  so they can't undo what the driver writes (interruption setup, scheduled outputs, reflexes).
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/device.h>
+#include <linux/capability.h>
+#include <linux/mm.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin.h"
+
+#define  MEM_DEVICE_NAME   "iopinmem"
+
+static int iopin_mem_open( struct inode* inode, struct file* filp );
+static int iopin_mem_mmap( struct file* filp, struct vm_area_struct* vma );
+static long iopin_mem_ioctl( struct file* filp, unsigned int ioctl_num, unsigned long ioctl_param );
+
+//------[ Module operations ]------
+static struct file_operations g_stIOPinMemFops =
+{
+   .owner            = THIS_MODULE,
+   .open             = iopin_mem_open,
+   .unlocked_ioctl   = iopin_mem_ioctl,
+   .mmap             = iopin_mem_mmap,
+};
+
+//------[ Global variables ]------
+static struct cdev g_stMemCdev;
+static dev_t g_MemDevno;
+static int g_iMemCreated;
+
+int IOPinMemInit( struct class* pobjClass, dev_t devno )
+{
+   struct device* pstDevice;
+   int iRet;
+   
+   cdev_init( &g_stMemCdev, &g_stIOPinMemFops );
+   g_stMemCdev.owner = THIS_MODULE;
+   
+   iRet = cdev_add( &g_stMemCdev, devno, 1 );
+   if( iRet )
+   {
+      printk( KERN_WARNING "[IOPin] Error %d while trying to add %s\n", iRet, MEM_DEVICE_NAME );
+      return iRet;
+   }
+   
+   pstDevice = device_create( pobjClass, NULL, devno, NULL, MEM_DEVICE_NAME );
+   if( IS_ERR( pstDevice ) )
+   {
+      iRet = PTR_ERR( pstDevice );
+      printk( KERN_WARNING "[IOPin] Error %d while trying to create %s\n", iRet, MEM_DEVICE_NAME );
+      cdev_del( &g_stMemCdev );
+      return iRet;
+   }
+   
+   g_MemDevno = devno;
+   g_iMemCreated = 1;
+   
+   return 0;
+}
+
+void IOPinMemExit( struct class* pobjClass )
+{
+   if( g_iMemCreated )
+   {
+      device_destroy( pobjClass, g_MemDevno );
+      cdev_del( &g_stMemCdev );
+      g_iMemCreated = 0;
+   }
+}
+
+long IOPinGetExportedMask( unsigned long ioctl_param )
+{
+   struct SIOPinExportedMask stMask;
+   
+   stMask.auiMask[0] = g_auiExportedMask[0];
+   stMask.auiMask[1] = g_auiExportedMask[1];
+   stMask.uiNumPins = g_pstSocLayout->uiNumPins;
+   stMask.uiMapOffset = offset_in_page( g_GpioPhysAddr );
+   
+   if( copy_to_user( (void __user*)ioctl_param, &stMask, sizeof(stMask) ) )
+   {
+      return -EFAULT;
+   }
+   
+   return 0;
+}
+
+static int iopin_mem_open( struct inode* inode, struct file* filp )
+{
+   // Whoever maps the registers can drive any pin, so the same privilege as /dev/mem is required
+   if( !capable( CAP_SYS_RAWIO ) )
+   {
+      return -EPERM;
+   }
+   
+   return 0;
+}
+
+static int iopin_mem_mmap( struct file* filp, struct vm_area_struct* vma )
+{
+   // Only the page of the GPIO block, uncached so every access reaches the registers
+   vma->vm_page_prot = pgprot_noncached( vma->vm_page_prot );
+   
+   return vm_iomap_memory( vma, g_GpioPhysAddr & PAGE_MASK, PAGE_SIZE );
+}
+
+static long iopin_mem_ioctl( struct file* filp, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   switch( ioctl_num )
+   {
+      case IOCTL_GET_EXPORTED_MASK:
+      {
+         return IOPinGetExportedMask( ioctl_param );
+      }
+      
+      default:
+      {
+         printk( KERN_WARNING "[IOPin] Unkown ioctl %u\n", ioctl_num );
+         return -EINVAL;
+      }
+   }
+}
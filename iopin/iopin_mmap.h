@@ -0,0 +1,102 @@
+#ifndef _IOPIN_MMAP_H_
+#define _IOPIN_MMAP_H_
+
+/*
+ * Userspace access to the GPIO registers through /dev/iopinmem (needs CAP_SYS_RAWIO)
+ *
+ * A toggle is a single store to GPSET/GPCLR, without a syscall. The driver doesn't check what is
+ * done through the map, so by convention only the pins exported by the driver (IOPinMapIsExported)
+ * are used, configured with IOCTL_SET_FUNCTION on their device as usual. The pin helpers don't
+ * check the pin to keep the loops tight; the bank helpers mask the value with the exported pins.
+ * Only GPSET, GPCLR and GPLEV are touched, so this is safe while the driver serves interruptions,
+ * scheduled outputs and reflexes on the same banks
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+
+#define  IOPIN_MEM_DEVICE  "/dev/iopinmem"
+
+struct SIOPinMap
+{
+   volatile struct SGpioRegistersMap* pstRegisters;
+   void*    pvMap;
+   size_t   szMapSize;
+   int      fd;
+   struct SIOPinExportedMask stExported;
+};
+
+// Returns 0 or -1 with errno set
+static inline int IOPinMapOpen( struct SIOPinMap* pstMap )
+{
+   pstMap->szMapSize = sysconf( _SC_PAGESIZE );
+   pstMap->fd = open( IOPIN_MEM_DEVICE, O_RDWR | O_SYNC | O_CLOEXEC );
+   if( 0 > pstMap->fd )
+   {
+      return -1;
+   }
+   
+   if( 0 > ioctl( pstMap->fd, IOCTL_GET_EXPORTED_MASK, &pstMap->stExported ) )
+   {
+      close( pstMap->fd );
+      return -1;
+   }
+   
+   pstMap->pvMap = mmap( NULL, pstMap->szMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, pstMap->fd, 0 );
+   if( MAP_FAILED == pstMap->pvMap )
+   {
+      close( pstMap->fd );
+      return -1;
+   }
+   
+   pstMap->pstRegisters = (volatile struct SGpioRegistersMap*)((char*)pstMap->pvMap + pstMap->stExported.uiMapOffset);
+   
+   return 0;
+}
+
+static inline void IOPinMapClose( struct SIOPinMap* pstMap )
+{
+   munmap( pstMap->pvMap, pstMap->szMapSize );
+   close( pstMap->fd );
+   pstMap->pstRegisters = NULL;
+}
+
+static inline int IOPinMapIsExported( const struct SIOPinMap* pstMap, unsigned int uiPin )
+{
+   return (uiPin < pstMap->stExported.uiNumPins) && (pstMap->stExported.auiMask[uiPin / 32] & (1u << (uiPin % 32)));
+}
+
+static inline void IOPinMapSet( const struct SIOPinMap* pstMap, unsigned int uiPin )
+{
+   pstMap->pstRegisters->GPSET[uiPin / 32] = 1u << (uiPin % 32);
+}
+
+static inline void IOPinMapClear( const struct SIOPinMap* pstMap, unsigned int uiPin )
+{
+   pstMap->pstRegisters->GPCLR[uiPin / 32] = 1u << (uiPin % 32);
+}
+
+static inline int IOPinMapLevel( const struct SIOPinMap* pstMap, unsigned int uiPin )
+{
+   return (pstMap->pstRegisters->GPLEV[uiPin / 32] >> (uiPin % 32)) & 1;
+}
+
+// Changes every uiMask pin of the bank at the same time: the pins of uiLevel are set, the others cleared
+static inline void IOPinMapWriteBank( const struct SIOPinMap* pstMap, unsigned int uiBank, uint32_t uiMask, uint32_t uiLevel )
+{
+   uiMask &= pstMap->stExported.auiMask[uiBank];
+   pstMap->pstRegisters->GPSET[uiBank] = uiMask & uiLevel;
+   pstMap->pstRegisters->GPCLR[uiBank] = uiMask & ~uiLevel;
+}
+
+static inline uint32_t IOPinMapReadBank( const struct SIOPinMap* pstMap, unsigned int uiBank )
+{
+   return pstMap->pstRegisters->GPLEV[uiBank] & pstMap->stExported.auiMask[uiBank];
+}
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ *  iopin_poll.c - Polling of the pins too fast for interrupts
+ *
+ *  Like NAPI: a pin interrupting faster than poll_threshold has its detection masked and is
+ *  sampled by a single hrtimer shared by every polled pin. The events are made up from the
+ *  changes of GPLEV, and the pin goes back to interrupts when it calms down.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/ratelimit.h>
+#include <asm/io.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin.h"
+
+//-----[ Module parameters ]------
+static ulong poll_threshold = 20000;
+module_param( poll_threshold, ulong, S_IRUGO );
+MODULE_PARM_DESC( poll_threshold, "Interrupts per second above which a pin is polled instead (default 20000, 0 = never)" );
+
+static ulong poll_period_us = 50;
+module_param( poll_period_us, ulong, S_IRUGO );
+MODULE_PARM_DESC( poll_period_us, "Sampling period of the polled pins (default 50us)" );
+
+//------[ Global variables ]------
+static DEFINE_SPINLOCK( g_stPollLock );
+static struct hrtimer g_stPollTimer;
+static uint32_t g_auiPollingMask[2];      // Pins being polled
+static int g_iPollRunning;
+
+// Samples one polled pin. Returns 1 when the pin should go back to interrupts
+static int PollPin( struct SIOPinDev* dev, const uint32_t* puiLevels, u64 ullNow )
+{
+   uint32_t uiLevel = (puiLevels[dev->ulPin / 32] >> (dev->ulPin % 32)) & 1;
+   int iEvent = 0;
+   int iResume = 0;
+   
+   spin_lock( &dev->lock );
+   
+   if( !(dev->uiMaskState & PIN_MASKED_POLLING) )
+   {  // Reconfigured meanwhile
+      spin_unlock( &dev->lock );
+      return 0;
+   }
+   
+   if( uiLevel != dev->uiPolledLevel )
+   {
+      dev->uiPolledLevel = uiLevel;
+      iEvent = !!(dev->ulInterruption & (uiLevel? (PIN_INTERRUPTION_RISING | PIN_INTERRUPTION_ASYNC_RISING):
+                                                  (PIN_INTERRUPTION_FALLING | PIN_INTERRUPTION_ASYNC_FALLING)));
+   }
+   
+   if( !iEvent && (dev->ulInterruption & (uiLevel? PIN_INTERRUPTION_HIGH: PIN_INTERRUPTION_LOW)) &&
+       !(dev->uiMaskState & PIN_MASKED_LEVEL) )
+   {  // Same as the interrupt handler: one event, then masked until the next read
+      iEvent = 1;
+      dev->uiMaskState |= PIN_MASKED_LEVEL;
+      dev->stStats.ullLevelMasks++;
+   }
+   
+   if( (ullNow - dev->ullWindowStart) >= IOPIN_RATE_WINDOW_NS )
+   {  // Hysteresis: back to interrupts well below the threshold
+      dev->stStats.uiEventRate = dev->ulWindowEvents * (NSEC_PER_SEC / IOPIN_RATE_WINDOW_NS);
+      iResume = dev->ulWindowEvents < ((poll_threshold / 4) / (NSEC_PER_SEC / IOPIN_RATE_WINDOW_NS));
+      dev->ullWindowStart = ullNow;
+      dev->ulWindowEvents = 0;
+   }
+   
+   if( iEvent )
+   {
+      dev->ulWindowEvents++;
+      dev->stStats.ullPolledEvents++;
+   }
+   
+   spin_unlock( &dev->lock );
+   
+   if( iEvent )
+   {
+      IOPinReflexEvaluate( dev->ulPin, puiLevels, ullNow );
+      IOPinNotifyEvent( dev, uiLevel, ullNow );
+   }
+   
+   return iResume;
+}
+
+static enum hrtimer_restart PollTimerHandler( struct hrtimer* pstTimer )
+{
+   uint32_t auiPolling[2];
+   uint32_t auiLevels[2];
+   unsigned long ulFlags;
+   unsigned long ulPin;
+   unsigned int uiBank;
+   struct SIOPinDev* dev;
+   u64 ullNow;
+   
+   spin_lock_irqsave( &g_stPollLock, ulFlags );
+   auiPolling[0] = g_auiPollingMask[0];
+   auiPolling[1] = g_auiPollingMask[1];
+   spin_unlock_irqrestore( &g_stPollLock, ulFlags );
+   
+   ullNow = ktime_get_ns();
+   auiLevels[0] = ioread32( &g_pstGpioRegisters->GPLEV[0] );
+   auiLevels[1] = ioread32( &g_pstGpioRegisters->GPLEV[1] );
+   
+   for( uiBank = 0; uiBank < 2; uiBank++ )
+   {
+      while( auiPolling[uiBank] )
+      {
+         ulPin = (uiBank * 32) + __ffs( auiPolling[uiBank] );
+         auiPolling[uiBank] &= auiPolling[uiBank] - 1;
+         
+         dev = g_apstPinDevices[ulPin];
+         if( PollPin( dev, auiLevels, ullNow ) )
+         {
+            printk_ratelimited( KERN_INFO "[IOPin] GPIO%lu: back to interrupts\n", ulPin );
+            IOPinPollStop( dev );
+            IOPinResumeInterruptions( dev );
+         }
+      }
+   }
+   
+   spin_lock_irqsave( &g_stPollLock, ulFlags );
+   if( g_auiPollingMask[0] || g_auiPollingMask[1] )
+   {
+      spin_unlock_irqrestore( &g_stPollLock, ulFlags );
+      hrtimer_forward_now( pstTimer, ns_to_ktime( poll_period_us * NSEC_PER_USEC ) );
+      return HRTIMER_RESTART;
+   }
+   g_iPollRunning = 0;
+   spin_unlock_irqrestore( &g_stPollLock, ulFlags );
+   
+   return HRTIMER_NORESTART;
+}
+
+void IOPinPollInit( void )
+{
+   hrtimer_init( &g_stPollTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL );
+   g_stPollTimer.function = PollTimerHandler;
+   
+   if( poll_period_us < 10 )
+   {  // Faster than that the polling would be the new storm
+      poll_period_us = 10;
+   }
+}
+
+void IOPinPollExit( void )
+{
+   unsigned long ulFlags;
+   
+   spin_lock_irqsave( &g_stPollLock, ulFlags );
+   g_auiPollingMask[0] = 0;
+   g_auiPollingMask[1] = 0;
+   spin_unlock_irqrestore( &g_stPollLock, ulFlags );
+   
+   hrtimer_cancel( &g_stPollTimer );
+   g_iPollRunning = 0;
+}
+
+int IOPinPollWanted( ulong ulWindowEvents )
+{
+   return poll_threshold && (ulWindowEvents > (poll_threshold / (NSEC_PER_SEC / IOPIN_RATE_WINDOW_NS)));
+}
+
+// Called from the interrupt handler with dev->lock held. The caller masks the detection of the pin
+void IOPinPollStart( struct SIOPinDev* dev, uint32_t uiLevel, u64 ullTimestamp )
+{
+   dev->uiMaskState |= PIN_MASKED_POLLING;
+   dev->uiPolledLevel = uiLevel? 1: 0;
+   dev->ullWindowStart = ullTimestamp;
+   dev->ulWindowEvents = 0;
+   dev->stStats.ullPollingSwitches++;
+   
+   printk_ratelimited( KERN_INFO "[IOPin] GPIO%lu: too many interrupts, polling every %luus\n", dev->ulPin, poll_period_us );
+   
+   spin_lock( &g_stPollLock );
+   g_auiPollingMask[dev->ulPin / 32] |= 1U << (dev->ulPin % 32);
+   if( !g_iPollRunning )
+   {
+      g_iPollRunning = 1;
+      hrtimer_start( &g_stPollTimer, ns_to_ktime( poll_period_us * NSEC_PER_USEC ), HRTIMER_MODE_REL );
+   }
+   spin_unlock( &g_stPollLock );
+}
+
+// The timer stops by itself after the last pin
+void IOPinPollStop( struct SIOPinDev* dev )
+{
+   unsigned long ulFlags;
+   
+   spin_lock_irqsave( &g_stPollLock, ulFlags );
+   g_auiPollingMask[dev->ulPin / 32] &= ~(1U << (dev->ulPin % 32));
+   spin_unlock_irqrestore( &g_stPollLock, ulFlags );
+}
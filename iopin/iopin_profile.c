@@ -0,0 +1,92 @@
+/*
+ *  iopin_profile.c - Trapezoidal motion profile for the steppers
+ */
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/math64.h>
+#define  PROFILE_DIV( a, b )     div_u64( (a), (b) )
+#else
+#include <stdint.h>
+#define  PROFILE_DIV( a, b )     ((a) / (b))
+#endif
+
+#include "iopin_profile.h"
+
+#define  PROFILE_SECOND_NS       1000000000ULL
+#define  PROFILE_STEP_PHASE      (PROFILE_SECOND_NS << 16)    // Phase of one step: 1 step/s during 1s
+
+void IOPinProfileStart( struct SIOPinProfile* pstProfile, uint32_t uiSteps, uint32_t uiMaxRate, uint32_t uiAccel, uint32_t uiTickNs )
+{
+   pstProfile->ullMaxRateQ16 = (uint64_t)uiMaxRate << 16;
+   pstProfile->ullMinRateQ16 = 0;
+   pstProfile->ullPhase = 0;
+   pstProfile->uiRemaining = uiSteps;
+   pstProfile->uiAccel = uiAccel;
+   pstProfile->uiTickNs = uiTickNs;
+   
+   if( uiAccel )
+   {  // From standstill, so the first step comes after sqrt(2 / accel) as it should
+      pstProfile->ullRateQ16 = 0;
+      pstProfile->ullDeltaQ16 = PROFILE_DIV( ((uint64_t)uiAccel * uiTickNs) << 16, PROFILE_SECOND_NS );
+      if( 0 == pstProfile->ullDeltaQ16 )
+      {
+         pstProfile->ullDeltaQ16 = 1;
+      }
+   }
+   else
+   {
+      pstProfile->ullRateQ16 = pstProfile->ullMaxRateQ16;
+      pstProfile->ullDeltaQ16 = 0;
+   }
+}
+
+int IOPinProfileTick( struct SIOPinProfile* pstProfile )
+{
+   uint64_t ullRate;
+   
+   if( 0 == pstProfile->uiRemaining )
+   {
+      return 0;
+   }
+   
+   if( pstProfile->uiAccel )
+   {
+      ullRate = pstProfile->ullRateQ16 >> 16;
+      
+      if( pstProfile->ullMinRateQ16 && (pstProfile->uiRemaining <= PROFILE_DIV( ullRate * ullRate, 2ULL * pstProfile->uiAccel )) )
+      {  // Braking
+         if( pstProfile->ullRateQ16 > (pstProfile->ullMinRateQ16 + pstProfile->ullDeltaQ16) )
+         {
+            pstProfile->ullRateQ16 -= pstProfile->ullDeltaQ16;
+         }
+         else
+         {
+            pstProfile->ullRateQ16 = pstProfile->ullMinRateQ16;
+         }
+      }
+      else if( pstProfile->ullRateQ16 < pstProfile->ullMaxRateQ16 )
+      {
+         pstProfile->ullRateQ16 += pstProfile->ullDeltaQ16;
+         if( pstProfile->ullRateQ16 > pstProfile->ullMaxRateQ16 )
+         {
+            pstProfile->ullRateQ16 = pstProfile->ullMaxRateQ16;
+         }
+      }
+   }
+   
+   pstProfile->ullPhase += pstProfile->ullRateQ16 * pstProfile->uiTickNs;
+   if( PROFILE_STEP_PHASE > pstProfile->ullPhase )
+   {
+      return 0;
+   }
+   
+   pstProfile->ullPhase -= PROFILE_STEP_PHASE;
+   pstProfile->uiRemaining--;
+   if( 0 == pstProfile->ullMinRateQ16 )
+   {
+      pstProfile->ullMinRateQ16 = pstProfile->ullRateQ16;
+   }
+   
+   return 1;
+}
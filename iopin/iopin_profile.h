@@ -0,0 +1,36 @@
+#ifndef _IOPIN_PROFILE_H_
+#define _IOPIN_PROFILE_H_
+
+/*
+ * Trapezoidal motion profile in integer math, advanced one timer tick at a time
+ *
+ * The rate is kept in steps/s with 16 fractional bits and integrated into a phase: a step is due
+ * each time the phase reaches one second worth of rate. The rate goes up by the acceleration
+ * each tick until the maximum, and down again once the remaining steps are within the braking
+ * distance (rate^2 / (2 * accel)). It never goes below the rate of the first step, so the move
+ * doesn't stall before its last step
+ */
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+struct SIOPinProfile
+{
+   uint64_t ullRateQ16;             // Current rate
+   uint64_t ullMaxRateQ16;
+   uint64_t ullMinRateQ16;          // Rate of the first step (0 until then)
+   uint64_t ullDeltaQ16;            // Change of the rate on each tick
+   uint64_t ullPhase;               // Rate * ns accumulated since the last step
+   uint32_t uiRemaining;            // Steps left
+   uint32_t uiAccel;                // Steps/s^2 (0 = no ramps)
+   uint32_t uiTickNs;
+};
+
+void IOPinProfileStart( struct SIOPinProfile* pstProfile, uint32_t uiSteps, uint32_t uiMaxRate, uint32_t uiAccel, uint32_t uiTickNs );
+
+// Advances one tick. Returns 1 when a step is due on this tick
+int IOPinProfileTick( struct SIOPinProfile* pstProfile );
+
+#endif
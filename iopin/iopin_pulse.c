@@ -0,0 +1,70 @@
+/*
+ *  iopin_pulse.c - Pulse width decoding for single-wire sensors
+ */
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/string.h>
+#else
+#include <stdint.h>
+#include <string.h>
+#endif
+
+#include "iopin_pulse.h"
+
+int IOPinPulseDecode( const uint64_t* pullTimestamps, const uint8_t* pucLevels, unsigned int uiEdges, unsigned int uiBits,
+                      uint32_t uiThresholdNs, uint8_t* pucData )
+{
+   unsigned int uiBit = uiBits;
+   uint64_t ullWidth;
+   unsigned int i;
+   
+   memset( pucData, 0, (uiBits + 7) / 8 );
+   
+   // Backwards from the last falling edge, so the pulses of the answer don't shift the bits
+   for( i = uiEdges; (1 < i) && uiBit; i-- )
+   {
+      if( (0 != pucLevels[i - 1]) || (1 != pucLevels[i - 2]) )
+      {  // Not the end of a high pulse. Between the bits it means that an edge was lost
+         if( uiBit != uiBits )
+         {
+            return PULSE_ERR_MISSING;
+         }
+         continue;
+      }
+      
+      ullWidth = pullTimestamps[i - 1] - pullTimestamps[i - 2];
+      if( (DHT_MIN_HIGH_NS > ullWidth) || (DHT_MAX_HIGH_NS < ullWidth) )
+      {
+         return PULSE_ERR_MISSING;
+      }
+      
+      uiBit--;
+      if( ullWidth > uiThresholdNs )
+      {
+         pucData[uiBit / 8] |= 0x80 >> (uiBit % 8);
+      }
+      i--;        // The rising edge belongs to this pulse
+   }
+   
+   return uiBit? PULSE_ERR_MISSING: 0;
+}
+
+int IOPinDhtDecode( const uint64_t* pullTimestamps, const uint8_t* pucLevels, unsigned int uiEdges, uint32_t uiThresholdNs,
+                    uint8_t* pucData )
+{
+   int iRet;
+   
+   iRet = IOPinPulseDecode( pullTimestamps, pucLevels, uiEdges, DHT_BITS, uiThresholdNs, pucData );
+   if( iRet )
+   {
+      return iRet;
+   }
+   
+   if( (uint8_t)(pucData[0] + pucData[1] + pucData[2] + pucData[3]) != pucData[4] )
+   {
+      return PULSE_ERR_CHECKSUM;
+   }
+   
+   return 0;
+}
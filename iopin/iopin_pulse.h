@@ -0,0 +1,34 @@
+#ifndef _IOPIN_PULSE_H_
+#define _IOPIN_PULSE_H_
+
+/*
+ * Pulse width decoding of the edges captured by the interrupt handler
+ */
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+#define  DHT_BITS                40
+#define  DHT_BYTES               (DHT_BITS / 8)
+#define  DHT_THRESHOLD_NS        48000    // Between the 26-28us of a 0 and the 70us of a 1
+#define  DHT_MIN_HIGH_NS         8000
+#define  DHT_MAX_HIGH_NS         100000
+
+#define  PULSE_ERR_MISSING       -1       // Fewer pulses than bits, or a pulse out of range
+#define  PULSE_ERR_CHECKSUM      -2
+
+/*
+ * Bits from the last uiBits complete high pulses (rising edge then falling edge): 1 when longer
+ * than uiThresholdNs. The pulses must follow each other without a missing edge. The pulses
+ * before them (the answer of the sensor) are ignored, and so are the edges after the last one
+ */
+int IOPinPulseDecode( const uint64_t* pullTimestamps, const uint8_t* pucLevels, unsigned int uiEdges, unsigned int uiBits,
+                      uint32_t uiThresholdNs, uint8_t* pucData );
+
+// The 5 bytes of a DHT11/DHT22 answer, with the checksum verified
+int IOPinDhtDecode( const uint64_t* pullTimestamps, const uint8_t* pucLevels, unsigned int uiEdges, uint32_t uiThresholdNs,
+                    uint8_t* pucData );
+
+#endif
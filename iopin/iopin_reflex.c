@@ -0,0 +1,241 @@
+/*
+ *  iopin_reflex.c - Output changes triggered directly by input edges
+ *
+ *  The rules are evaluated by GPIOIntHandler before userspace is woken up, so an
+ *  interlock reacts within the interrupt latency instead of a full userspace round trip.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin.h"
+
+struct SReflexEntry
+{
+   int                     iValid;
+   struct SIOPinReflexRule stRule;
+};
+
+//------[ Global variables ]------
+static DEFINE_SPINLOCK( g_stReflexLock );
+static struct SReflexEntry g_astReflexRules[REFLEX_MAX_RULES];
+static uint32_t g_auiReflexTriggers[2];      // Pins that have at least one rule, so the handler can skip the others
+
+// Must be called with g_stReflexLock held
+static void UpdateTriggers( void )
+{
+   int i;
+   
+   g_auiReflexTriggers[0] = 0;
+   g_auiReflexTriggers[1] = 0;
+   
+   for( i = 0; i < REFLEX_MAX_RULES; i++ )
+   {
+      if( g_astReflexRules[i].iValid )
+      {
+         g_auiReflexTriggers[g_astReflexRules[i].stRule.uiTriggerPin / 32] |= (1 << (g_astReflexRules[i].stRule.uiTriggerPin % 32));
+      }
+   }
+}
+
+// Called from the interrupt handler with the levels of both banks sampled when it was served
+void IOPinReflexEvaluate( unsigned long ulPin, const uint32_t* puiLevels, u64 ullTimestamp )
+{
+   uint32_t auiSet[2] = { 0, 0 };
+   uint32_t auiClear[2] = { 0, 0 };
+   uint32_t uiEdge;
+   int i;
+   
+   if( 0 == (g_auiReflexTriggers[ulPin / 32] & (1 << (ulPin % 32))) )
+   {
+      return;
+   }
+   
+   uiEdge = (puiLevels[ulPin / 32] & (1 << (ulPin % 32)))? PIN_INTERRUPTION_RISING: PIN_INTERRUPTION_FALLING;
+   
+   spin_lock( &g_stReflexLock );
+   
+   for( i = 0; i < REFLEX_MAX_RULES; i++ )
+   {
+      struct SIOPinReflexRule* pstRule = &g_astReflexRules[i].stRule;
+      
+      if( !g_astReflexRules[i].iValid || (pstRule->uiTriggerPin != ulPin) || !(pstRule->uiEdge & uiEdge) )
+      {
+         continue;
+      }
+      
+      if( (0 <= pstRule->iGatePin) &&
+          ((0 != (puiLevels[pstRule->iGatePin / 32] & (1 << (pstRule->iGatePin % 32)))) != (0 != pstRule->uiGateLevel)) )
+      {  // Gate closed
+         continue;
+      }
+      
+      pstRule->ullFired++;
+      
+      if( pstRule->ullDelayNs )
+      {
+         struct SIOPinScheduledOutput stEntry;
+         
+         stEntry.uiBank = pstRule->uiBank;
+         stEntry.uiMask = pstRule->uiMask;
+         stEntry.uiLevel = (REFLEX_SET == pstRule->uiAction);
+         stEntry.uiReserved = 0;
+         stEntry.ullDeadlineNs = ullTimestamp + pstRule->ullDelayNs;
+         IOPinSchedAdd( &stEntry );
+      }
+      else if( REFLEX_SET == pstRule->uiAction )
+      {
+         auiSet[pstRule->uiBank] |= pstRule->uiMask;
+      }
+      else
+      {
+         auiClear[pstRule->uiBank] |= pstRule->uiMask;
+      }
+   }
+   
+   spin_unlock( &g_stReflexLock );
+   
+   for( i = 0; i < 2; i++ )
+   {
+      if( auiSet[i] )   iowrite32( auiSet[i], &g_pstGpioRegisters->GPSET[i] );
+      if( auiClear[i] ) iowrite32( auiClear[i], &g_pstGpioRegisters->GPCLR[i] );
+   }
+}
+
+// Remove the rules triggered by a pin (or all the rules if lPin is negative)
+void IOPinReflexClear( long lPin )
+{
+   unsigned long ulFlags;
+   int i;
+   
+   spin_lock_irqsave( &g_stReflexLock, ulFlags );
+   for( i = 0; i < REFLEX_MAX_RULES; i++ )
+   {
+      if( (0 > lPin) || (g_astReflexRules[i].stRule.uiTriggerPin == lPin) )
+      {
+         g_astReflexRules[i].iValid = 0;
+      }
+   }
+   UpdateTriggers();
+   spin_unlock_irqrestore( &g_stReflexLock, ulFlags );
+}
+
+long IOPinReflexIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   struct SIOPinReflexRule stRule;
+   unsigned long ulFlags;
+   int iRet;
+   int i;
+   
+   switch (ioctl_num)
+   {
+      case IOCTL_ADD_REFLEX:
+      {
+         if( copy_from_user( &stRule, (void __user*)ioctl_param, sizeof(stRule) ) )
+         {
+            return -EFAULT;
+         }
+         
+         if( (0 == (stRule.uiEdge & (PIN_INTERRUPTION_RISING | PIN_INTERRUPTION_FALLING))) ||
+             ((REFLEX_SET != stRule.uiAction) && (REFLEX_CLEAR != stRule.uiAction)) ||
+             ((0 <= stRule.iGatePin) && ((IOPIN_NUM_PINS <= stRule.iGatePin) || !(g_auiExportedMask[stRule.iGatePin / 32] & (1 << (stRule.iGatePin % 32))))) )
+         {
+            printk( KERN_WARNING "[IOPin] reflex: Invalid rule\n" );
+            return -EINVAL;
+         }
+         
+         iRet = IOPinCheckOutputs( stRule.uiBank, stRule.uiMask );
+         if( iRet )
+         {
+            return iRet;
+         }
+         
+         if( 0 > stRule.iGatePin )
+         {
+            stRule.iGatePin = -1;
+         }
+         stRule.uiTriggerPin = dev->ulPin;
+         stRule.ullFired = 0;
+         
+         spin_lock_irqsave( &g_stReflexLock, ulFlags );
+         for( i = 0; (i < REFLEX_MAX_RULES) && g_astReflexRules[i].iValid; i++ );
+         if( REFLEX_MAX_RULES > i )
+         {
+            stRule.uiIndex = i;
+            g_astReflexRules[i].stRule = stRule;
+            g_astReflexRules[i].iValid = 1;
+            UpdateTriggers();
+         }
+         spin_unlock_irqrestore( &g_stReflexLock, ulFlags );
+         
+         return (REFLEX_MAX_RULES > i)? i: -ENOSPC;
+      }
+      
+      case IOCTL_DEL_REFLEX:
+      {
+         if( REFLEX_MAX_RULES <= ioctl_param )
+         {
+            return -EINVAL;
+         }
+         
+         // Only the device of the trigger pin can delete a rule
+         spin_lock_irqsave( &g_stReflexLock, ulFlags );
+         if( g_astReflexRules[ioctl_param].iValid && (g_astReflexRules[ioctl_param].stRule.uiTriggerPin != dev->ulPin) )
+         {
+            spin_unlock_irqrestore( &g_stReflexLock, ulFlags );
+            return -EPERM;
+         }
+         g_astReflexRules[ioctl_param].iValid = 0;
+         UpdateTriggers();
+         spin_unlock_irqrestore( &g_stReflexLock, ulFlags );
+         break;
+      }
+      
+      case IOCTL_GET_REFLEX:
+      {
+         if( copy_from_user( &stRule, (void __user*)ioctl_param, sizeof(stRule) ) )
+         {
+            return -EFAULT;
+         }
+         
+         if( REFLEX_MAX_RULES <= stRule.uiIndex )
+         {
+            return -EINVAL;
+         }
+         
+         spin_lock_irqsave( &g_stReflexLock, ulFlags );
+         iRet = g_astReflexRules[stRule.uiIndex].iValid;
+         stRule = g_astReflexRules[stRule.uiIndex].stRule;
+         spin_unlock_irqrestore( &g_stReflexLock, ulFlags );
+         
+         if( !iRet )
+         {
+            return -ENOENT;
+         }
+         
+         if( copy_to_user( (void __user*)ioctl_param, &stRule, sizeof(stRule) ) )
+         {
+            return -EFAULT;
+         }
+         break;
+      }
+      
+      default:
+      {
+         return -EINVAL;
+      }
+   }
+   
+   return 0;
+}
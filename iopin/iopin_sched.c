@@ -0,0 +1,247 @@
+/*
+ *  iopin_sched.c - Output changes at absolute deadlines
+ *
+ *  The entries are kept sorted by deadline and a single hrtimer, armed for the earliest
+ *  one, applies every entry that is due with one GPSET/GPCLR write per bank.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin.h"
+
+#define  SCHED_QUEUE_DEPTH    64
+
+//-----[ Module parameters ]------
+static ulong sched_late_ns = 20000;
+module_param( sched_late_ns, ulong, S_IRUGO );
+MODULE_PARM_DESC( sched_late_ns, "Delay after the deadline for a scheduled output to count as late (default 20000ns)" );
+
+//------[ Global variables ]------
+static DEFINE_SPINLOCK( g_stSchedLock );
+static struct hrtimer g_stSchedTimer;
+static struct SIOPinScheduledOutput g_astSchedQueue[SCHED_QUEUE_DEPTH];    // Sorted by deadline
+static unsigned int g_uiSchedDepth;
+static struct SIOPinSchedStats g_stSchedStats;
+
+static enum hrtimer_restart SchedTimerHandler( struct hrtimer* pstTimer )
+{
+   uint32_t auiSet[2] = { 0, 0 };
+   uint32_t auiClear[2] = { 0, 0 };
+   unsigned long ulFlags;
+   unsigned int uiDue;
+   unsigned int i;
+   u64 ullNow;
+   u64 ullLateness;
+   enum hrtimer_restart eRet = HRTIMER_NORESTART;
+   
+   spin_lock_irqsave( &g_stSchedLock, ulFlags );
+   
+   ullNow = ktime_get_ns();
+   
+   for( uiDue = 0; (uiDue < g_uiSchedDepth) && (g_astSchedQueue[uiDue].ullDeadlineNs <= ullNow); uiDue++ )
+   {  // Entries are in deadline order, so a later entry wins over an earlier one for the same pin
+      struct SIOPinScheduledOutput* pstEntry = &g_astSchedQueue[uiDue];
+      
+      if( pstEntry->uiLevel )
+      {
+         auiSet[pstEntry->uiBank] |= pstEntry->uiMask;
+         auiClear[pstEntry->uiBank] &= ~pstEntry->uiMask;
+      }
+      else
+      {
+         auiClear[pstEntry->uiBank] |= pstEntry->uiMask;
+         auiSet[pstEntry->uiBank] &= ~pstEntry->uiMask;
+      }
+   }
+   
+   for( i = 0; i < 2; i++ )
+   {
+      if( auiSet[i] )   iowrite32( auiSet[i], &g_pstGpioRegisters->GPSET[i] );
+      if( auiClear[i] ) iowrite32( auiClear[i], &g_pstGpioRegisters->GPCLR[i] );
+   }
+   
+   for( i = 0; i < uiDue; i++ )
+   {
+      ullLateness = ullNow - g_astSchedQueue[i].ullDeadlineNs;
+      
+      g_stSchedStats.ullFired++;
+      g_stSchedStats.ullTotalLatenessNs += ullLateness;
+      if( ullLateness > g_stSchedStats.ullMaxLatenessNs )
+      {
+         g_stSchedStats.ullMaxLatenessNs = ullLateness;
+      }
+      if( ullLateness > sched_late_ns )
+      {
+         g_stSchedStats.ullLate++;
+      }
+   }
+   
+   if( uiDue )
+   {
+      g_uiSchedDepth -= uiDue;
+      memmove( &g_astSchedQueue[0], &g_astSchedQueue[uiDue], g_uiSchedDepth * sizeof(g_astSchedQueue[0]) );
+   }
+   
+   // SchedEnqueue may have restarted the timer on a new head while this waited for the lock
+   if( g_uiSchedDepth && !hrtimer_is_queued( pstTimer ) )
+   {
+      hrtimer_set_expires( pstTimer, ns_to_ktime( g_astSchedQueue[0].ullDeadlineNs ) );
+      eRet = HRTIMER_RESTART;
+   }
+   
+   spin_unlock_irqrestore( &g_stSchedLock, ulFlags );
+   
+   return eRet;
+}
+
+// Called with g_stSchedLock held
+static int SchedEnqueue( const struct SIOPinScheduledOutput* pstEntry )
+{
+   unsigned int uiPos;
+   
+   if( SCHED_QUEUE_DEPTH <= g_uiSchedDepth )
+   {
+      g_stSchedStats.ullRejected++;
+      return -ENOSPC;
+   }
+   
+   // Insert after every entry with the same or an earlier deadline
+   for( uiPos = g_uiSchedDepth; (0 < uiPos) && (g_astSchedQueue[uiPos - 1].ullDeadlineNs > pstEntry->ullDeadlineNs); uiPos-- )
+   {
+      g_astSchedQueue[uiPos] = g_astSchedQueue[uiPos - 1];
+   }
+   g_astSchedQueue[uiPos] = *pstEntry;
+   g_uiSchedDepth++;
+   
+   if( 0 == uiPos )
+   {  // New earliest deadline. Restarting is fine even while the callback runs: it won't rearm a queued timer
+      hrtimer_start( &g_stSchedTimer, ns_to_ktime( pstEntry->ullDeadlineNs ), HRTIMER_MODE_ABS );
+   }
+   
+   return 0;
+}
+
+// Every pin of the mask must be exported and configured as output
+int IOPinCheckOutputs( uint32_t uiBank, uint32_t uiMask )
+{
+   unsigned long ulPin;
+   
+   if( (1 < uiBank) || (0 == uiMask) || (uiMask & ~g_auiExportedMask[uiBank]) )
+   {
+      return -EINVAL;
+   }
+   
+   for( ulPin = uiBank * 32; ulPin < (uiBank + 1) * 32; ulPin++ )
+   {
+      if( (uiMask & (1 << (ulPin % 32))) && (PIN_FUNCTION_OUTPUT != IOPinGetFunction( ulPin )) )
+      {
+         printk( KERN_INFO "[IOPin] GPIO%lu not configure as output\n", ulPin );
+         return -EPERM;
+      }
+   }
+   
+   return 0;
+}
+
+// Can be called from interrupt context
+int IOPinSchedAdd( const struct SIOPinScheduledOutput* pstEntry )
+{
+   unsigned long ulFlags;
+   int iRet;
+   
+   spin_lock_irqsave( &g_stSchedLock, ulFlags );
+   iRet = SchedEnqueue( pstEntry );
+   spin_unlock_irqrestore( &g_stSchedLock, ulFlags );
+   
+   return iRet;
+}
+
+long IOPinSchedIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   unsigned long ulFlags;
+   
+   switch (ioctl_num)
+   {
+      case IOCTL_SCHEDULE_OUTPUT:
+      {
+         struct SIOPinScheduledOutput stEntry;
+         int iRet;
+         
+         if( copy_from_user( &stEntry, (void __user*)ioctl_param, sizeof(stEntry) ) )
+         {
+            return -EFAULT;
+         }
+         
+         if( 0 == stEntry.uiMask )
+         {  // Pin of the device
+            stEntry.uiBank = dev->ulPin / 32;
+            stEntry.uiMask = 1 << (dev->ulPin % 32);
+         }
+         
+         iRet = IOPinCheckOutputs( stEntry.uiBank, stEntry.uiMask );
+         if( iRet )
+         {
+            return iRet;
+         }
+         
+         return IOPinSchedAdd( &stEntry );
+      }
+      
+      case IOCTL_CANCEL_SCHEDULE:
+      {
+         spin_lock_irqsave( &g_stSchedLock, ulFlags );
+         g_uiSchedDepth = 0;     // If the timer still fires, it finds nothing to do
+         spin_unlock_irqrestore( &g_stSchedLock, ulFlags );
+         break;
+      }
+      
+      case IOCTL_GET_SCHED_STATS:
+      {
+         struct SIOPinSchedStats stStats;
+         
+         spin_lock_irqsave( &g_stSchedLock, ulFlags );
+         stStats = g_stSchedStats;
+         stStats.uiDepth = g_uiSchedDepth;
+         stStats.uiCapacity = SCHED_QUEUE_DEPTH;
+         spin_unlock_irqrestore( &g_stSchedLock, ulFlags );
+         
+         if( copy_to_user( (void __user*)ioctl_param, &stStats, sizeof(stStats) ) )
+         {
+            return -EFAULT;
+         }
+         break;
+      }
+      
+      default:
+      {
+         return -EINVAL;
+      }
+   }
+   
+   return 0;
+}
+
+void IOPinSchedInit( void )
+{
+   hrtimer_init( &g_stSchedTimer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS );
+   g_stSchedTimer.function = SchedTimerHandler;
+}
+
+void IOPinSchedExit( void )
+{
+   hrtimer_cancel( &g_stSchedTimer );
+}
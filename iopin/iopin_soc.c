@@ -0,0 +1,151 @@
+/*
+ *  iopin_soc.c - Register layouts of the SoCs used on the Raspberry PI boards
+ *
+ *  The layout is picked at load time from the machine compatible of the device tree
+ */
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/delay.h>
+#include <asm/io.h>
+#else
+#include <stdint.h>
+#endif
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+
+#ifndef __KERNEL__
+void (*g_pfnIOPinSocWriteHook)( volatile uint32_t* puiRegister, uint32_t uiValue ) = NULL;
+#endif
+
+// BCM2835 to BCM2837: the pull is clocked into the pads by the GPPUD/GPPUDCLK sequence
+static int SetPullBCM2835( struct SGpioRegistersMap* pstRegisters, unsigned long ulPin, unsigned long ulPull )
+{
+   static const uint32_t auiPUD[] = { GPIO_PUD_OFF, GPIO_PUD_DOWN, GPIO_PUD_UP };    // Indexed by PIN_PULL_xxx
+   
+   if( PIN_PULL_UP < ulPull )
+   {
+      return -1;
+   }
+   
+   // Write to GPPUD to set the required control signal
+   SOC_WRITE( auiPUD[ulPull], pstRegisters->GPPUD );
+   
+   // Wait 150 cycles: the maximum frequency is 125Mhz, so that is 1.2us at most
+   SOC_DELAY_US( 2 );
+   
+   // Write to GPPUDCLK to clock the control signal into the GPIO pads
+   SOC_WRITE( (1 << (ulPin % 32)), pstRegisters->GPPUDCLK[ulPin / 32] );
+   
+   // Wait 150 cycles: the maximum frequency is 125Mhz, so that is 1.2us at most
+   SOC_DELAY_US( 2 );
+   
+   // Write to GPPUD to remove the control signal
+   SOC_WRITE( 0, pstRegisters->GPPUD );
+   
+   // Write to GPPUDCLK to remove the clock
+   SOC_WRITE( 0, pstRegisters->GPPUDCLK[ulPin / 32] );
+   
+   return 0;
+}
+
+// The pads of the BCM2835 don't report the pull
+static int GetPullBCM2835( struct SGpioRegistersMap* pstRegisters, unsigned long ulPin )
+{
+   return -1;
+}
+
+// BCM2711: each pin has its own 2-bit field, written directly without any delay
+static int SetPullBCM2711( struct SGpioRegistersMap* pstRegisters, unsigned long ulPin, unsigned long ulPull )
+{
+   static const uint32_t auiPUPPDN[] = { GPIO_PUPPDN_OFF, GPIO_PUPPDN_DOWN, GPIO_PUPPDN_UP };    // Indexed by PIN_PULL_xxx
+   unsigned int uiShift = (ulPin % 16) * 2;
+   uint32_t uiValue;
+   
+   if( PIN_PULL_UP < ulPull )
+   {
+      return -1;
+   }
+   
+   uiValue = SOC_READ( pstRegisters->GPPUPPDN[ulPin / 16] );
+   uiValue = (uiValue & ~(0b11 << uiShift)) | (auiPUPPDN[ulPull] << uiShift);
+   SOC_WRITE( uiValue, pstRegisters->GPPUPPDN[ulPin / 16] );
+   
+   return 0;
+}
+
+static int GetPullBCM2711( struct SGpioRegistersMap* pstRegisters, unsigned long ulPin )
+{
+   switch( (SOC_READ( pstRegisters->GPPUPPDN[ulPin / 16] ) >> ((ulPin % 16) * 2)) & 0b11 )
+   {
+      case GPIO_PUPPDN_UP:    return PIN_PULL_UP;
+      case GPIO_PUPPDN_DOWN:  return PIN_PULL_DOWN;
+      case GPIO_PUPPDN_OFF:   return PIN_PULL_OFF;
+      default:                return -1;
+   }
+}
+
+// The first layout is the fallback when the board can't be identified
+const struct SIOPinSocLayout g_astIOPinSocLayouts[] =
+{
+   {
+      .szName           = "BCM2835",
+      .aszCompatible    = { "brcm,bcm2835", "brcm,bcm2708", NULL },
+      .szGpioCompatible = "brcm,bcm2835-gpio",
+      .ulPeriBase       = BCM2835_PERI_BASE,
+      .iLegacyIRQ       = 49,
+      .uiNumPins        = 54,
+      .uiOscFreq        = 19200000,
+      .uiPlldFreq       = 500000000,
+      .pfnSetPull       = SetPullBCM2835,
+      .pfnGetPull       = GetPullBCM2835,
+   },
+   {
+      .szName           = "BCM2836/BCM2837",
+      .aszCompatible    = { "brcm,bcm2836", "brcm,bcm2837", "brcm,bcm2709" },
+      .szGpioCompatible = "brcm,bcm2835-gpio",
+      .ulPeriBase       = BCM2836_PERI_BASE,
+      .iLegacyIRQ       = -1,
+      .uiNumPins        = 54,
+      .uiOscFreq        = 19200000,
+      .uiPlldFreq       = 500000000,
+      .pfnSetPull       = SetPullBCM2835,
+      .pfnGetPull       = GetPullBCM2835,
+   },
+   {
+      .szName           = "BCM2711",
+      .aszCompatible    = { "brcm,bcm2711", "brcm,bcm2838", NULL },
+      .szGpioCompatible = "brcm,bcm2711-gpio",
+      .ulPeriBase       = BCM2711_PERI_BASE,
+      .iLegacyIRQ       = -1,
+      .uiNumPins        = 58,
+      .uiOscFreq        = 54000000,
+      .uiPlldFreq       = 750000000,
+      .pfnSetPull       = SetPullBCM2711,
+      .pfnGetPull       = GetPullBCM2711,
+   },
+};
+
+const unsigned int g_uiIOPinNumSocLayouts = sizeof(g_astIOPinSocLayouts) / sizeof(g_astIOPinSocLayouts[0]);
+
+// Find the layout of the board. pfnIsCompatible tells if the machine matches a compatible string
+const struct SIOPinSocLayout* IOPinFindSocLayout( int (*pfnIsCompatible)( const char* szCompatible ) )
+{
+   unsigned int i;
+   unsigned int j;
+   
+   for( i = 0; i < g_uiIOPinNumSocLayouts; i++ )
+   {
+      for( j = 0; (j < SOC_MAX_COMPATIBLES) && g_astIOPinSocLayouts[i].aszCompatible[j]; j++ )
+      {
+         if( pfnIsCompatible( g_astIOPinSocLayouts[i].aszCompatible[j] ) )
+         {
+            return &g_astIOPinSocLayouts[i];
+         }
+      }
+   }
+   
+   return &g_astIOPinSocLayouts[0];
+}
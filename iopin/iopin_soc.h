@@ -0,0 +1,46 @@
+#ifndef _IOPIN_SOC_H_
+#define _IOPIN_SOC_H_
+
+/*
+ * Register access of the SoC specific code. Outside the kernel the registers are a plain
+ * memory block (a simulated register map), and every write is also passed to
+ * g_pfnIOPinSocWriteHook so the order of the accesses can be checked
+ */
+#ifdef __KERNEL__
+#define  SOC_READ( reg )            ioread32( &(reg) )
+#define  SOC_WRITE( value, reg )    iowrite32( (value), &(reg) )
+#define  SOC_DELAY_US( us )         udelay( us )
+#else
+#include <stdint.h>
+#include <stddef.h>
+extern void (*g_pfnIOPinSocWriteHook)( volatile uint32_t* puiRegister, uint32_t uiValue );
+#define  SOC_READ( reg )            (*(volatile uint32_t*)&(reg))
+#define  SOC_WRITE( value, reg )    do { *(volatile uint32_t*)&(reg) = (value); if( g_pfnIOPinSocWriteHook ) g_pfnIOPinSocWriteHook( &(reg), (value) ); } while( 0 )
+#define  SOC_DELAY_US( us )         do { } while( 0 )
+#endif
+
+#define  SOC_MAX_COMPATIBLES        3
+
+struct SIOPinSocLayout
+{
+   const char*    szName;
+   const char*    aszCompatible[SOC_MAX_COMPATIBLES];    // Machine compatible strings of the device tree
+   const char*    szGpioCompatible;                      // Compatible string of the GPIO node
+   unsigned long  ulPeriBase;                            // Peripheral base when there is no device tree
+   int            iLegacyIRQ;                            // IRQ of GPIO0-27 when there is no device tree, the next groups follow (-1 if unknown)
+   unsigned int   uiNumPins;
+   uint32_t       uiOscFreq;                             // Frequency of the oscillator clock source (Hz)
+   uint32_t       uiPlldFreq;                            // Frequency of the PLLD clock source (Hz)
+   
+   // Set the pull of a pin (PIN_PULL_xxx). Must be serialized with the other writes to the GPIO block
+   int            (*pfnSetPull)( struct SGpioRegistersMap* pstRegisters, unsigned long ulPin, unsigned long ulPull );
+   // Read back the pull of a pin (PIN_PULL_xxx), or -1 when the SoC can't tell
+   int            (*pfnGetPull)( struct SGpioRegistersMap* pstRegisters, unsigned long ulPin );
+};
+
+extern const struct SIOPinSocLayout g_astIOPinSocLayouts[];
+extern const unsigned int g_uiIOPinNumSocLayouts;
+
+const struct SIOPinSocLayout* IOPinFindSocLayout( int (*pfnIsCompatible)( const char* szCompatible ) );
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ *  iopin_status.c - Read-only view of every exported pin (/proc/iopin)
+ *
+ *  Monitoring reads this file instead of opening every device: one line per pin, built from a
+ *  single pass over the registers, without taking a file or a place in the event log of the pins.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/version.h>
+#include <asm/io.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin.h"
+
+#define  STATUS_FILE_NAME  "iopin"
+
+// The 3 bits of GPFSEL, in order
+static const char* g_aszFunctions[8] = { "in", "out", "alt5", "alt4", "alt0", "alt1", "alt2", "alt3" };
+static const char* g_aszPulls[3] = { "off", "down", "up" };
+static struct proc_dir_entry* g_pstStatusEntry = NULL;
+
+struct SStatusRegisters
+{
+   uint32_t auiFunction[6];
+   uint32_t auiLevel[2];
+   uint32_t auiRising[2];
+   uint32_t auiFalling[2];
+   uint32_t auiHigh[2];
+   uint32_t auiLow[2];
+   uint32_t auiAsyncRising[2];
+   uint32_t auiAsyncFalling[2];
+};
+
+static void ReadRegisters( struct SStatusRegisters* pstRegisters )
+{
+   unsigned int i;
+   
+   for( i = 0; i < 6; i++ )
+   {
+      pstRegisters->auiFunction[i] = ioread32( &g_pstGpioRegisters->GPFSEL[i] );
+   }
+   
+   for( i = 0; i < 2; i++ )
+   {
+      pstRegisters->auiLevel[i] = ioread32( &g_pstGpioRegisters->GPLEV[i] );
+      pstRegisters->auiRising[i] = ioread32( &g_pstGpioRegisters->GPREN[i] );
+      pstRegisters->auiFalling[i] = ioread32( &g_pstGpioRegisters->GPFEN[i] );
+      pstRegisters->auiHigh[i] = ioread32( &g_pstGpioRegisters->GPHEN[i] );
+      pstRegisters->auiLow[i] = ioread32( &g_pstGpioRegisters->GPLEN[i] );
+      pstRegisters->auiAsyncRising[i] = ioread32( &g_pstGpioRegisters->GPAREN[i] );
+      pstRegisters->auiAsyncFalling[i] = ioread32( &g_pstGpioRegisters->GPAFEN[i] );
+   }
+}
+
+static int StatusShow( struct seq_file* pstFile, void* pvData )
+{
+   struct SStatusRegisters stRegisters;
+   struct SIOPinStats stStats;
+   struct SIOPinDev* dev;
+   unsigned long ulFlags;
+   unsigned long ulPin;
+   unsigned int uiBank;
+   uint32_t uiBit;
+   char szEdges[7];
+   int iPull;
+   
+   ReadRegisters( &stRegisters );
+   
+   seq_printf( pstFile, "# %s\n", g_pstSocLayout->szName );
+   seq_puts( pstFile, "pin function level edges pull open mask events sync async missed storms wakeups dropped polling rate\n" );
+   
+   for( ulPin = 0; ulPin < IOPIN_NUM_PINS; ulPin++ )
+   {
+      dev = g_apstPinDevices[ulPin];
+      if( NULL == dev )
+      {
+         continue;
+      }
+      
+      uiBank = ulPin / 32;
+      uiBit = 1U << (ulPin % 32);
+      
+      // Detection enabled in the hardware: rising, falling, high, low, async rising, async falling
+      szEdges[0] = (stRegisters.auiRising[uiBank] & uiBit)? 'R': '-';
+      szEdges[1] = (stRegisters.auiFalling[uiBank] & uiBit)? 'F': '-';
+      szEdges[2] = (stRegisters.auiHigh[uiBank] & uiBit)? 'H': '-';
+      szEdges[3] = (stRegisters.auiLow[uiBank] & uiBit)? 'L': '-';
+      szEdges[4] = (stRegisters.auiAsyncRising[uiBank] & uiBit)? 'r': '-';
+      szEdges[5] = (stRegisters.auiAsyncFalling[uiBank] & uiBit)? 'f': '-';
+      szEdges[6] = '\0';
+      
+      // The BCM2835 can't read the pulls back, only the last one set through the driver is known
+      iPull = g_pstSocLayout->pfnGetPull( g_pstGpioRegisters, ulPin );
+      if( 0 > iPull )
+      {
+         iPull = dev->iPull;
+      }
+      
+      spin_lock_irqsave( &dev->lock, ulFlags );
+      stStats = dev->stStats;
+      stStats.uiMaskState = dev->uiMaskState;
+      spin_unlock_irqrestore( &dev->lock, ulFlags );
+      
+      seq_printf( pstFile, "%lu %s %u %s %s %d %x %llu %llu %llu %llu %llu %llu %llu %llu %u\n",
+                  ulPin,
+                  g_aszFunctions[(stRegisters.auiFunction[ulPin / 10] >> ((ulPin % 10) * 3)) & 0b111],
+                  (stRegisters.auiLevel[uiBank] & uiBit)? 1: 0,
+                  szEdges,
+                  (0 <= iPull)? g_aszPulls[iPull]: "?",
+                  atomic_read( &dev->stOpenCount ),
+                  stStats.uiMaskState,
+                  (unsigned long long)stStats.ullEvents, (unsigned long long)stStats.ullSyncEvents,
+                  (unsigned long long)stStats.ullAsyncEvents, (unsigned long long)stStats.ullMissedPulses,
+                  (unsigned long long)stStats.ullStorms, (unsigned long long)stStats.ullWakeups,
+                  (unsigned long long)stStats.ullDroppedEvents, (unsigned long long)stStats.ullPollingSwitches,
+                  stStats.uiEventRate );
+   }
+   
+   return 0;
+}
+
+static int StatusOpen( struct inode* inode, struct file* filp )
+{
+   return single_open( filp, StatusShow, NULL );
+}
+
+// proc_create takes its own operations since 5.6
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+static const struct proc_ops g_stStatusFops =
+{
+   .proc_open        = StatusOpen,
+   .proc_read        = seq_read,
+   .proc_lseek       = seq_lseek,
+   .proc_release     = single_release,
+};
+#else
+static const struct file_operations g_stStatusFops =
+{
+   .owner            = THIS_MODULE,
+   .open             = StatusOpen,
+   .read             = seq_read,
+   .llseek           = seq_lseek,
+   .release          = single_release,
+};
+#endif
+
+int IOPinStatusInit( void )
+{
+   g_pstStatusEntry = proc_create( STATUS_FILE_NAME, S_IRUGO, NULL, &g_stStatusFops );
+   if( NULL == g_pstStatusEntry )
+   {
+      printk( KERN_WARNING "[IOPin] Failed to create /proc/%s\n", STATUS_FILE_NAME );
+      return -ENOMEM;
+   }
+   
+   return 0;
+}
+
+void IOPinStatusExit( void )
+{
+   if( g_pstStatusEntry )
+   {
+      remove_proc_entry( STATUS_FILE_NAME, NULL );
+      g_pstStatusEntry = NULL;
+   }
+}
@@ -0,0 +1,464 @@
+/*
+ *  iopin_stepper.c - Step/direction pulse generator for stepper motors
+ *
+ *  Every axis is driven by the same periodic hrtimer, so the axes stay in phase. On each tick
+ *  the step pulses of the previous tick end, the profile of every axis is advanced and all the
+ *  pins change with one GPCLR and one GPSET write per bank.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin_profile.h"
+#include "iopin.h"
+
+//-----[ Module parameters ]------
+static ulong stepper_tick_ns = 10000;
+module_param( stepper_tick_ns, ulong, S_IRUGO );
+MODULE_PARM_DESC( stepper_tick_ns, "Period of the stepper timer, also the width of the step pulses (default 10000ns)" );
+
+struct SStepperAxis
+{
+   int                  iBound;
+   unsigned long        ulStepPin;
+   long                 lDirPin;
+   long                 lEnablePin;          // -1 = none
+   uint32_t             auiPinMask[2];       // Step, direction and enable pins, claimed while bound
+   uint32_t             uiFlags;             // STEPPER_xxx
+   struct SIOPinStepperMove astQueue[STEPPER_QUEUE_DEPTH];
+   unsigned int         uiHead;
+   unsigned int         uiCount;
+   struct SIOPinProfile stProfile;           // Current move
+   int                  iDir;                // +1 or -1
+   int                  iStepHigh;           // Step pulse to end on the next tick
+   s64                  llPosition;
+};
+
+//------[ Global variables ]------
+static DEFINE_SPINLOCK( g_stStepperLock );
+static struct hrtimer g_stStepperTimer;
+static struct SStepperAxis g_astAxes[STEPPER_MAX_AXES];
+static int g_iStepperRunning;
+
+static void AddPin( uint32_t* puiMask, long lPin )
+{
+   puiMask[lPin / 32] |= 1U << (lPin % 32);
+}
+
+static void WritePins( const uint32_t* puiClear, const uint32_t* puiSet )
+{
+   unsigned int i;
+   
+   for( i = 0; i < 2; i++ )
+   {
+      if( puiClear[i] )
+      {
+         iowrite32( puiClear[i], &g_pstGpioRegisters->GPCLR[i] );
+      }
+      if( puiSet[i] )
+      {
+         iowrite32( puiSet[i], &g_pstGpioRegisters->GPSET[i] );
+      }
+   }
+}
+
+static void SetEnable( struct SStepperAxis* pstAxis, int iEnable, uint32_t* puiClear, uint32_t* puiSet )
+{
+   if( 0 > pstAxis->lEnablePin )
+   {
+      return;
+   }
+   
+   if( (!iEnable) != (!(pstAxis->uiFlags & STEPPER_ENABLE_ACTIVE_LOW)) )
+   {
+      AddPin( puiSet, pstAxis->lEnablePin );
+   }
+   else
+   {
+      AddPin( puiClear, pstAxis->lEnablePin );
+   }
+}
+
+// Called with g_stStepperLock held. The direction changes at least one tick before the first step
+static void StartNextMove( struct SStepperAxis* pstAxis, uint32_t* puiClear, uint32_t* puiSet )
+{
+   struct SIOPinStepperMove* pstMove;
+   
+   while( pstAxis->uiCount && (0 == pstAxis->stProfile.uiRemaining) )
+   {
+      pstMove = &pstAxis->astQueue[pstAxis->uiHead];
+      pstAxis->uiHead = (pstAxis->uiHead + 1) % STEPPER_QUEUE_DEPTH;
+      pstAxis->uiCount--;
+      
+      if( 0 == pstMove->iSteps )
+      {
+         continue;
+      }
+      
+      pstAxis->iDir = (0 < pstMove->iSteps)? 1: -1;
+      if( (0 < pstAxis->iDir) != !!(pstAxis->uiFlags & STEPPER_DIR_INVERT) )
+      {
+         AddPin( puiSet, pstAxis->lDirPin );
+      }
+      else
+      {
+         AddPin( puiClear, pstAxis->lDirPin );
+      }
+      
+      IOPinProfileStart( &pstAxis->stProfile, (0 < pstMove->iSteps)? pstMove->iSteps: -pstMove->iSteps,
+                         pstMove->uiMaxRate, pstMove->uiAccel, stepper_tick_ns );
+   }
+}
+
+static enum hrtimer_restart StepperTimerHandler( struct hrtimer* pstTimer )
+{
+   struct SStepperAxis* pstAxis;
+   uint32_t auiClear[2] = { 0, 0 };
+   uint32_t auiSet[2] = { 0, 0 };
+   unsigned long ulFlags;
+   unsigned int i;
+   int iBusy = 0;
+   
+   spin_lock_irqsave( &g_stStepperLock, ulFlags );
+   
+   for( i = 0; i < STEPPER_MAX_AXES; i++ )
+   {
+      pstAxis = &g_astAxes[i];
+      if( !pstAxis->iBound )
+      {
+         continue;
+      }
+      
+      if( pstAxis->iStepHigh )
+      {
+         AddPin( auiClear, pstAxis->ulStepPin );
+         pstAxis->iStepHigh = 0;
+      }
+      
+      if( 0 == pstAxis->stProfile.uiRemaining )
+      {
+         StartNextMove( pstAxis, auiClear, auiSet );
+      }
+      else if( IOPinProfileTick( &pstAxis->stProfile ) )
+      {
+         AddPin( auiSet, pstAxis->ulStepPin );
+         pstAxis->iStepHigh = 1;
+         pstAxis->llPosition += pstAxis->iDir;
+      }
+      
+      iBusy |= pstAxis->stProfile.uiRemaining || pstAxis->uiCount || pstAxis->iStepHigh;
+   }
+   
+   WritePins( auiClear, auiSet );
+   
+   if( !iBusy )
+   {
+      g_iStepperRunning = 0;
+      spin_unlock_irqrestore( &g_stStepperLock, ulFlags );
+      return HRTIMER_NORESTART;
+   }
+   
+   spin_unlock_irqrestore( &g_stStepperLock, ulFlags );
+   
+   hrtimer_forward_now( pstTimer, ns_to_ktime( stepper_tick_ns ) );
+   return HRTIMER_RESTART;
+}
+
+// Called with g_stStepperLock held
+static void Unbind( struct SStepperAxis* pstAxis )
+{
+   uint32_t auiClear[2] = { 0, 0 };
+   uint32_t auiSet[2] = { 0, 0 };
+   
+   AddPin( auiClear, pstAxis->ulStepPin );
+   SetEnable( pstAxis, 0, auiClear, auiSet );
+   WritePins( auiClear, auiSet );
+   
+   pstAxis->iBound = 0;
+   pstAxis->uiCount = 0;
+   pstAxis->stProfile.uiRemaining = 0;
+   pstAxis->iStepHigh = 0;
+   
+   IOPinReleasePins( pstAxis->auiPinMask );
+}
+
+static int IsExported( long lPin )
+{
+   return (0 <= lPin) && (IOPIN_NUM_PINS > lPin) && (NULL != g_apstPinDevices[lPin]);
+}
+
+static long Bind( struct SIOPinDev* dev, const struct SIOPinStepperBind* pstBind )
+{
+   struct SStepperAxis* pstAxis;
+   uint32_t auiPinMask[2] = { 0, 0 };
+   uint32_t auiClear[2] = { 0, 0 };
+   uint32_t auiSet[2] = { 0, 0 };
+   unsigned long ulFlags;
+   
+   if( (STEPPER_MAX_AXES <= pstBind->uiAxis) || !IsExported( pstBind->iDirPin ) || (pstBind->iDirPin == dev->ulPin) ||
+       ((-1 != pstBind->iEnablePin) && (!IsExported( pstBind->iEnablePin ) || (pstBind->iEnablePin == dev->ulPin) || (pstBind->iEnablePin == pstBind->iDirPin))) )
+   {
+      return -EINVAL;
+   }
+   
+   AddPin( auiPinMask, dev->ulPin );
+   AddPin( auiPinMask, pstBind->iDirPin );
+   if( -1 != pstBind->iEnablePin )
+   {
+      AddPin( auiPinMask, pstBind->iEnablePin );
+   }
+   
+   spin_lock_irqsave( &g_stStepperLock, ulFlags );
+   
+   // Neither the axis nor its pins used by another axis, a bus, a UART, a matrix or a clock generator
+   pstAxis = &g_astAxes[pstBind->uiAxis];
+   if( pstAxis->iBound || IOPinClaimPins( auiPinMask ) )
+   {
+      spin_unlock_irqrestore( &g_stStepperLock, ulFlags );
+      return -EBUSY;
+   }
+   
+   // Only once nothing can fail, so a refused bind leaves the pins alone
+   IOPinSetFunction( dev->ulPin, PIN_FUNCTION_OUTPUT );
+   IOPinSetFunction( pstBind->iDirPin, PIN_FUNCTION_OUTPUT );
+   if( -1 != pstBind->iEnablePin )
+   {
+      IOPinSetFunction( pstBind->iEnablePin, PIN_FUNCTION_OUTPUT );
+   }
+   
+   memset( pstAxis, 0, sizeof(*pstAxis) );
+   pstAxis->ulStepPin = dev->ulPin;
+   pstAxis->lDirPin = pstBind->iDirPin;
+   pstAxis->lEnablePin = pstBind->iEnablePin;
+   pstAxis->auiPinMask[0] = auiPinMask[0];
+   pstAxis->auiPinMask[1] = auiPinMask[1];
+   pstAxis->uiFlags = pstBind->uiFlags;
+   pstAxis->iDir = 1;
+   pstAxis->iBound = 1;
+   
+   AddPin( auiClear, pstAxis->ulStepPin );
+   SetEnable( pstAxis, 1, auiClear, auiSet );
+   WritePins( auiClear, auiSet );
+   
+   spin_unlock_irqrestore( &g_stStepperLock, ulFlags );
+   
+   return 0;
+}
+
+static long QueueMoves( const struct SIOPinStepperMoves* pstMoves )
+{
+   const struct SIOPinStepperMove* pstMove;
+   unsigned int auiNew[STEPPER_MAX_AXES] = { 0 };
+   ulong ulMaxRate = NSEC_PER_SEC / (2 * stepper_tick_ns);     // A step is one tick high and one low
+   struct SStepperAxis* pstAxis;
+   unsigned long ulFlags;
+   unsigned int i;
+   
+   if( (0 == pstMoves->uiCount) || (STEPPER_MAX_AXES < pstMoves->uiCount) )
+   {
+      return -EINVAL;
+   }
+   
+   for( i = 0; i < pstMoves->uiCount; i++ )
+   {
+      pstMove = &pstMoves->astMoves[i];
+      if( (STEPPER_MAX_AXES <= pstMove->uiAxis) || (0 == pstMove->uiMaxRate) || (ulMaxRate < pstMove->uiMaxRate) ||
+          (STEPPER_MAX_ACCEL < pstMove->uiAccel) || (INT_MIN == pstMove->iSteps) )
+      {
+         return -EINVAL;
+      }
+      auiNew[pstMove->uiAxis]++;
+   }
+   
+   spin_lock_irqsave( &g_stStepperLock, ulFlags );
+   
+   for( i = 0; i < STEPPER_MAX_AXES; i++ )
+   {
+      if( auiNew[i] && (!g_astAxes[i].iBound || ((g_astAxes[i].uiCount + auiNew[i]) > STEPPER_QUEUE_DEPTH)) )
+      {
+         spin_unlock_irqrestore( &g_stStepperLock, ulFlags );
+         return g_astAxes[i].iBound? -ENOSPC: -ENODEV;
+      }
+   }
+   
+   // All at once, so the idle axes start them on the same tick
+   for( i = 0; i < pstMoves->uiCount; i++ )
+   {
+      pstMove = &pstMoves->astMoves[i];
+      pstAxis = &g_astAxes[pstMove->uiAxis];
+      pstAxis->astQueue[(pstAxis->uiHead + pstAxis->uiCount) % STEPPER_QUEUE_DEPTH] = *pstMove;
+      pstAxis->uiCount++;
+   }
+   
+   if( !g_iStepperRunning )
+   {
+      g_iStepperRunning = 1;
+      hrtimer_start( &g_stStepperTimer, ns_to_ktime( stepper_tick_ns ), HRTIMER_MODE_REL );
+   }
+   
+   spin_unlock_irqrestore( &g_stStepperLock, ulFlags );
+   
+   return 0;
+}
+
+void IOPinStepperInit( void )
+{
+   hrtimer_init( &g_stStepperTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL );
+   g_stStepperTimer.function = StepperTimerHandler;
+   
+   if( stepper_tick_ns < 2000 )
+   {  // The timer would take the whole CPU
+      stepper_tick_ns = 2000;
+   }
+}
+
+void IOPinStepperExit( void )
+{
+   unsigned long ulFlags;
+   unsigned int i;
+   
+   hrtimer_cancel( &g_stStepperTimer );
+   
+   spin_lock_irqsave( &g_stStepperLock, ulFlags );
+   for( i = 0; i < STEPPER_MAX_AXES; i++ )
+   {
+      if( g_astAxes[i].iBound )
+      {
+         Unbind( &g_astAxes[i] );
+      }
+   }
+   g_iStepperRunning = 0;
+   spin_unlock_irqrestore( &g_stStepperLock, ulFlags );
+}
+
+// Unbinds the axes stepped by the pin
+void IOPinStepperRelease( unsigned long ulPin )
+{
+   unsigned long ulFlags;
+   unsigned int i;
+   
+   spin_lock_irqsave( &g_stStepperLock, ulFlags );
+   for( i = 0; i < STEPPER_MAX_AXES; i++ )
+   {
+      if( g_astAxes[i].iBound && (g_astAxes[i].ulStepPin == ulPin) )
+      {
+         Unbind( &g_astAxes[i] );
+      }
+   }
+   spin_unlock_irqrestore( &g_stStepperLock, ulFlags );
+}
+
+long IOPinStepperIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   struct SIOPinStepperBind stBind;
+   struct SIOPinStepperMoves stMoves;
+   struct SIOPinStepperStatus stStatus;
+   struct SStepperAxis* pstAxis;
+   unsigned long ulFlags;
+   
+   switch( ioctl_num )
+   {
+      case IOCTL_STEPPER_BIND:
+      {
+         if( copy_from_user( &stBind, (void __user*)ioctl_param, sizeof(stBind) ) )
+         {
+            return -EFAULT;
+         }
+         
+         return Bind( dev, &stBind );
+      }
+      
+      case IOCTL_STEPPER_UNBIND:
+      case IOCTL_STEPPER_STOP:
+      {
+         if( STEPPER_MAX_AXES <= ioctl_param )
+         {
+            return -EINVAL;
+         }
+         
+         spin_lock_irqsave( &g_stStepperLock, ulFlags );
+         
+         // Any device can stop an axis, as any device can move it. Only the one of the step pin unbinds it
+         pstAxis = &g_astAxes[ioctl_param];
+         if( !pstAxis->iBound || ((IOCTL_STEPPER_UNBIND == ioctl_num) && (pstAxis->ulStepPin != dev->ulPin)) )
+         {
+            spin_unlock_irqrestore( &g_stStepperLock, ulFlags );
+            return pstAxis->iBound? -EPERM: -ENODEV;
+         }
+         
+         if( IOCTL_STEPPER_UNBIND == ioctl_num )
+         {
+            Unbind( pstAxis );
+         }
+         else
+         {
+            pstAxis->uiCount = 0;
+            pstAxis->stProfile.uiRemaining = 0;
+         }
+         
+         spin_unlock_irqrestore( &g_stStepperLock, ulFlags );
+         break;
+      }
+      
+      case IOCTL_STEPPER_MOVE:
+      {
+         if( copy_from_user( &stMoves, (void __user*)ioctl_param, sizeof(stMoves) ) )
+         {
+            return -EFAULT;
+         }
+         
+         return QueueMoves( &stMoves );
+      }
+      
+      case IOCTL_STEPPER_STATUS:
+      {
+         if( copy_from_user( &stStatus, (void __user*)ioctl_param, sizeof(stStatus) ) )
+         {
+            return -EFAULT;
+         }
+         
+         if( STEPPER_MAX_AXES <= stStatus.uiAxis )
+         {
+            return -EINVAL;
+         }
+         
+         spin_lock_irqsave( &g_stStepperLock, ulFlags );
+         pstAxis = &g_astAxes[stStatus.uiAxis];
+         if( !pstAxis->iBound )
+         {
+            spin_unlock_irqrestore( &g_stStepperLock, ulFlags );
+            return -ENODEV;
+         }
+         stStatus.uiQueued = pstAxis->uiCount;
+         stStatus.llPosition = pstAxis->llPosition;
+         stStatus.uiRemaining = pstAxis->stProfile.uiRemaining;
+         stStatus.uiRate = pstAxis->stProfile.uiRemaining? (pstAxis->stProfile.ullRateQ16 >> 16): 0;
+         spin_unlock_irqrestore( &g_stStepperLock, ulFlags );
+         
+         if( copy_to_user( (void __user*)ioctl_param, &stStatus, sizeof(stStatus) ) )
+         {
+            return -EFAULT;
+         }
+         break;
+      }
+      
+      default:
+      {
+         return -EINVAL;
+      }
+   }
+   
+   return 0;
+}
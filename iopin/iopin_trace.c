@@ -0,0 +1,627 @@
+/*
+ *  iopin_trace.c - Recording and replay of edge traces
+ *
+ *  /dev/iopintrace reads the edges of the recorded pins as they are notified and writes traces
+ *  back onto outputs. The playback is a single hrtimer armed for the next record, and the records
+ *  with the same time are applied together with one GPSET and one GPCLR write per bank, so edges
+ *  that were simultaneous are still simultaneous.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/device.h>
+#include <linux/spinlock.h>
+#include <linux/poll.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin.h"
+
+#define  TRACE_DEVICE_NAME    "iopintrace"
+#define  TRACE_FIFO_SIZE      4096     // Records of each direction
+#define  TRACE_CHUNK          64       // Records copied from/to userspace at a time
+#define  TRACE_MAX_DELTA      0xFFFFFFFFULL
+
+static int iopin_trace_open( struct inode* inode, struct file* filp );
+static ssize_t iopin_trace_read( struct file* filp, char __user* buf, size_t count, loff_t* f_pos );
+static ssize_t iopin_trace_write( struct file* filp, const char __user* buf, size_t count, loff_t* f_pos );
+static unsigned int iopin_trace_poll( struct file* filp, poll_table* wait_table );
+static long iopin_trace_ioctl( struct file* filp, unsigned int ioctl_num, unsigned long ioctl_param );
+
+//------[ Module operations ]------
+static struct file_operations g_stIOPinTraceFops =
+{
+   .owner            = THIS_MODULE,
+   .open             = iopin_trace_open,
+   .read             = iopin_trace_read,
+   .write            = iopin_trace_write,
+   .poll             = iopin_trace_poll,
+   .unlocked_ioctl   = iopin_trace_ioctl,
+};
+
+//------[ Global variables ]------
+static struct cdev g_stTraceCdev;
+static dev_t g_TraceDevno;
+static int g_iTraceCreated;
+static DEFINE_SPINLOCK( g_stTraceLock );
+static DECLARE_WAIT_QUEUE_HEAD( g_stTraceWait );
+static struct SIOPinTraceStatus g_stTraceStatus;
+
+// Recording
+static uint32_t g_auiRecordMask[2];
+static u64 g_ullRecordLast;                           // Time of the last record stored
+static struct SIOPinTraceEdge g_astRecord[TRACE_FIFO_SIZE];
+static unsigned int g_uiRecordHead;
+static unsigned int g_uiRecordCount;
+
+// Playback
+static struct hrtimer g_stPlayTimer;
+static uint8_t g_aucOutput[TRACE_MAX_PINS];
+static struct SIOPinTraceEdge g_astPlay[TRACE_FIFO_SIZE];
+static unsigned int g_uiPlayHead;
+static unsigned int g_uiPlayCount;
+static int g_iPlaying;
+static int g_iPlayReference;                          // g_ullPlayLast is the time of the last records played
+static u64 g_ullPlayLast;
+
+static void WritePins( const uint32_t* puiClear, const uint32_t* puiSet )
+{
+   unsigned int i;
+   
+   for( i = 0; i < 2; i++ )
+   {
+      if( puiClear[i] )
+      {
+         iowrite32( puiClear[i], &g_pstGpioRegisters->GPCLR[i] );
+      }
+      if( puiSet[i] )
+      {
+         iowrite32( puiSet[i], &g_pstGpioRegisters->GPSET[i] );
+      }
+   }
+}
+
+static int IsRecording( void )
+{
+   return g_auiRecordMask[0] || g_auiRecordMask[1];
+}
+
+// A writer is only woken once half of the playback FIFO has been played, so each write() hands over a large batch
+static int HasPlayRoom( void )
+{
+   return (TRACE_FIFO_SIZE / 2) >= g_uiPlayCount;
+}
+
+// What was done before the error, if anything
+static ssize_t Transferred( size_t szRecords, ssize_t iError )
+{
+   return szRecords? (ssize_t)(szRecords * sizeof(struct SIOPinTraceEdge)): iError;
+}
+
+// Called with g_stTraceLock held
+static int PushRecord( u64 ullDeltaNs, uint8_t ucPin, uint8_t ucLevel )
+{
+   struct SIOPinTraceEdge* pstEdge;
+   
+   if( TRACE_FIFO_SIZE == g_uiRecordCount )
+   {
+      return 0;
+   }
+   
+   pstEdge = &g_astRecord[(g_uiRecordHead + g_uiRecordCount) % TRACE_FIFO_SIZE];
+   pstEdge->uiDeltaNs = ullDeltaNs;
+   pstEdge->ucPin = ucPin;
+   pstEdge->ucLevel = ucLevel;
+   pstEdge->usReserved = 0;
+   g_uiRecordCount++;
+   
+   return 1;
+}
+
+// Called for every event notified, from the interrupt handler or the polling timer
+void IOPinTraceEdge( unsigned long ulPin, uint32_t uiLevel, u64 ullTimestamp )
+{
+   unsigned long ulFlags;
+   u64 ullDelta = 0;
+   int iWake = 0;
+   
+   if( !(g_auiRecordMask[ulPin / 32] & (1U << (ulPin % 32))) )
+   {
+      return;
+   }
+   
+   spin_lock_irqsave( &g_stTraceLock, ulFlags );
+   
+   if( g_auiRecordMask[ulPin / 32] & (1U << (ulPin % 32)) )
+   {
+      // The polled pins are timestamped by their timer, a little out of order with the others
+      if( ullTimestamp > g_ullRecordLast )
+      {
+         ullDelta = ullTimestamp - g_ullRecordLast;
+      }
+      
+      while( (TRACE_MAX_DELTA < ullDelta) && PushRecord( TRACE_MAX_DELTA, TRACE_PIN_DELAY, 0 ) )
+      {
+         ullDelta -= TRACE_MAX_DELTA;
+         g_ullRecordLast += TRACE_MAX_DELTA;
+      }
+      
+      // A record lost doesn't move g_ullRecordLast, so the next one keeps its time
+      if( (TRACE_MAX_DELTA >= ullDelta) && PushRecord( ullDelta, ulPin, !!uiLevel ) )
+      {
+         g_ullRecordLast += ullDelta;
+         g_stTraceStatus.ullRecorded++;
+         iWake = 1;
+      }
+      else
+      {
+         g_stTraceStatus.uiLost++;
+      }
+   }
+   
+   spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+   
+   if( iWake )
+   {
+      wake_up_interruptible( &g_stTraceWait );
+   }
+}
+
+static enum hrtimer_restart PlayTimerHandler( struct hrtimer* pstTimer )
+{
+   struct SIOPinTraceEdge* pstEdge;
+   uint32_t auiClear[2] = { 0, 0 };
+   uint32_t auiSet[2] = { 0, 0 };
+   unsigned long ulFlags;
+   unsigned int uiOutput;
+   uint32_t uiBit;
+   u64 ullNow;
+   
+   ullNow = ktime_get_ns();
+   
+   spin_lock_irqsave( &g_stTraceLock, ulFlags );
+   
+   if( 0 == g_uiPlayCount )
+   {  // Stopped
+      g_iPlaying = 0;
+      spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+      return HRTIMER_NORESTART;
+   }
+   
+   if( (ullNow > g_ullPlayLast) && ((ullNow - g_ullPlayLast) > g_stTraceStatus.uiMaxLateNs) )
+   {
+      g_stTraceStatus.uiMaxLateNs = min_t( u64, ullNow - g_ullPlayLast, TRACE_MAX_DELTA );
+   }
+   
+   // Every record of this instant. The last edge of a pin wins
+   do
+   {
+      pstEdge = &g_astPlay[g_uiPlayHead];
+      g_uiPlayHead = (g_uiPlayHead + 1) % TRACE_FIFO_SIZE;
+      g_uiPlayCount--;
+      g_stTraceStatus.ullPlayed++;
+      
+      uiOutput = (TRACE_PIN_DELAY == pstEdge->ucPin)? TRACE_NO_OUTPUT: g_aucOutput[pstEdge->ucPin];
+      if( TRACE_NO_OUTPUT != uiOutput )
+      {
+         uiBit = 1U << (uiOutput % 32);
+         auiSet[uiOutput / 32] &= ~uiBit;
+         auiClear[uiOutput / 32] &= ~uiBit;
+         if( pstEdge->ucLevel )
+         {
+            auiSet[uiOutput / 32] |= uiBit;
+         }
+         else
+         {
+            auiClear[uiOutput / 32] |= uiBit;
+         }
+      }
+   }
+   while( g_uiPlayCount && (0 == g_astPlay[g_uiPlayHead].uiDeltaNs) );
+   
+   WritePins( auiClear, auiSet );
+   
+   if( 0 == g_uiPlayCount )
+   {  // Ran dry, the next write starts the timer again
+      g_iPlaying = 0;
+      spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+      wake_up_interruptible( &g_stTraceWait );
+      return HRTIMER_NORESTART;
+   }
+   
+   g_ullPlayLast += g_astPlay[g_uiPlayHead].uiDeltaNs;
+   hrtimer_set_expires( pstTimer, ns_to_ktime( g_ullPlayLast ) );
+   
+   spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+   
+   if( HasPlayRoom() )
+   {
+      wake_up_interruptible( &g_stTraceWait );
+   }
+   
+   return HRTIMER_RESTART;
+}
+
+// Called with g_stTraceLock held
+static void StartPlay( void )
+{
+   u64 ullNow;
+   
+   if( g_iPlaying || (0 == g_uiPlayCount) )
+   {
+      return;
+   }
+   
+   ullNow = ktime_get_ns();
+   if( !g_iPlayReference )
+   {  // The first record of a trace is timed from now
+      g_ullPlayLast = ullNow;
+      g_iPlayReference = 1;
+   }
+   
+   g_ullPlayLast += g_astPlay[g_uiPlayHead].uiDeltaNs;
+   if( g_ullPlayLast < ullNow )
+   {  // The time of this record passed while the FIFO was empty
+      g_stTraceStatus.uiUnderruns++;
+      g_ullPlayLast = ullNow;
+   }
+   
+   g_iPlaying = 1;
+   hrtimer_start( &g_stPlayTimer, ns_to_ktime( g_ullPlayLast ), HRTIMER_MODE_ABS );
+}
+
+static void StopPlay( void )
+{
+   unsigned long ulFlags;
+   
+   spin_lock_irqsave( &g_stTraceLock, ulFlags );
+   g_uiPlayCount = 0;
+   g_iPlayReference = 0;
+   spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+   
+   hrtimer_cancel( &g_stPlayTimer );
+   
+   // A write may have come in before the timer was cancelled
+   spin_lock_irqsave( &g_stTraceLock, ulFlags );
+   g_iPlaying = 0;
+   StartPlay();
+   spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+   
+   wake_up_interruptible( &g_stTraceWait );
+}
+
+int IOPinTraceInit( struct class* pobjClass, dev_t devno )
+{
+   struct device* pstDevice;
+   int iRet;
+   int i;
+   
+   hrtimer_init( &g_stPlayTimer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS );
+   g_stPlayTimer.function = PlayTimerHandler;
+   
+   // By default the trace is replayed on the pins it was recorded from
+   for( i = 0; i < TRACE_MAX_PINS; i++ )
+   {
+      g_aucOutput[i] = (IOPIN_NUM_PINS > i)? i: TRACE_NO_OUTPUT;
+   }
+   
+   cdev_init( &g_stTraceCdev, &g_stIOPinTraceFops );
+   g_stTraceCdev.owner = THIS_MODULE;
+   
+   iRet = cdev_add( &g_stTraceCdev, devno, 1 );
+   if( iRet )
+   {
+      printk( KERN_WARNING "[IOPin] Error %d while trying to add %s\n", iRet, TRACE_DEVICE_NAME );
+      return iRet;
+   }
+   
+   pstDevice = device_create( pobjClass, NULL, devno, NULL, TRACE_DEVICE_NAME );
+   if( IS_ERR( pstDevice ) )
+   {
+      iRet = PTR_ERR( pstDevice );
+      printk( KERN_WARNING "[IOPin] Error %d while trying to create %s\n", iRet, TRACE_DEVICE_NAME );
+      cdev_del( &g_stTraceCdev );
+      return iRet;
+   }
+   
+   g_TraceDevno = devno;
+   g_iTraceCreated = 1;
+   
+   return 0;
+}
+
+void IOPinTraceExit( struct class* pobjClass )
+{
+   g_auiRecordMask[0] = 0;
+   g_auiRecordMask[1] = 0;
+   
+   // Without the device nothing could start the timer, which may not even be initialised
+   if( g_iTraceCreated )
+   {
+      hrtimer_cancel( &g_stPlayTimer );
+      device_destroy( pobjClass, g_TraceDevno );
+      cdev_del( &g_stTraceCdev );
+      g_iTraceCreated = 0;
+   }
+}
+
+static int iopin_trace_open( struct inode* inode, struct file* filp )
+{
+   unsigned long ulFlags;
+   
+   // A new writer starts a new trace, unless the previous one is still playing
+   if( filp->f_mode & FMODE_WRITE )
+   {
+      spin_lock_irqsave( &g_stTraceLock, ulFlags );
+      if( !g_iPlaying )
+      {
+         g_iPlayReference = 0;
+      }
+      spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+   }
+   
+   return 0;
+}
+
+static ssize_t iopin_trace_read( struct file* filp, char __user* buf, size_t count, loff_t* f_pos )
+{
+   struct SIOPinTraceEdge astChunk[TRACE_CHUNK];
+   size_t szRecords = count / sizeof(struct SIOPinTraceEdge);
+   unsigned long ulFlags;
+   size_t szDone = 0;
+   size_t szCount;
+   size_t i;
+   int iRecording;
+   
+   if( 0 == szRecords )
+   {
+      return -EINVAL;
+   }
+   
+   while( szDone < szRecords )
+   {
+      spin_lock_irqsave( &g_stTraceLock, ulFlags );
+      szCount = min_t( size_t, szRecords - szDone, min_t( size_t, TRACE_CHUNK, g_uiRecordCount ) );
+      for( i = 0; i < szCount; i++ )
+      {
+         astChunk[i] = g_astRecord[g_uiRecordHead];
+         g_uiRecordHead = (g_uiRecordHead + 1) % TRACE_FIFO_SIZE;
+      }
+      g_uiRecordCount -= szCount;
+      iRecording = IsRecording();
+      spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+      
+      if( 0 == szCount )
+      {  // Only waits for the first record. The end of the file is the end of the recording
+         if( szDone || !iRecording )
+         {
+            break;
+         }
+         if( filp->f_flags & O_NONBLOCK )
+         {
+            return -EAGAIN;
+         }
+         if( wait_event_interruptible( g_stTraceWait, g_uiRecordCount || !IsRecording() ) )
+         {
+            return -ERESTARTSYS;
+         }
+         continue;
+      }
+      
+      if( copy_to_user( buf + szDone * sizeof(struct SIOPinTraceEdge), astChunk, szCount * sizeof(struct SIOPinTraceEdge) ) )
+      {
+         return Transferred( szDone, -EFAULT );
+      }
+      szDone += szCount;
+   }
+   
+   return szDone * sizeof(struct SIOPinTraceEdge);
+}
+
+static ssize_t iopin_trace_write( struct file* filp, const char __user* buf, size_t count, loff_t* f_pos )
+{
+   struct SIOPinTraceEdge astChunk[TRACE_CHUNK];
+   size_t szRecords = count / sizeof(struct SIOPinTraceEdge);
+   uint32_t auiOutputs[2];
+   unsigned long ulFlags;
+   unsigned int uiOutput;
+   size_t szDone = 0;
+   size_t szChunk;
+   size_t szCount;
+   size_t i;
+   int iRet;
+   
+   if( (0 == szRecords) || (count % sizeof(struct SIOPinTraceEdge)) )
+   {
+      return -EINVAL;
+   }
+   
+   while( szDone < szRecords )
+   {
+      szChunk = min_t( size_t, szRecords - szDone, TRACE_CHUNK );
+      if( copy_from_user( astChunk, buf + szDone * sizeof(struct SIOPinTraceEdge), szChunk * sizeof(struct SIOPinTraceEdge) ) )
+      {
+         return Transferred( szDone, -EFAULT );
+      }
+      
+      // Every output of the chunk must be exported and configured as output
+      auiOutputs[0] = 0;
+      auiOutputs[1] = 0;
+      for( i = 0; i < szChunk; i++ )
+      {
+         if( TRACE_PIN_DELAY == astChunk[i].ucPin )
+         {
+            continue;
+         }
+         if( (TRACE_MAX_PINS <= astChunk[i].ucPin) || (1 < astChunk[i].ucLevel) )
+         {
+            return Transferred( szDone, -EINVAL );
+         }
+         uiOutput = g_aucOutput[astChunk[i].ucPin];
+         if( TRACE_NO_OUTPUT != uiOutput )
+         {
+            auiOutputs[uiOutput / 32] |= 1U << (uiOutput % 32);
+         }
+      }
+      for( i = 0; i < 2; i++ )
+      {
+         iRet = auiOutputs[i]? IOPinCheckOutputs( i, auiOutputs[i] ): 0;
+         if( iRet )
+         {
+            return Transferred( szDone, iRet );
+         }
+      }
+      
+      spin_lock_irqsave( &g_stTraceLock, ulFlags );
+      szCount = min_t( size_t, szChunk, TRACE_FIFO_SIZE - g_uiPlayCount );
+      for( i = 0; i < szCount; i++ )
+      {
+         g_astPlay[(g_uiPlayHead + g_uiPlayCount) % TRACE_FIFO_SIZE] = astChunk[i];
+         g_uiPlayCount++;
+      }
+      StartPlay();
+      spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+      
+      szDone += szCount;
+      if( szCount < szChunk )
+      {  // The FIFO is full
+         if( filp->f_flags & O_NONBLOCK )
+         {
+            return Transferred( szDone, -EAGAIN );
+         }
+         if( wait_event_interruptible( g_stTraceWait, HasPlayRoom() ) )
+         {
+            return Transferred( szDone, -ERESTARTSYS );
+         }
+      }
+   }
+   
+   return szDone * sizeof(struct SIOPinTraceEdge);
+}
+
+static unsigned int iopin_trace_poll( struct file* filp, poll_table* wait_table )
+{
+   unsigned int mask = 0;
+   
+   poll_wait( filp, &g_stTraceWait, wait_table );
+   
+   if( g_uiRecordCount )
+   {
+      mask |= (POLLIN | POLLRDNORM);
+   }
+   if( HasPlayRoom() )
+   {
+      mask |= (POLLOUT | POLLWRNORM);
+   }
+   
+   return mask;
+}
+
+static long iopin_trace_ioctl( struct file* filp, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   struct SIOPinTraceRecord stRecord;
+   struct SIOPinTraceMap stMap;
+   struct SIOPinTraceStatus stStatus;
+   unsigned long ulFlags;
+   unsigned int i;
+   
+   switch( ioctl_num )
+   {
+      case IOCTL_TRACE_RECORD:
+      {
+         if( copy_from_user( &stRecord, (void __user*)ioctl_param, sizeof(stRecord) ) )
+         {
+            return -EFAULT;
+         }
+         if( (stRecord.auiMask[0] & ~g_auiExportedMask[0]) || (stRecord.auiMask[1] & ~g_auiExportedMask[1]) )
+         {
+            return -EINVAL;
+         }
+         
+         spin_lock_irqsave( &g_stTraceLock, ulFlags );
+         if( !IsRecording() )
+         {  // A new trace, timed from now
+            g_ullRecordLast = ktime_get_ns();
+            g_uiRecordHead = 0;
+            g_uiRecordCount = 0;
+         }
+         g_auiRecordMask[0] = stRecord.auiMask[0];
+         g_auiRecordMask[1] = stRecord.auiMask[1];
+         spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+         
+         // The readers get the end of the file if it was stopped
+         wake_up_interruptible( &g_stTraceWait );
+         break;
+      }
+      
+      case IOCTL_TRACE_MAP:
+      {
+         if( copy_from_user( &stMap, (void __user*)ioctl_param, sizeof(stMap) ) )
+         {
+            return -EFAULT;
+         }
+         for( i = 0; i < TRACE_MAX_PINS; i++ )
+         {
+            if( (TRACE_NO_OUTPUT != stMap.aucOutput[i]) &&
+                ((IOPIN_NUM_PINS <= stMap.aucOutput[i]) || (NULL == g_apstPinDevices[stMap.aucOutput[i]])) )
+            {
+               return -EINVAL;
+            }
+         }
+         
+         // The outputs of the records queued were checked against the current map
+         spin_lock_irqsave( &g_stTraceLock, ulFlags );
+         if( g_uiPlayCount )
+         {
+            spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+            return -EBUSY;
+         }
+         memcpy( g_aucOutput, stMap.aucOutput, sizeof(g_aucOutput) );
+         spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+         break;
+      }
+      
+      case IOCTL_TRACE_STOP:
+      {
+         StopPlay();
+         break;
+      }
+      
+      case IOCTL_TRACE_STATUS:
+      {
+         spin_lock_irqsave( &g_stTraceLock, ulFlags );
+         stStatus = g_stTraceStatus;
+         stStatus.uiRecordPending = g_uiRecordCount;
+         stStatus.uiPlayPending = g_uiPlayCount;
+         spin_unlock_irqrestore( &g_stTraceLock, ulFlags );
+         
+         if( copy_to_user( (void __user*)ioctl_param, &stStatus, sizeof(stStatus) ) )
+         {
+            return -EFAULT;
+         }
+         break;
+      }
+      
+      case IOCTL_GET_EXPORTED_MASK:
+      {
+         return IOPinGetExportedMask( ioctl_param );
+      }
+      
+      default:
+      {
+         printk( KERN_WARNING "[IOPin] Unkown ioctl %u\n", ioctl_num );
+         return -EINVAL;
+      }
+   }
+   
+   return 0;
+}
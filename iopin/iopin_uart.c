@@ -0,0 +1,663 @@
+/*
+ *  iopin_uart.c - Software UART
+ *
+ *  The transmitter is an hrtimer that only fires on the transitions of the frame, so a byte
+ *  costs one timer interrupt per change of level instead of one per bit. The receiver takes the
+ *  falling edge of the start bit in the interrupt handler, masks the detection and samples the
+ *  middle of the data bits and of the stop bit with an hrtimer timed from that edge.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/uio.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin.h"
+
+#define  UART_FIFO_SIZE       1024
+#define  UART_CHUNK           64       // Bytes copied from/to userspace at a time
+#define  UART_DATA_BITS       8
+
+struct SIOPinUart
+{
+   spinlock_t           lock;
+   int                  iBound;
+   struct SIOPinDev*    pstDev;              // Its read() and write() go to the FIFOs
+   long                 lRxPin;              // -1 = none
+   long                 lTxPin;              // -1 = none
+   uint32_t             auiPinMask[2];       // RX and TX pins, claimed while bound
+   uint32_t             uiBaud;
+   unsigned int         uiFrameBits;         // Start, data and stop bits
+   struct SIOPinUartStats stStats;
+   struct hrtimer       stRxTimer;
+   int                  iRxActive;           // From the start bit to the stop bit
+   u64                  ullRxStart;          // Falling edge of the start bit
+   unsigned int         uiRxBit;             // Next bit to sample, 1 = first data bit
+   unsigned int         uiRxShift;
+   uint8_t              aucRx[UART_FIFO_SIZE];
+   unsigned int         uiRxHead;
+   unsigned int         uiRxCount;
+   struct hrtimer       stTxTimer;
+   int                  iTxActive;
+   u64                  ullTxStart;          // Start of the frame on the pin
+   unsigned int         uiTxBit;             // Bit of the frame on the pin
+   unsigned int         uiTxFrame;           // Start bit first, then the data and the stop bits
+   uint8_t              aucTx[UART_FIFO_SIZE];
+   unsigned int         uiTxHead;
+   unsigned int         uiTxCount;
+};
+
+//------[ Global variables ]------
+static struct SIOPinUart g_astUarts[UART_MAX_PORTS];
+static DEFINE_MUTEX( g_stUartMutex );     // Bind and unbind
+
+// Time from the start of the frame to a number of half bits (odd numbers are the middle of a bit)
+static u64 HalfBits( struct SIOPinUart* pstUart, unsigned int uiHalfBits )
+{
+   return div_u64( (u64)uiHalfBits * NSEC_PER_SEC, 2 * pstUart->uiBaud );
+}
+
+static void WritePin( long lPin, int iLevel )
+{
+   if( iLevel )
+   {
+      iowrite32( 1U << (lPin % 32), &g_pstGpioRegisters->GPSET[lPin / 32] );
+   }
+   else
+   {
+      iowrite32( 1U << (lPin % 32), &g_pstGpioRegisters->GPCLR[lPin / 32] );
+   }
+}
+
+// Waits for the next start bit. Whatever was latched before is from the previous frame
+static void ArmStartBit( struct SIOPinUart* pstUart )
+{
+   iowrite32( 1U << (pstUart->lRxPin % 32), &g_pstGpioRegisters->GPEDS[pstUart->lRxPin / 32] );
+   IOPinWriteBit( g_pstGpioRegisters->GPFEN, pstUart->lRxPin, 1 );
+}
+
+static int IsPort( struct SIOPinUart* pstUart, struct SIOPinDev* dev )
+{
+   return pstUart->iBound && (pstUart->pstDev == dev);
+}
+
+static int HasRx( struct SIOPinUart* pstUart, struct SIOPinDev* dev )
+{
+   return !IsPort( pstUart, dev ) || pstUart->uiRxCount;
+}
+
+// Writers sleep until half of the transmit FIFO is free instead of waking for every frame sent
+static int HasTxRoom( struct SIOPinUart* pstUart, struct SIOPinDev* dev )
+{
+   return !IsPort( pstUart, dev ) || ((UART_FIFO_SIZE / 2) >= pstUart->uiTxCount);
+}
+
+static enum hrtimer_restart RxTimerHandler( struct hrtimer* pstTimer )
+{
+   struct SIOPinUart* pstUart = container_of( pstTimer, struct SIOPinUart, stRxTimer );
+   unsigned long ulFlags;
+   u64 ullSample;
+   u64 ullNow;
+   int iLevel;
+   int iWake = 0;
+   
+   iLevel = !!(ioread32( &g_pstGpioRegisters->GPLEV[pstUart->lRxPin / 32] ) & (1U << (pstUart->lRxPin % 32)));
+   ullNow = ktime_get_ns();
+   
+   spin_lock_irqsave( &pstUart->lock, ulFlags );
+   
+   if( !pstUart->iBound || !pstUart->iRxActive )
+   {
+      spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+      return HRTIMER_NORESTART;
+   }
+   
+   ullSample = pstUart->ullRxStart + HalfBits( pstUart, 2 * pstUart->uiRxBit + 1 );
+   if( ullNow > (ullSample + HalfBits( pstUart, 1 )) )
+   {  // The sample was taken in a later bit
+      pstUart->stStats.uiLateSamples++;
+   }
+   else if( UART_DATA_BITS >= pstUart->uiRxBit )
+   {
+      pstUart->uiRxShift |= iLevel << (pstUart->uiRxBit - 1);
+      pstUart->uiRxBit++;
+      hrtimer_set_expires( pstTimer, ns_to_ktime( pstUart->ullRxStart + HalfBits( pstUart, 2 * pstUart->uiRxBit + 1 ) ) );
+      
+      spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+      return HRTIMER_RESTART;
+   }
+   else if( !iLevel )
+   {
+      pstUart->stStats.uiFramingErrors++;
+   }
+   else if( UART_FIFO_SIZE == pstUart->uiRxCount )
+   {
+      pstUart->stStats.uiOverruns++;
+   }
+   else
+   {
+      pstUart->aucRx[(pstUart->uiRxHead + pstUart->uiRxCount) % UART_FIFO_SIZE] = pstUart->uiRxShift;
+      pstUart->uiRxCount++;
+      pstUart->stStats.ullRxBytes++;
+      iWake = 1;
+   }
+   
+   // Done with this frame, in the middle of its stop bit
+   pstUart->iRxActive = 0;
+   ArmStartBit( pstUart );
+   
+   spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+   
+   if( iWake )
+   {
+      wake_up_interruptible( &pstUart->pstDev->irq_wait );
+   }
+   
+   return HRTIMER_NORESTART;
+}
+
+static int TxLevel( struct SIOPinUart* pstUart, unsigned int uiBit )
+{
+   return (pstUart->uiTxFrame >> uiBit) & 1;
+}
+
+static enum hrtimer_restart TxTimerHandler( struct hrtimer* pstTimer )
+{
+   struct SIOPinUart* pstUart = container_of( pstTimer, struct SIOPinUart, stTxTimer );
+   unsigned long ulFlags;
+   u64 ullNow;
+   int iWake = 0;
+   
+   spin_lock_irqsave( &pstUart->lock, ulFlags );
+   
+   if( !pstUart->iBound )
+   {
+      pstUart->iTxActive = 0;
+      spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+      return HRTIMER_NORESTART;
+   }
+   
+   if( pstUart->uiTxBit >= pstUart->uiFrameBits )
+   {  // End of the frame: the start bit of the next one, if any
+      if( 0 == pstUart->uiTxCount )
+      {
+         pstUart->iTxActive = 0;
+         spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+         return HRTIMER_NORESTART;
+      }
+      
+      pstUart->uiTxFrame = (pstUart->aucTx[pstUart->uiTxHead] << 1) | (~0U << (UART_DATA_BITS + 1));
+      pstUart->uiTxHead = (pstUart->uiTxHead + 1) % UART_FIFO_SIZE;
+      pstUart->uiTxCount--;
+      pstUart->stStats.ullTxBytes++;
+      pstUart->uiTxBit = 0;
+      iWake = ((UART_FIFO_SIZE / 2) == pstUart->uiTxCount);
+      
+      // A late timer delays the whole frame instead of shortening its start bit
+      pstUart->ullTxStart = ktime_to_ns( hrtimer_get_expires( pstTimer ) );
+      ullNow = ktime_get_ns();
+      if( ullNow > (pstUart->ullTxStart + HalfBits( pstUart, 1 )) )
+      {
+         pstUart->ullTxStart = ullNow;
+      }
+   }
+   
+   WritePin( pstUart->lTxPin, TxLevel( pstUart, pstUart->uiTxBit ) );
+   
+   // Nothing to do until the level changes or the frame ends
+   do
+   {
+      pstUart->uiTxBit++;
+   }
+   while( (pstUart->uiTxBit < pstUart->uiFrameBits) && (TxLevel( pstUart, pstUart->uiTxBit ) == TxLevel( pstUart, pstUart->uiTxBit - 1 )) );
+   
+   hrtimer_set_expires( pstTimer, ns_to_ktime( pstUart->ullTxStart + HalfBits( pstUart, 2 * pstUart->uiTxBit ) ) );
+   
+   spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+   
+   if( iWake )
+   {
+      wake_up_interruptible( &pstUart->pstDev->irq_wait );
+   }
+   
+   return HRTIMER_RESTART;
+}
+
+// Called with pstUart->lock held
+static void StartTx( struct SIOPinUart* pstUart )
+{
+   if( !pstUart->iTxActive && pstUart->uiTxCount )
+   {
+      pstUart->iTxActive = 1;
+      pstUart->uiTxBit = pstUart->uiFrameBits;
+      hrtimer_start( &pstUart->stTxTimer, ns_to_ktime( ktime_get_ns() ), HRTIMER_MODE_ABS );
+   }
+}
+
+static int IsExported( long lPin )
+{
+   return (0 <= lPin) && (IOPIN_NUM_PINS > lPin) && (NULL != g_apstPinDevices[lPin]);
+}
+
+// Called with g_stUartMutex held
+static void Unbind( struct SIOPinUart* pstUart )
+{
+   struct SIOPinDev* dev = pstUart->pstDev;
+   unsigned long ulFlags;
+   
+   spin_lock_irqsave( &pstUart->lock, ulFlags );
+   pstUart->iBound = 0;
+   pstUart->iRxActive = 0;
+   spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+   
+   hrtimer_cancel( &pstUart->stRxTimer );
+   hrtimer_cancel( &pstUart->stTxTimer );
+   pstUart->iTxActive = 0;
+   
+   if( 0 <= pstUart->lRxPin )
+   {
+      IOPinWriteBit( g_pstGpioRegisters->GPFEN, pstUart->lRxPin, 0 );
+   }
+   if( 0 <= pstUart->lTxPin )
+   {  // Idle
+      WritePin( pstUart->lTxPin, 1 );
+   }
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   dev->pstUart = NULL;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   IOPinReleasePins( pstUart->auiPinMask );
+   
+   // Readers and writers still waiting on the port
+   wake_up_interruptible( &dev->irq_wait );
+}
+
+static long Bind( struct SIOPinDev* dev, const struct SIOPinUartConfig* pstConfig )
+{
+   struct SIOPinUart* pstUart = NULL;
+   uint32_t auiPinMask[2] = { 0, 0 };
+   long lRxPin = dev->ulPin;
+   long lTxPin = pstConfig->iTxPin;
+   unsigned long ulFlags;
+   unsigned int i;
+   long lRet;
+   
+   if( pstConfig->uiFlags & UART_TX_ONLY )
+   {
+      lRxPin = -1;
+      lTxPin = dev->ulPin;
+   }
+   
+   if( (UART_MIN_BAUD > pstConfig->uiBaud) || (UART_MAX_BAUD < pstConfig->uiBaud) ||
+       (pstConfig->uiFlags & ~(UART_TWO_STOP_BITS | UART_TX_ONLY)) ||
+       ((-1 != lTxPin) && (!IsExported( lTxPin ) || (lTxPin == lRxPin))) )
+   {
+      return -EINVAL;
+   }
+   
+   if( 0 <= lRxPin )
+   {
+      auiPinMask[lRxPin / 32] |= 1U << (lRxPin % 32);
+   }
+   if( 0 <= lTxPin )
+   {
+      auiPinMask[lTxPin / 32] |= 1U << (lTxPin % 32);
+   }
+   
+   mutex_lock( &g_stUartMutex );
+   
+   // The receiver needs the falling edge detection of the pin for itself
+   if( dev->pstUart || dev->pstMatrix || ((0 <= lRxPin) && (dev->ulInterruption || dev->pstCapture)) )
+   {
+      mutex_unlock( &g_stUartMutex );
+      return -EBUSY;
+   }
+   
+   for( i = 0; (i < UART_MAX_PORTS) && (NULL == pstUart); i++ )
+   {
+      if( !g_astUarts[i].iBound )
+      {
+         pstUart = &g_astUarts[i];
+      }
+   }
+   if( NULL == pstUart )
+   {
+      mutex_unlock( &g_stUartMutex );
+      return -ENOSPC;
+   }
+   
+   lRet = IOPinClaimPins( auiPinMask );
+   if( lRet )
+   {
+      mutex_unlock( &g_stUartMutex );
+      return lRet;
+   }
+   
+   spin_lock_irqsave( &pstUart->lock, ulFlags );
+   pstUart->pstDev = dev;
+   pstUart->lRxPin = lRxPin;
+   pstUart->lTxPin = lTxPin;
+   pstUart->auiPinMask[0] = auiPinMask[0];
+   pstUart->auiPinMask[1] = auiPinMask[1];
+   pstUart->uiBaud = pstConfig->uiBaud;
+   pstUart->uiFrameBits = 1 + UART_DATA_BITS + ((pstConfig->uiFlags & UART_TWO_STOP_BITS)? 2: 1);
+   memset( &pstUart->stStats, 0, sizeof(pstUart->stStats) );
+   pstUart->iRxActive = 0;
+   pstUart->uiRxHead = 0;
+   pstUart->uiRxCount = 0;
+   pstUart->iTxActive = 0;
+   pstUart->uiTxHead = 0;
+   pstUart->uiTxCount = 0;
+   pstUart->iBound = 1;
+   spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+   
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   dev->pstUart = pstUart;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+   
+   // Idle high before it becomes an output, so the other end doesn't see a start bit
+   if( 0 <= lTxPin )
+   {
+      WritePin( lTxPin, 1 );
+      IOPinSetFunction( lTxPin, PIN_FUNCTION_OUTPUT );
+   }
+   if( 0 <= lRxPin )
+   {
+      IOPinSetFunction( lRxPin, PIN_FUNCTION_INPUT );
+      ArmStartBit( pstUart );
+   }
+   
+   mutex_unlock( &g_stUartMutex );
+   
+   return 0;
+}
+
+// Called by the interrupt handler for every edge. True when it is the start bit of a receiver
+int IOPinUartEdge( struct SIOPinDev* dev, u64 ullTimestamp )
+{
+   struct SIOPinUart* pstUart = dev->pstUart;
+   unsigned long ulFlags;
+   
+   if( (NULL == pstUart) || (pstUart->lRxPin != dev->ulPin) )
+   {
+      return 0;
+   }
+   
+   spin_lock_irqsave( &pstUart->lock, ulFlags );
+   if( pstUart->iBound && !pstUart->iRxActive )
+   {
+      // The rest of the frame is sampled, its edges don't need to interrupt
+      IOPinWriteBit( g_pstGpioRegisters->GPFEN, pstUart->lRxPin, 0 );
+      pstUart->iRxActive = 1;
+      pstUart->ullRxStart = ullTimestamp;
+      pstUart->uiRxBit = 1;
+      pstUart->uiRxShift = 0;
+      hrtimer_start( &pstUart->stRxTimer, ns_to_ktime( ullTimestamp + HalfBits( pstUart, 3 ) ), HRTIMER_MODE_ABS );
+   }
+   spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+   
+   return 1;
+}
+
+ssize_t IOPinUartRead( struct SIOPinDev* dev, struct kiocb* iocb, struct iov_iter* to )
+{
+   struct SIOPinUart* pstUart = dev->pstUart;
+   uint8_t aucChunk[UART_CHUNK];
+   unsigned long ulFlags;
+   ssize_t iTotal = 0;
+   size_t szCount;
+   size_t i;
+   
+   if( (NULL == pstUart) || (0 > pstUart->lRxPin) )
+   {
+      return -EINVAL;
+   }
+   
+   while( iov_iter_count( to ) )
+   {
+      spin_lock_irqsave( &pstUart->lock, ulFlags );
+      if( !IsPort( pstUart, dev ) )
+      {
+         spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+         return iTotal? iTotal: -ENODEV;
+      }
+      szCount = min_t( size_t, iov_iter_count( to ), min_t( size_t, UART_CHUNK, pstUart->uiRxCount ) );
+      for( i = 0; i < szCount; i++ )
+      {
+         aucChunk[i] = pstUart->aucRx[pstUart->uiRxHead];
+         pstUart->uiRxHead = (pstUart->uiRxHead + 1) % UART_FIFO_SIZE;
+      }
+      pstUart->uiRxCount -= szCount;
+      spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+      
+      if( 0 == szCount )
+      {  // Only waits for the first byte
+         if( iTotal )
+         {
+            break;
+         }
+         if( (iocb->ki_filp->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT) )
+         {
+            return -EAGAIN;
+         }
+         if( wait_event_interruptible( dev->irq_wait, HasRx( pstUart, dev ) ) )
+         {
+            return -ERESTARTSYS;
+         }
+         continue;
+      }
+      
+      if( szCount != copy_to_iter( aucChunk, szCount, to ) )
+      {
+         return iTotal? iTotal: -EFAULT;
+      }
+      iTotal += szCount;
+   }
+   
+   return iTotal;
+}
+
+ssize_t IOPinUartWrite( struct SIOPinDev* dev, struct file* filp, const char __user* buf, size_t count )
+{
+   struct SIOPinUart* pstUart = dev->pstUart;
+   uint8_t aucChunk[UART_CHUNK];
+   unsigned long ulFlags;
+   ssize_t iTotal = 0;
+   size_t szChunk;
+   size_t szCount;
+   size_t i;
+   
+   if( (NULL == pstUart) || (0 > pstUart->lTxPin) )
+   {
+      return -EINVAL;
+   }
+   
+   while( (size_t)iTotal < count )
+   {
+      szChunk = min_t( size_t, count - iTotal, UART_CHUNK );
+      if( copy_from_user( aucChunk, buf + iTotal, szChunk ) )
+      {
+         return iTotal? iTotal: -EFAULT;
+      }
+      
+      spin_lock_irqsave( &pstUart->lock, ulFlags );
+      if( !IsPort( pstUart, dev ) )
+      {
+         spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+         return iTotal? iTotal: -ENODEV;
+      }
+      szCount = min_t( size_t, szChunk, UART_FIFO_SIZE - pstUart->uiTxCount );
+      for( i = 0; i < szCount; i++ )
+      {
+         pstUart->aucTx[(pstUart->uiTxHead + pstUart->uiTxCount) % UART_FIFO_SIZE] = aucChunk[i];
+         pstUart->uiTxCount++;
+      }
+      StartTx( pstUart );
+      spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+      
+      iTotal += szCount;
+      if( szCount < szChunk )
+      {  // The FIFO is full
+         if( filp->f_flags & O_NONBLOCK )
+         {
+            return iTotal? iTotal: -EAGAIN;
+         }
+         if( wait_event_interruptible( dev->irq_wait, HasTxRoom( pstUart, dev ) ) )
+         {
+            return iTotal? iTotal: -ERESTARTSYS;
+         }
+      }
+   }
+   
+   return iTotal;
+}
+
+unsigned int IOPinUartPoll( struct SIOPinDev* dev )
+{
+   struct SIOPinUart* pstUart = dev->pstUart;
+   unsigned int mask = 0;
+   unsigned long ulFlags;
+   
+   if( NULL == pstUart )
+   {
+      return 0;
+   }
+   
+   spin_lock_irqsave( &pstUart->lock, ulFlags );
+   if( IsPort( pstUart, dev ) )
+   {
+      if( pstUart->uiRxCount )
+      {
+         mask |= (POLLIN | POLLRDNORM);
+      }
+      if( (0 <= pstUart->lTxPin) && HasTxRoom( pstUart, dev ) )
+      {
+         mask |= (POLLOUT | POLLWRNORM);
+      }
+   }
+   spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+   
+   return mask;
+}
+
+void IOPinUartInit( void )
+{
+   unsigned int i;
+   
+   for( i = 0; i < UART_MAX_PORTS; i++ )
+   {
+      spin_lock_init( &g_astUarts[i].lock );
+      hrtimer_init( &g_astUarts[i].stRxTimer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS );
+      g_astUarts[i].stRxTimer.function = RxTimerHandler;
+      hrtimer_init( &g_astUarts[i].stTxTimer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS );
+      g_astUarts[i].stTxTimer.function = TxTimerHandler;
+   }
+}
+
+void IOPinUartExit( void )
+{
+   unsigned int i;
+   
+   mutex_lock( &g_stUartMutex );
+   for( i = 0; i < UART_MAX_PORTS; i++ )
+   {
+      if( g_astUarts[i].iBound )
+      {
+         Unbind( &g_astUarts[i] );
+      }
+   }
+   mutex_unlock( &g_stUartMutex );
+}
+
+// Unbinds the port of the device
+void IOPinUartRelease( struct SIOPinDev* dev )
+{
+   mutex_lock( &g_stUartMutex );
+   if( dev->pstUart )
+   {
+      Unbind( dev->pstUart );
+   }
+   mutex_unlock( &g_stUartMutex );
+}
+
+long IOPinUartIoctl( struct SIOPinDev* dev, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   struct SIOPinUartConfig stConfig;
+   struct SIOPinUartStats stStats;
+   struct SIOPinUart* pstUart;
+   unsigned long ulFlags;
+   
+   switch( ioctl_num )
+   {
+      case IOCTL_UART_BIND:
+      {
+         if( copy_from_user( &stConfig, (void __user*)ioctl_param, sizeof(stConfig) ) )
+         {
+            return -EFAULT;
+         }
+         
+         return Bind( dev, &stConfig );
+      }
+      
+      case IOCTL_UART_UNBIND:
+      {
+         mutex_lock( &g_stUartMutex );
+         if( NULL == dev->pstUart )
+         {
+            mutex_unlock( &g_stUartMutex );
+            return -ENODEV;
+         }
+         Unbind( dev->pstUart );
+         mutex_unlock( &g_stUartMutex );
+         break;
+      }
+      
+      case IOCTL_UART_STATS:
+      {
+         pstUart = dev->pstUart;
+         if( NULL == pstUart )
+         {
+            return -ENODEV;
+         }
+         
+         spin_lock_irqsave( &pstUart->lock, ulFlags );
+         if( !IsPort( pstUart, dev ) )
+         {
+            spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+            return -ENODEV;
+         }
+         stStats = pstUart->stStats;
+         stStats.uiRxPending = pstUart->uiRxCount;
+         stStats.uiTxPending = pstUart->uiTxCount;
+         spin_unlock_irqrestore( &pstUart->lock, ulFlags );
+         
+         if( copy_to_user( (void __user*)ioctl_param, &stStats, sizeof(stStats) ) )
+         {
+            return -EFAULT;
+         }
+         break;
+      }
+      
+      default:
+      {
+         return -EINVAL;
+      }
+   }
+   
+   return 0;
+}
@@ -0,0 +1,575 @@
+/*
+ * Non-interactive benchmark of the iopin devices. Prints the results as JSON on stdout
+ *
+ * Needs two exported pins wired together: the output pin drives the input pin, so the latency
+ * from the edge (write on the output) to the poll() wakeup and to the read() of the input can be
+ * measured. With -s the devices are simulated (the loopback is done in memory), to check the tool
+ * without a board.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <sys/utsname.h>
+#include "iopin_ioctl.h"
+
+#define  EDGE_TIMEOUT_MS      1000        // An edge not seen by then is counted as lost
+#define  SIM_MAX_PINS         64
+
+//------[ Backends ]------
+struct SBackend
+{
+   const char* szName;
+   int (*pfnOpen)( unsigned int uiPin );
+   void (*pfnClose)( int iHandle );
+   int (*pfnWrite)( int iHandle, char chValue );
+   int (*pfnRead)( int iHandle, char* pchValue );
+   int (*pfnIoctl)( int iHandle, unsigned long ulRequest, unsigned long ulParam );
+   int (*pfnPollFd)( int iHandle );          // Descriptor that becomes readable on an event
+};
+
+static const char* g_szDevicePrefix = "/dev/iopin";
+
+static int DevOpen( unsigned int uiPin )
+{
+   char szDevice[64];
+   
+   snprintf( szDevice, sizeof(szDevice), "%s%u", g_szDevicePrefix, uiPin );
+   return open( szDevice, O_RDWR );
+}
+
+static void DevClose( int iHandle )
+{
+   close( iHandle );
+}
+
+static int DevWrite( int iHandle, char chValue )
+{
+   return write( iHandle, &chValue, 1 );
+}
+
+static int DevRead( int iHandle, char* pchValue )
+{
+   return read( iHandle, pchValue, 1 );
+}
+
+static int DevIoctl( int iHandle, unsigned long ulRequest, unsigned long ulParam )
+{
+   return ioctl( iHandle, ulRequest, ulParam );
+}
+
+static int DevPollFd( int iHandle )
+{
+   return iHandle;
+}
+
+static const struct SBackend g_stDeviceBackend = { "device", DevOpen, DevClose, DevWrite, DevRead, DevIoctl, DevPollFd };
+
+// Simulated devices: the handle is the pin, the levels of the loopback pair follow each other and
+// an eventfd plays the part of irq_flag
+struct SSimPin
+{
+   int            iEventFd;
+   int            iLevel;
+   unsigned long  ulFunction;
+   unsigned long  ulInterruption;
+   int            iPeer;                  // Pin wired to this one (-1 = none)
+};
+
+static struct SSimPin g_astSimPins[SIM_MAX_PINS];
+
+static void SimConnect( unsigned int uiPinA, unsigned int uiPinB )
+{
+   unsigned int i;
+   
+   for( i = 0; i < SIM_MAX_PINS; i++ )
+   {
+      g_astSimPins[i].iEventFd = -1;
+      g_astSimPins[i].iPeer = -1;
+   }
+   g_astSimPins[uiPinA].iPeer = uiPinB;
+   g_astSimPins[uiPinB].iPeer = uiPinA;
+}
+
+static int SimOpen( unsigned int uiPin )
+{
+   if( SIM_MAX_PINS <= uiPin )
+   {
+      errno = ENODEV;
+      return -1;
+   }
+   
+   g_astSimPins[uiPin].iEventFd = eventfd( 0, EFD_NONBLOCK );
+   if( 0 > g_astSimPins[uiPin].iEventFd )
+   {
+      return -1;
+   }
+   
+   return uiPin;
+}
+
+static void SimClose( int iHandle )
+{
+   close( g_astSimPins[iHandle].iEventFd );
+   g_astSimPins[iHandle].iEventFd = -1;
+}
+
+static void SimSetLevel( int iPin, int iLevel )
+{
+   struct SSimPin* pstPin = &g_astSimPins[iPin];
+   int iEvent;
+   
+   iEvent = ((pstPin->ulInterruption & PIN_INTERRUPTION_RISING) && !pstPin->iLevel && iLevel) ||
+            ((pstPin->ulInterruption & PIN_INTERRUPTION_FALLING) && pstPin->iLevel && !iLevel);
+   pstPin->iLevel = iLevel;
+   
+   if( iEvent && (0 <= pstPin->iEventFd) )
+   {
+      eventfd_write( pstPin->iEventFd, 1 );
+   }
+}
+
+static int SimWrite( int iHandle, char chValue )
+{
+   if( PIN_FUNCTION_OUTPUT != g_astSimPins[iHandle].ulFunction )
+   {
+      errno = EPERM;
+      return -1;
+   }
+   
+   SimSetLevel( iHandle, '1' == chValue );
+   if( 0 <= g_astSimPins[iHandle].iPeer )
+   {
+      SimSetLevel( g_astSimPins[iHandle].iPeer, '1' == chValue );
+   }
+   
+   return 1;
+}
+
+static int SimRead( int iHandle, char* pchValue )
+{
+   eventfd_t ullCount;
+   
+   eventfd_read( g_astSimPins[iHandle].iEventFd, &ullCount );     // Acknowledge the event
+   *pchValue = g_astSimPins[iHandle].iLevel? '1': '0';
+   
+   return 1;
+}
+
+static int SimIoctl( int iHandle, unsigned long ulRequest, unsigned long ulParam )
+{
+   switch( ulRequest )
+   {
+      case IOCTL_SET_FUNCTION:
+         g_astSimPins[iHandle].ulFunction = ulParam;
+         return 0;
+      
+      case IOCTL_SET_INTERRUPTION:
+         g_astSimPins[iHandle].ulInterruption = ulParam;
+         return 0;
+      
+      case IOCTL_SET_PULL:
+         return 0;
+      
+      case IOCTL_GET_STATS:
+         memset( (void*)ulParam, 0, sizeof(struct SIOPinStats) );
+         return 0;
+   }
+   
+   errno = EINVAL;
+   return -1;
+}
+
+static int SimPollFd( int iHandle )
+{
+   return g_astSimPins[iHandle].iEventFd;
+}
+
+static const struct SBackend g_stSimBackend = { "simulated", SimOpen, SimClose, SimWrite, SimRead, SimIoctl, SimPollFd };
+
+//------[ Measurement ]------
+struct SLatency
+{
+   uint64_t*      pullSamples;
+   unsigned int   uiCount;
+   unsigned int   uiLost;
+};
+
+struct SEdgeRun
+{
+   const struct SBackend*  pstBackend;
+   int                     iInput;
+   atomic_int              iState;
+   uint64_t                ullWakeup;
+   uint64_t                ullRead;
+   int                     iTimedOut;
+};
+
+#define  EDGE_IDLE      0
+#define  EDGE_ARMED     1        // Waiter should poll
+#define  EDGE_WAITING   2        // Waiter is (about to be) blocked in poll
+#define  EDGE_DONE      3
+#define  EDGE_QUIT      4
+
+static atomic_int g_iStopLoad;
+
+static uint64_t Now( void )
+{
+   struct timespec stNow;
+   
+   clock_gettime( CLOCK_MONOTONIC, &stNow );
+   return (stNow.tv_sec * 1000000000ULL) + stNow.tv_nsec;
+}
+
+static int CompareSamples( const void* pvA, const void* pvB )
+{
+   uint64_t ullA = *(const uint64_t*)pvA;
+   uint64_t ullB = *(const uint64_t*)pvB;
+   
+   return (ullA > ullB) - (ullA < ullB);
+}
+
+static void PrintDistribution( const char* szName, struct SLatency* pstLatency, const char* szSuffix )
+{
+   uint64_t ullSum = 0;
+   unsigned int uiCount = pstLatency->uiCount;
+   unsigned int i;
+   
+   printf( "    \"%s\": { \"samples\": %u, \"lost\": %u", szName, uiCount, pstLatency->uiLost );
+   if( uiCount )
+   {
+      qsort( pstLatency->pullSamples, uiCount, sizeof(uint64_t), CompareSamples );
+      for( i = 0; i < uiCount; i++ )
+      {
+         ullSum += pstLatency->pullSamples[i];
+      }
+      
+      printf( ", \"min\": %llu, \"mean\": %llu, \"p50\": %llu, \"p99\": %llu, \"p99.9\": %llu, \"max\": %llu",
+              (unsigned long long)pstLatency->pullSamples[0], (unsigned long long)(ullSum / uiCount),
+              (unsigned long long)pstLatency->pullSamples[(uiCount * 50ULL) / 100],
+              (unsigned long long)pstLatency->pullSamples[(uiCount * 99ULL) / 100],
+              (unsigned long long)pstLatency->pullSamples[(uiCount * 999ULL) / 1000],
+              (unsigned long long)pstLatency->pullSamples[uiCount - 1] );
+   }
+   printf( " }%s\n", szSuffix );
+}
+
+static void* LoadThread( void* pvArg )
+{
+   volatile uint64_t ullCounter = 0;
+   
+   while( !atomic_load( &g_iStopLoad ) )
+   {
+      ullCounter++;
+   }
+   
+   return NULL;
+}
+
+static void* EdgeWaiter( void* pvArg )
+{
+   struct SEdgeRun* pstRun = (struct SEdgeRun*)pvArg;
+   struct pollfd stPoll;
+   char chValue;
+   int iState;
+   
+   for( ;; )
+   {
+      while( EDGE_ARMED != (iState = atomic_load( &pstRun->iState )) )
+      {
+         if( EDGE_QUIT == iState )
+         {
+            return NULL;
+         }
+         sched_yield();
+      }
+      
+      stPoll.fd = pstRun->pstBackend->pfnPollFd( pstRun->iInput );
+      stPoll.events = POLLIN | POLLPRI;
+      atomic_store( &pstRun->iState, EDGE_WAITING );
+      
+      pstRun->iTimedOut = (1 != poll( &stPoll, 1, EDGE_TIMEOUT_MS ));
+      pstRun->ullWakeup = Now();
+      pstRun->pstBackend->pfnRead( pstRun->iInput, &chValue );
+      pstRun->ullRead = Now();
+      
+      atomic_store( &pstRun->iState, EDGE_DONE );
+   }
+}
+
+// Toggle rate: every write is a change of the output
+static double MeasureWrites( const struct SBackend* pstBackend, int iOutput, unsigned int uiIterations )
+{
+   uint64_t ullStart;
+   unsigned int i;
+   
+   ullStart = Now();
+   for( i = 0; i < uiIterations; i++ )
+   {
+      pstBackend->pfnWrite( iOutput, (i & 1)? '0': '1' );
+   }
+   
+   return (uiIterations * 1e9) / (Now() - ullStart);
+}
+
+static double MeasureReads( const struct SBackend* pstBackend, int iInput, unsigned int uiIterations )
+{
+   uint64_t ullStart;
+   unsigned int i;
+   char chValue;
+   
+   ullStart = Now();
+   for( i = 0; i < uiIterations; i++ )
+   {
+      pstBackend->pfnRead( iInput, &chValue );
+   }
+   
+   return (uiIterations * 1e9) / (Now() - ullStart);
+}
+
+static void MeasureIoctl( const struct SBackend* pstBackend, int iInput, unsigned int uiIterations, struct SLatency* pstLatency )
+{
+   struct SIOPinStats stStats;
+   uint64_t ullStart;
+   unsigned int i;
+   
+   for( i = 0; i < uiIterations; i++ )
+   {
+      ullStart = Now();
+      if( 0 > pstBackend->pfnIoctl( iInput, IOCTL_GET_STATS, (unsigned long)&stStats ) )
+      {
+         pstLatency->uiLost++;
+         continue;
+      }
+      pstLatency->pullSamples[pstLatency->uiCount++] = Now() - ullStart;
+   }
+}
+
+// Rising edges on the output, seen by a thread blocked in poll() on the input
+static void MeasureEdges( const struct SBackend* pstBackend, int iOutput, int iInput, unsigned int uiIterations,
+                          struct SLatency* pstWakeup, struct SLatency* pstRead )
+{
+   struct SEdgeRun stRun;
+   pthread_t stWaiter;
+   uint64_t ullEdge;
+   char chValue;
+   unsigned int i;
+   
+   stRun.pstBackend = pstBackend;
+   stRun.iInput = iInput;
+   atomic_init( &stRun.iState, EDGE_IDLE );
+   pthread_create( &stWaiter, NULL, EdgeWaiter, &stRun );
+   
+   for( i = 0; i < uiIterations; i++ )
+   {
+      // Back to low (no event, only rising edges are enabled) and acknowledge anything pending
+      pstBackend->pfnWrite( iOutput, '0' );
+      usleep( 100 );
+      pstBackend->pfnRead( iInput, &chValue );
+      
+      atomic_store( &stRun.iState, EDGE_ARMED );
+      while( EDGE_WAITING != atomic_load( &stRun.iState ) )
+      {
+         sched_yield();
+      }
+      usleep( 200 );       // Let the waiter sleep in poll()
+      
+      ullEdge = Now();
+      pstBackend->pfnWrite( iOutput, '1' );
+      
+      while( EDGE_DONE != atomic_load( &stRun.iState ) )
+      {
+         sched_yield();
+      }
+      
+      if( stRun.iTimedOut )
+      {
+         pstWakeup->uiLost++;
+         pstRead->uiLost++;
+      }
+      else
+      {
+         pstWakeup->pullSamples[pstWakeup->uiCount++] = stRun.ullWakeup - ullEdge;
+         pstRead->pullSamples[pstRead->uiCount++] = stRun.ullRead - ullEdge;
+      }
+      atomic_store( &stRun.iState, EDGE_IDLE );
+   }
+   
+   atomic_store( &stRun.iState, EDGE_QUIT );
+   pthread_join( stWaiter, NULL );
+}
+
+static void AllocLatency( struct SLatency* pstLatency, unsigned int uiIterations )
+{
+   pstLatency->pullSamples = (uint64_t*)calloc( uiIterations, sizeof(uint64_t) );
+   pstLatency->uiCount = 0;
+   pstLatency->uiLost = 0;
+   if( NULL == pstLatency->pullSamples )
+   {
+      fprintf( stderr, "Out of memory\n" );
+      exit( -1 );
+   }
+}
+
+static void Usage( const char* szName )
+{
+   fprintf( stderr, "Use:\n" );
+   fprintf( stderr, "\t%s [-o <output-pin>] [-i <input-pin>] [-n <iterations>] [-e <edges>] [-l <load-threads>] [-d <device-prefix>] [-s]\n", szName );
+   fprintf( stderr, "\t-o/-i: loopback pair, the output pin wired to the input pin (default 17 -> 27)\n" );
+   fprintf( stderr, "\t-n: iterations of the rate and ioctl measurements (default 100000)\n" );
+   fprintf( stderr, "\t-e: edges of each latency measurement (default 10000)\n" );
+   fprintf( stderr, "\t-l: threads spinning during a second latency measurement (default 0 = no second run)\n" );
+   fprintf( stderr, "\t-d: prefix of the device names (default /dev/iopin)\n" );
+   fprintf( stderr, "\t-s: simulated devices instead of the driver\n" );
+}
+
+int main( int argc, char* argv[] )
+{
+   const struct SBackend* pstBackend = &g_stDeviceBackend;
+   unsigned int uiOutputPin = 17;
+   unsigned int uiInputPin = 27;
+   unsigned int uiIterations = 100000;
+   unsigned int uiEdges = 10000;
+   unsigned int uiLoadThreads = 0;
+   struct SLatency stIoctl, stWakeupIdle, stReadIdle, stWakeupLoaded, stReadLoaded;
+   pthread_t* pstLoad;
+   struct utsname stUname;
+   char szSrcVersion[64] = "";
+   double dWriteRate, dReadRate;
+   FILE* pstFile;
+   int iOutput, iInput;
+   unsigned int i;
+   int iOption;
+   
+   while( -1 != (iOption = getopt( argc, argv, "o:i:n:e:l:d:sh" )) )
+   {
+      switch( iOption )
+      {
+         case 'o': uiOutputPin = strtoul( optarg, NULL, 0 ); break;
+         case 'i': uiInputPin = strtoul( optarg, NULL, 0 ); break;
+         case 'n': uiIterations = strtoul( optarg, NULL, 0 ); break;
+         case 'e': uiEdges = strtoul( optarg, NULL, 0 ); break;
+         case 'l': uiLoadThreads = strtoul( optarg, NULL, 0 ); break;
+         case 'd': g_szDevicePrefix = optarg; break;
+         case 's': pstBackend = &g_stSimBackend; break;
+         default:
+            Usage( argv[0] );
+            return -1;
+      }
+   }
+   
+   if( (0 == uiIterations) || (0 == uiEdges) || (uiOutputPin == uiInputPin) )
+   {
+      Usage( argv[0] );
+      return -1;
+   }
+   
+   if( &g_stSimBackend == pstBackend )
+   {
+      if( (SIM_MAX_PINS <= uiOutputPin) || (SIM_MAX_PINS <= uiInputPin) )
+      {
+         fprintf( stderr, "Invalid pin\n" );
+         return -1;
+      }
+      SimConnect( uiOutputPin, uiInputPin );
+   }
+   
+   iOutput = pstBackend->pfnOpen( uiOutputPin );
+   iInput = pstBackend->pfnOpen( uiInputPin );
+   if( (0 > iOutput) || (0 > iInput) )
+   {
+      fprintf( stderr, "Error opening the devices: (%d) %s\n", errno, strerror(errno) );
+      return -1;
+   }
+   
+   if( (0 > pstBackend->pfnIoctl( iOutput, IOCTL_SET_FUNCTION, PIN_FUNCTION_OUTPUT )) ||
+       (0 > pstBackend->pfnIoctl( iInput, IOCTL_SET_FUNCTION, PIN_FUNCTION_INPUT )) ||
+       (0 > pstBackend->pfnIoctl( iInput, IOCTL_SET_PULL, PIN_PULL_OFF )) ||
+       (0 > pstBackend->pfnIoctl( iInput, IOCTL_SET_INTERRUPTION, PIN_INTERRUPTION_RISING )) )
+   {
+      fprintf( stderr, "Error configuring the pins: (%d) %s\n", errno, strerror(errno) );
+      return -1;
+   }
+   
+   AllocLatency( &stIoctl, uiIterations );
+   AllocLatency( &stWakeupIdle, uiEdges );
+   AllocLatency( &stReadIdle, uiEdges );
+   AllocLatency( &stWakeupLoaded, uiEdges );
+   AllocLatency( &stReadLoaded, uiEdges );
+   
+   dWriteRate = MeasureWrites( pstBackend, iOutput, uiIterations );
+   dReadRate = MeasureReads( pstBackend, iInput, uiIterations );
+   MeasureIoctl( pstBackend, iInput, uiIterations, &stIoctl );
+   MeasureEdges( pstBackend, iOutput, iInput, uiEdges, &stWakeupIdle, &stReadIdle );
+   
+   if( uiLoadThreads )
+   {
+      pstLoad = (pthread_t*)calloc( uiLoadThreads, sizeof(pthread_t) );
+      atomic_store( &g_iStopLoad, 0 );
+      for( i = 0; i < uiLoadThreads; i++ )
+      {
+         pthread_create( &pstLoad[i], NULL, LoadThread, NULL );
+      }
+      
+      MeasureEdges( pstBackend, iOutput, iInput, uiEdges, &stWakeupLoaded, &stReadLoaded );
+      
+      atomic_store( &g_iStopLoad, 1 );
+      for( i = 0; i < uiLoadThreads; i++ )
+      {
+         pthread_join( pstLoad[i], NULL );
+      }
+      free( pstLoad );
+   }
+   
+   pstBackend->pfnWrite( iOutput, '0' );
+   pstBackend->pfnClose( iOutput );
+   pstBackend->pfnClose( iInput );
+   
+   // Versions, to compare runs
+   uname( &stUname );
+   pstFile = fopen( "/sys/module/iopin/srcversion", "r" );
+   if( pstFile )
+   {
+      if( fgets( szSrcVersion, sizeof(szSrcVersion), pstFile ) )
+      {
+         szSrcVersion[strcspn( szSrcVersion, "\n" )] = '\0';
+      }
+      fclose( pstFile );
+   }
+   
+   printf( "{\n" );
+   printf( "  \"tool\": \"iopin-bench\",\n" );
+   printf( "  \"format\": 1,\n" );
+   printf( "  \"backend\": \"%s\",\n", pstBackend->szName );
+   printf( "  \"kernel\": \"%s\",\n", stUname.release );
+   printf( "  \"driver_srcversion\": \"%s\",\n", szSrcVersion );
+   printf( "  \"output_pin\": %u,\n", uiOutputPin );
+   printf( "  \"input_pin\": %u,\n", uiInputPin );
+   printf( "  \"iterations\": %u,\n", uiIterations );
+   printf( "  \"edges\": %u,\n", uiEdges );
+   printf( "  \"load_threads\": %u,\n", uiLoadThreads );
+   printf( "  \"write_toggle_rate_hz\": %.0f,\n", dWriteRate );
+   printf( "  \"read_rate_hz\": %.0f,\n", dReadRate );
+   printf( "  \"latency_ns\": {\n" );
+   PrintDistribution( "ioctl", &stIoctl, "," );
+   PrintDistribution( "edge_to_poll", &stWakeupIdle, "," );
+   PrintDistribution( "edge_to_read", &stReadIdle, uiLoadThreads? ",": "" );
+   if( uiLoadThreads )
+   {
+      PrintDistribution( "edge_to_poll_loaded", &stWakeupLoaded, "," );
+      PrintDistribution( "edge_to_read_loaded", &stReadLoaded, "" );
+   }
+   printf( "  }\n" );
+   printf( "}\n" );
+   
+   return (stWakeupIdle.uiLost || stWakeupLoaded.uiLost)? 1: 0;
+}
@@ -0,0 +1,53 @@
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+/*
+ * Shared by the checks of the driver code: the failure count and, for the checks that run
+ * against a simulated register block, the log of the writes to that block
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define  MAX_WRITES     16
+
+struct SWrite
+{
+   size_t   szOffset;                // From the start of the simulated block
+   uint32_t uiValue;
+};
+
+static int g_iFailures;
+static volatile void* g_pvRegisters;     // Simulated block the offsets of the log are taken from
+static struct SWrite g_astWrites[MAX_WRITES];
+static int g_iNumWrites;                 // Can be more than MAX_WRITES, only the first ones are kept
+
+static inline void Check( int iCondition, const char* szCase, const char* szWhat )
+{
+   if( !iCondition )
+   {
+      printf( "FAIL: %s: %s\n", szCase, szWhat );
+      g_iFailures++;
+   }
+}
+
+// Prints the summary line. Returns the exit code of the check
+static inline int CheckResult( const char* szName )
+{
+   printf( "%s check: %s\n", szName, g_iFailures? "FAILED": "OK" );
+   
+   return g_iFailures? -1: 0;
+}
+
+// Write hook of the simulated registers (g_pfnIOPinSocWriteHook)
+static inline void RecordWrite( volatile uint32_t* puiRegister, uint32_t uiValue )
+{
+   if( MAX_WRITES > g_iNumWrites )
+   {
+      g_astWrites[g_iNumWrites].szOffset = (volatile char*)puiRegister - (volatile char*)g_pvRegisters;
+      g_astWrites[g_iNumWrites].uiValue = uiValue;
+   }
+   g_iNumWrites++;
+}
+
+#endif
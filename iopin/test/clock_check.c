@@ -0,0 +1,164 @@
+/*
+ * Checks the GPCLK divisor math and register sequence against a simulated clock manager. Doesn't need the board
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "iopin_clock.h"
+#include "check.h"
+
+#define  OSC_FREQ       19200000
+#define  PLLD_FREQ      500000000
+
+static struct SClockManagerRegistersMap g_stRegisters;
+static int g_iStuck;                // The generator never stops
+
+// Records the write, and keeps the control registers busy while the generator is stuck
+static void StuckWrite( volatile uint32_t* puiRegister, uint32_t uiValue )
+{
+   size_t szOffset = (volatile char*)puiRegister - (volatile char*)&g_stRegisters;
+   
+   RecordWrite( puiRegister, uiValue );
+   
+   if( g_iStuck && (0 == ((szOffset - offsetof(struct SClockManagerRegistersMap, CM_GP0CTL)) % 8)) )
+   {
+      *puiRegister |= (1 << CM_BUSY);
+   }
+}
+
+static void CheckPin( unsigned long ulPin, int iClock, unsigned int uiFunction )
+{
+   unsigned int uiClock = 99;
+   unsigned int uiFound = 99;
+   int iRet = IOPinClockFindPin( ulPin, &uiClock, &uiFound );
+   
+   if( 0 > iClock )
+   {
+      Check( 0 != iRet, "pins", "pin without clock refused" );
+   }
+   else
+   {
+      Check( (0 == iRet) && ((unsigned int)iClock == uiClock) && (uiFunction == uiFound), "pins", "generator and function" );
+   }
+}
+
+static void CheckDivisor( uint32_t uiSource, uint32_t uiFrequency, uint32_t uiMash, int iValid, uint32_t uiDivI, uint32_t uiDivF )
+{
+   uint32_t uiGotDivI = 0;
+   uint32_t uiGotDivF = 0;
+   int iRet = IOPinClockDivisor( uiSource, uiFrequency, uiMash, &uiGotDivI, &uiGotDivF );
+   
+   Check( iValid == (0 == iRet), "divisor", "range" );
+   if( iValid && (0 == iRet) )
+   {
+      Check( (uiDivI == uiGotDivI) && (uiDivF == uiGotDivF), "divisor", "value" );
+   }
+}
+
+// Every frequency in range gets the closest divisor of its MASH order
+static void CheckSweep( uint32_t uiSource )
+{
+   uint32_t uiFrequency;
+   uint32_t uiMash;
+   uint32_t uiDivI;
+   uint32_t uiDivF;
+   double dIdeal;
+   double dDivisor;
+   
+   for( uiFrequency = 5000; uiFrequency <= CLOCK_MAX_FREQ; uiFrequency += uiFrequency / 7 + 1 )
+   {
+      for( uiMash = 0; uiMash <= PIN_CLOCK_MAX_MASH; uiMash++ )
+      {
+         if( IOPinClockDivisor( uiSource, uiFrequency, uiMash, &uiDivI, &uiDivF ) )
+         {
+            continue;
+         }
+         
+         dIdeal = (double)uiSource / uiFrequency;
+         dDivisor = uiDivI + (uiMash? uiDivF / (double)CLOCK_DIVF_ONE: 0);
+         Check( (dDivisor - dIdeal) <= (uiMash? 0.5 / CLOCK_DIVF_ONE: 0.5) + 1e-9, "sweep", "closest divisor (above)" );
+         Check( (dIdeal - dDivisor) <= (uiMash? 0.5 / CLOCK_DIVF_ONE: 0.5) + 1e-9, "sweep", "closest divisor (below)" );
+         Check( uiSource / (uiDivI - (3 == uiMash? 3: (2 == uiMash? 1: 0))) <= CLOCK_MAX_FREQ, "sweep", "highest frequency" );
+         Check( (uint32_t)(uiSource / dDivisor + 0.5) == IOPinClockFrequency( uiSource, uiMash, uiDivI, uiDivF ), "sweep", "actual frequency" );
+      }
+   }
+}
+
+static void CheckStart( void )
+{
+   size_t szCTL = offsetof(struct SClockManagerRegistersMap, CM_GP1CTL);
+   size_t szDIV = offsetof(struct SClockManagerRegistersMap, CM_GP1DIV);
+   uint32_t uiCTL = CM_PASSWD | (2 << CM_MASH) | (CM_SRC_PLLD << CM_SRC);
+   
+   // Running from the oscillator, to be moved to PLLD
+   memset( &g_stRegisters, 0, sizeof(g_stRegisters) );
+   g_stRegisters.CM_GP1CTL = (CM_SRC_OSC << CM_SRC) | (1 << CM_ENAB);
+   g_iNumWrites = 0;
+   g_iStuck = 0;
+   
+   Check( 0 == IOPinClockStart( &g_stRegisters, 1, CM_SRC_PLLD, 2, 40, 123 ), "start", "result" );
+   Check( 4 == g_iNumWrites, "start", "number of writes" );
+   Check( (szCTL == g_astWrites[0].szOffset) && ((CM_PASSWD | (CM_SRC_OSC << CM_SRC)) == g_astWrites[0].uiValue), "start", "disable" );
+   Check( (szDIV == g_astWrites[1].szOffset) && ((CM_PASSWD | (40 << CM_DIVI) | 123) == g_astWrites[1].uiValue), "start", "divisor" );
+   Check( (szCTL == g_astWrites[2].szOffset) && (uiCTL == g_astWrites[2].uiValue), "start", "source and MASH" );
+   Check( (szCTL == g_astWrites[3].szOffset) && ((uiCTL | (1 << CM_ENAB)) == g_astWrites[3].uiValue), "start", "enable" );
+   Check( (0 == g_stRegisters.CM_GP0CTL) && (0 == g_stRegisters.CM_GP2CTL), "start", "other generators untouched" );
+   
+   // A generator that doesn't stop is killed and left alone
+   memset( &g_stRegisters, 0, sizeof(g_stRegisters) );
+   g_stRegisters.CM_GP1CTL = (CM_SRC_OSC << CM_SRC) | (1 << CM_ENAB) | (1 << CM_BUSY);
+   g_iNumWrites = 0;
+   g_iStuck = 1;
+   
+   Check( 0 != IOPinClockStart( &g_stRegisters, 1, CM_SRC_PLLD, 0, 10, 0 ), "stuck", "result" );
+   Check( 2 == g_iNumWrites, "stuck", "number of writes" );
+   Check( (szCTL == g_astWrites[1].szOffset) && ((CM_PASSWD | (1 << CM_KILL)) == g_astWrites[1].uiValue), "stuck", "kill" );
+   g_iStuck = 0;
+}
+
+int main( int argc, char* argv[] )
+{
+   g_pvRegisters = &g_stRegisters;
+   g_pfnIOPinSocWriteHook = StuckWrite;
+   
+   Check( 0x70 == offsetof(struct SClockManagerRegistersMap, CM_GP0CTL), "map", "CM_GP0CTL offset" );
+   Check( 0x84 == offsetof(struct SClockManagerRegistersMap, CM_GP2DIV), "map", "CM_GP2DIV offset" );
+   Check( 0x98 == offsetof(struct SClockManagerRegistersMap, CM_PCMCTL), "map", "CM_PCMCTL offset" );
+   Check( 0xA0 == offsetof(struct SClockManagerRegistersMap, CM_PWMCTL), "map", "CM_PWMCTL offset" );
+   
+   CheckPin( 4, 0, GPIO_ALT0 );
+   CheckPin( 20, 0, GPIO_ALT5 );
+   CheckPin( 21, 1, GPIO_ALT5 );
+   CheckPin( 44, 1, GPIO_ALT0 );
+   CheckPin( 43, 2, GPIO_ALT0 );
+   CheckPin( 7, -1, 0 );
+   
+   CheckDivisor( OSC_FREQ, 1000000, 0, 1, 19, 0 );          // 19.2 rounded
+   CheckDivisor( OSC_FREQ, 1000000, 1, 1, 19, 819 );        // 19.2 = 19 + 819/4096
+   CheckDivisor( OSC_FREQ, OSC_FREQ, 0, 1, 1, 0 );
+   CheckDivisor( OSC_FREQ, OSC_FREQ, 1, 0, 0, 0 );          // MASH 1 needs DIVI >= 2
+   CheckDivisor( OSC_FREQ, 5000000, 3, 0, 0, 0 );           // MASH 3 needs DIVI >= 5
+   CheckDivisor( OSC_FREQ, 4000, 0, 0, 0, 0 );              // DIVI above 4095
+   CheckDivisor( OSC_FREQ, 4700, 1, 1, 4085, 436 );
+   CheckDivisor( PLLD_FREQ, 125000000, 0, 1, 4, 0 );
+   CheckDivisor( PLLD_FREQ, 250000000, 0, 0, 0, 0 );        // Above 125MHz
+   CheckDivisor( PLLD_FREQ, 111111111, 2, 0, 0, 0 );        // Dithers down to 3.5: 142MHz
+   CheckDivisor( PLLD_FREQ, 111111111, 1, 1, 4, 2048 );
+   
+   Check( 0 != IOPinClockCheckDivisor( OSC_FREQ, 1, 10, CLOCK_DIVF_ONE ), "divisor", "fraction out of range" );
+   Check( 0 != IOPinClockCheckDivisor( OSC_FREQ, 4, 10, 0 ), "divisor", "MASH out of range" );
+   Check( 1010526 == IOPinClockFrequency( OSC_FREQ, 0, 19, 819 ), "frequency", "MASH 0 ignores the fraction" );
+   
+   CheckSweep( OSC_FREQ );
+   CheckSweep( PLLD_FREQ );
+   CheckSweep( 54000000 );
+   CheckSweep( 750000000 );
+   CheckStart();
+   
+   return CheckResult( "Clock" );
+}
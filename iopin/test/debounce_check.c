@@ -0,0 +1,74 @@
+/*
+ * Checks the debouncing of the key matrix against bouncing and glitching keys. Doesn't need the board
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "iopin_debounce.h"
+#include "check.h"
+
+/*
+ * Feeds the samples of a key, one character per scan ('1' down, '0' up), and checks the scans
+ * where the state changes: '^' the key goes down, 'v' it goes up, '.' nothing
+ */
+static void CheckKey( const char* szCase, uint8_t ucScans, unsigned int uiKey, const char* szSamples, const char* szEvents )
+{
+   struct SIOPinDebounce stDebounce;
+   uint64_t ullBit = 1ULL << uiKey;
+   uint64_t ullChanged;
+   size_t i;
+   char chEvent;
+   
+   IOPinDebounceInit( &stDebounce, ucScans );
+   Check( strlen( szSamples ) == strlen( szEvents ), szCase, "test lengths" );
+   
+   for( i = 0; szSamples[i]; i++ )
+   {
+      ullChanged = IOPinDebounceScan( &stDebounce, ('1' == szSamples[i])? ullBit: 0 );
+      Check( 0 == (ullChanged & ~ullBit), szCase, "other keys unchanged" );
+      
+      chEvent = !ullChanged? '.': (stDebounce.ullState & ullBit)? '^': 'v';
+      if( chEvent != szEvents[i] )
+      {
+         printf( "FAIL: %s: scan %zu is '%c' instead of '%c'\n", szCase, i, chEvent, szEvents[i] );
+         g_iFailures++;
+      }
+   }
+}
+
+int main( int argc, char* argv[] )
+{
+   struct SIOPinDebounce stDebounce;
+   uint64_t ullChanged;
+   int i;
+   
+   CheckKey( "clean press", 3, 0,      "0011111000000", "....^....v..." );
+   CheckKey( "bouncing press", 3, 5,   "0101101111100001", "........^....v.." );
+   CheckKey( "bouncing release", 3, 5, "111111010100000", "..^.........v.." );
+   CheckKey( "glitch", 3, 63,          "00110011000", "..........." );
+   CheckKey( "no debounce", 1, 20,     "0110100", ".^.v^v." );
+   CheckKey( "zero scans", 0, 20,      "0110", ".^.v" );
+   
+   // Keys changing together come out in the same scan
+   IOPinDebounceInit( &stDebounce, 2 );
+   IOPinDebounceScan( &stDebounce, 0x8000000000000081ULL );
+   ullChanged = IOPinDebounceScan( &stDebounce, 0x8000000000000081ULL );
+   Check( 0x8000000000000081ULL == ullChanged, "chord", "keys down together" );
+   ullChanged = IOPinDebounceScan( &stDebounce, 0x8000000000000080ULL );
+   Check( 0 == ullChanged, "chord", "no event before the debounce" );
+   ullChanged = IOPinDebounceScan( &stDebounce, 0x8000000000000080ULL );
+   Check( 0x1ULL == ullChanged, "chord", "one key up" );
+   Check( 0x8000000000000080ULL == stDebounce.ullState, "chord", "state" );
+   
+   // Every key at once, for the upper bits
+   IOPinDebounceInit( &stDebounce, 4 );
+   for( i = 0; i < 4; i++ )
+   {
+      ullChanged = IOPinDebounceScan( &stDebounce, ~0ULL );
+   }
+   Check( ~0ULL == ullChanged, "all keys", "down" );
+   Check( 0 == stDebounce.ullCounting, "all keys", "nothing counting" );
+   
+   return CheckResult( "Debounce" );
+}
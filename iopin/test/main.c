@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -8,7 +9,9 @@
 #include <sys/ioctl.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <time.h>
 #include "iopin_ioctl.h"
+#include "iopin_mmap.h"
 
 int main( int argc, char* argv[] )
 {
@@ -41,6 +44,22 @@ int main( int argc, char* argv[] )
       printf( "[ 3] - Set function\n" );
       printf( "[ 4] - Set interruption\n" );
       printf( "[ 5] - Set Pull\n" );
+      printf( "[ 6] - Schedule output\n" );
+      printf( "[ 7] - Get stats\n" );
+      printf( "[ 8] - Toggle through mmap\n" );
+      printf( "[ 9] - Set moderation\n" );
+      printf( "[10] - Read events\n" );
+      printf( "[11] - Reset configuration\n" );
+      printf( "[12] - Stepper move (this pin steps axis 0)\n" );
+      printf( "[13] - Capture events to a file (splice)\n" );
+      printf( "[14] - Clock output\n" );
+      printf( "[15] - Wait for an edge\n" );
+      printf( "[16] - Bus write (this pin strobes)\n" );
+      printf( "[17] - Read a DHT22\n" );
+      printf( "[18] - UART send and receive (this pin receives)\n" );
+      printf( "[19] - Record a trace to a file\n" );
+      printf( "[20] - Replay a trace file\n" );
+      printf( "[21] - Key matrix (this pin is one of its rows or columns)\n" );
       printf( "[ 0] - Exit\n" );
       printf( "Option: " );
       fflush( stdout );
@@ -147,6 +166,657 @@ int main( int argc, char* argv[] )
             
             break;
          }
+         
+         case 6:
+         {
+            struct SIOPinScheduledOutput stEntry;
+            struct SIOPinSchedStats stStats;
+            struct timespec stNow;
+            unsigned long ulDelayUs;
+            
+            printf( "Value = " );
+            fflush( stdout );
+            scanf( "%lu", &ulValue );
+            printf( "Delay (us) = " );
+            fflush( stdout );
+            scanf( "%lu", &ulDelayUs );
+            
+            clock_gettime( CLOCK_MONOTONIC, &stNow );
+            memset( &stEntry, 0, sizeof(stEntry) );      // uiMask = 0 -> pin of this device
+            stEntry.uiLevel = ulValue;
+            stEntry.ullDeadlineNs = (stNow.tv_sec * 1000000000ULL) + stNow.tv_nsec + (ulDelayUs * 1000ULL);
+            
+            iRet = ioctl( fd, IOCTL_SCHEDULE_OUTPUT, &stEntry );
+            if( 0 > iRet )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+               break;
+            }
+            
+            usleep( ulDelayUs + 1000 );
+            
+            iRet = ioctl( fd, IOCTL_GET_SCHED_STATS, &stStats );
+            if( 0 > iRet )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+            }
+            else
+            {
+               printf( "Depth=%u/%u Fired=%llu Late=%llu Rejected=%llu MaxLateness=%lluns\n",
+                       stStats.uiDepth, stStats.uiCapacity, (unsigned long long)stStats.ullFired, (unsigned long long)stStats.ullLate,
+                       (unsigned long long)stStats.ullRejected, (unsigned long long)stStats.ullMaxLatenessNs );
+            }
+            
+            break;
+         }
+         
+         case 7:
+         {
+            struct SIOPinStats stStats;
+            
+            iRet = ioctl( fd, IOCTL_GET_STATS, &stStats );
+            if( 0 > iRet )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+            }
+            else
+            {
+               printf( "Events=%llu Sync=%llu Async=%llu MissedPulses=%llu LevelMasks=%llu Storms=%llu MaskState=%x Wakeups=%llu Dropped=%llu\n"
+                       "PollingSwitches=%llu PolledEvents=%llu Rate=%u/s\n",
+                       (unsigned long long)stStats.ullEvents, (unsigned long long)stStats.ullSyncEvents,
+                       (unsigned long long)stStats.ullAsyncEvents, (unsigned long long)stStats.ullMissedPulses,
+                       (unsigned long long)stStats.ullLevelMasks, (unsigned long long)stStats.ullStorms, stStats.uiMaskState,
+                       (unsigned long long)stStats.ullWakeups, (unsigned long long)stStats.ullDroppedEvents,
+                       (unsigned long long)stStats.ullPollingSwitches, (unsigned long long)stStats.ullPolledEvents, stStats.uiEventRate );
+            }
+            
+            break;
+         }
+         
+         case 8:
+         {
+            struct SIOPinMap stMap;
+            struct timespec stStart, stEnd;
+            unsigned long ulToggles;
+            double dSeconds;
+            
+            printf( "Pin = " );
+            fflush( stdout );
+            scanf( "%lu", &ulValue );
+            printf( "Toggles = " );
+            fflush( stdout );
+            scanf( "%lu", &ulToggles );
+            
+            if( 0 > IOPinMapOpen( &stMap ) )
+            {
+               printf( "Map failed: (%d) %s\n", errno, strerror(errno) );
+               break;
+            }
+            
+            if( !IOPinMapIsExported( &stMap, ulValue ) )
+            {
+               printf( "Pin %lu is not exported (mask %08x %08x)\n", ulValue, stMap.stExported.auiMask[0], stMap.stExported.auiMask[1] );
+               IOPinMapClose( &stMap );
+               break;
+            }
+            
+            clock_gettime( CLOCK_MONOTONIC, &stStart );
+            while( ulToggles-- )
+            {
+               IOPinMapSet( &stMap, ulValue );
+               IOPinMapClear( &stMap, ulValue );
+            }
+            clock_gettime( CLOCK_MONOTONIC, &stEnd );
+            
+            dSeconds = (stEnd.tv_sec - stStart.tv_sec) + ((stEnd.tv_nsec - stStart.tv_nsec) / 1e9);
+            printf( "Took %.6fs\n", dSeconds );
+            
+            IOPinMapClose( &stMap );
+            break;
+         }
+         
+         case 9:
+         {
+            struct SIOPinModeration stModeration;
+            
+            printf( "Events = " );
+            fflush( stdout );
+            scanf( "%u", &stModeration.uiMaxEvents );
+            printf( "Delay (us) = " );
+            fflush( stdout );
+            scanf( "%u", &stModeration.uiMaxDelayUs );
+            
+            iRet = ioctl( fd, IOCTL_SET_MODERATION, &stModeration );
+            if( 0 > iRet )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+            }
+            
+            break;
+         }
+         
+         case 10:
+         {
+            struct SIOPinEvent astEvents[16];
+            int i;
+            
+            // Blocks until the next wakeup, then back to level reads
+            ioctl( fd, IOCTL_SET_READ_MODE, READ_MODE_EVENTS );
+            iRet = read( fd, astEvents, sizeof(astEvents) );
+            ioctl( fd, IOCTL_SET_READ_MODE, READ_MODE_LEVEL );
+            
+            if( 0 > iRet )
+            {
+               printf( "Read failed: (%d) %s\n", errno, strerror(errno) );
+               break;
+            }
+            
+            for( i = 0; i < iRet / (int)sizeof(struct SIOPinEvent); i++ )
+            {
+               printf( "%llu.%09llu GPIO%u = %u\n", (unsigned long long)(astEvents[i].ullTimestampNs / 1000000000ULL),
+                       (unsigned long long)(astEvents[i].ullTimestampNs % 1000000000ULL), astEvents[i].uiPin, astEvents[i].uiLevel );
+            }
+            
+            break;
+         }
+         
+         case 11:
+         {
+            iRet = ioctl( fd, IOCTL_RESET_CONFIG );
+            if( 0 > iRet )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+            }
+            
+            break;
+         }
+         
+         case 12:
+         {
+            struct SIOPinStepperBind stBind;
+            struct SIOPinStepperMoves stMoves;
+            struct SIOPinStepperStatus stStatus;
+            
+            memset( &stBind, 0, sizeof(stBind) );
+            memset( &stMoves, 0, sizeof(stMoves) );
+            
+            printf( "Dir pin = " );
+            fflush( stdout );
+            scanf( "%d", &stBind.iDirPin );
+            stBind.iEnablePin = -1;
+            printf( "Steps = " );
+            fflush( stdout );
+            scanf( "%d", &stMoves.astMoves[0].iSteps );
+            printf( "Max rate (steps/s) = " );
+            fflush( stdout );
+            scanf( "%u", &stMoves.astMoves[0].uiMaxRate );
+            printf( "Acceleration (steps/s^2) = " );
+            fflush( stdout );
+            scanf( "%u", &stMoves.astMoves[0].uiAccel );
+            stMoves.uiCount = 1;
+            
+            // Already bound by a previous move is fine
+            iRet = ioctl( fd, IOCTL_STEPPER_BIND, &stBind );
+            if( (0 > iRet) && (EBUSY != errno) )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+               break;
+            }
+            
+            iRet = ioctl( fd, IOCTL_STEPPER_MOVE, &stMoves );
+            if( 0 > iRet )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+               break;
+            }
+            
+            do
+            {
+               usleep( 100000 );
+               memset( &stStatus, 0, sizeof(stStatus) );
+               iRet = ioctl( fd, IOCTL_STEPPER_STATUS, &stStatus );
+               printf( "Position=%lld Remaining=%u Rate=%u Queued=%u\n", (long long)stStatus.llPosition, stStatus.uiRemaining, stStatus.uiRate, stStatus.uiQueued );
+            } while( (0 == iRet) && (stStatus.uiRemaining || stStatus.uiQueued) );
+            
+            break;
+         }
+         
+         case 13:
+         {
+            char szFileName[256];
+            unsigned long ulEvents;
+            unsigned long ulBytes = 0;
+            ssize_t iMoved;
+            ssize_t iWritten;
+            int aiPipe[2];
+            int fdOut;
+            
+            printf( "File = " );
+            fflush( stdout );
+            scanf( "%255s", szFileName );
+            printf( "Events = " );
+            fflush( stdout );
+            scanf( "%lu", &ulEvents );
+            
+            fdOut = open( szFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+            if( 0 > fdOut )
+            {
+               printf( "Open failed: (%d) %s\n", errno, strerror(errno) );
+               break;
+            }
+            if( 0 > pipe( aiPipe ) )
+            {
+               printf( "Pipe failed: (%d) %s\n", errno, strerror(errno) );
+               close( fdOut );
+               break;
+            }
+            
+            // The records go from the driver to the pipe and from the pipe to the file without passing through this process
+            ioctl( fd, IOCTL_SET_READ_MODE, READ_MODE_EVENTS );
+            iRet = 0;
+            while( (0 == iRet) && (ulBytes < ulEvents * sizeof(struct SIOPinEvent)) )
+            {
+               iMoved = splice( fd, NULL, aiPipe[1], NULL, ulEvents * sizeof(struct SIOPinEvent) - ulBytes, SPLICE_F_MOVE );
+               if( 0 >= iMoved )
+               {
+                  iRet = -1;
+                  break;
+               }
+               ulBytes += iMoved;
+               
+               while( 0 < iMoved )
+               {
+                  iWritten = splice( aiPipe[0], NULL, fdOut, NULL, iMoved, SPLICE_F_MOVE );
+                  if( 0 >= iWritten )
+                  {
+                     iRet = -1;
+                     break;
+                  }
+                  iMoved -= iWritten;
+               }
+            }
+            if( 0 > iRet )
+            {
+               printf( "Splice failed: (%d) %s\n", errno, strerror(errno) );
+            }
+            ioctl( fd, IOCTL_SET_READ_MODE, READ_MODE_LEVEL );
+            
+            printf( "%lu events written\n", ulBytes / sizeof(struct SIOPinEvent) );
+            
+            close( aiPipe[0] );
+            close( aiPipe[1] );
+            close( fdOut );
+            break;
+         }
+         
+         case 14:
+         {
+            struct SIOPinClock stClock;
+            
+            memset( &stClock, 0, sizeof(stClock) );
+            printf( "Source (1=oscillator, 6=PLLD) = " );
+            fflush( stdout );
+            scanf( "%u", &stClock.uiSource );
+            printf( "MASH (0-3) = " );
+            fflush( stdout );
+            scanf( "%u", &stClock.uiMash );
+            printf( "Frequency (Hz, 0=stop) = " );
+            fflush( stdout );
+            scanf( "%u", &stClock.uiFrequency );
+            
+            if( 0 == stClock.uiFrequency )
+            {
+               iRet = ioctl( fd, IOCTL_CLOCK_STOP );
+            }
+            else
+            {
+               iRet = ioctl( fd, IOCTL_CLOCK_START, &stClock );
+            }
+            
+            if( 0 > iRet )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+            }
+            else if( stClock.uiFrequency )
+            {
+               printf( "DIVI=%u DIVF=%u Frequency=%uHz\n", stClock.uiDivI, stClock.uiDivF, stClock.uiActualFrequency );
+            }
+            
+            break;
+         }
+         
+         case 15:
+         {
+            struct SIOPinWaitEdge stWait;
+            
+            memset( &stWait, 0, sizeof(stWait) );
+            printf( "Edges (1=rising, 2=falling, 3=any) = " );
+            fflush( stdout );
+            scanf( "%u", &stWait.uiEdges );
+            printf( "Timeout (us, -1=forever) = " );
+            fflush( stdout );
+            scanf( "%d", &stWait.iTimeoutUs );
+            
+            iRet = ioctl( fd, IOCTL_WAIT_EDGE, &stWait );
+            if( 0 > iRet )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+            }
+            else
+            {
+               printf( "%llu.%09llu Level=%u Skipped=%u Missed=%u\n", (unsigned long long)(stWait.ullTimestampNs / 1000000000ULL),
+                       (unsigned long long)(stWait.ullTimestampNs % 1000000000ULL), stWait.uiLevel, stWait.uiSkipped, stWait.uiMissed );
+            }
+            
+            break;
+         }
+         
+         case 16:
+         {
+            struct SIOPinBusConfig stConfig;
+            struct SIOPinBusTransfer stTransfer;
+            char szText[81];
+            unsigned int i;
+            
+            // HD44780 timing: 450ns strobe, 40us per character
+            memset( &stConfig, 0, sizeof(stConfig) );
+            printf( "Data pins (8, D0 first) = " );
+            fflush( stdout );
+            stConfig.uiWidth = 8;
+            for( i = 0; i < stConfig.uiWidth; i++ )
+            {
+               scanf( "%d", &stConfig.aiDataPins[i] );
+            }
+            printf( "RS pin (-1=none) = " );
+            fflush( stdout );
+            scanf( "%d", &stConfig.iRsPin );
+            stConfig.iRwPin = -1;
+            stConfig.uiSetupNs = 60;
+            stConfig.uiPulseNs = 450;
+            stConfig.uiHoldNs = 20;
+            stConfig.uiGapNs = 40000;
+            printf( "Text = " );
+            fflush( stdout );
+            scanf( " %80[^\n]", szText );
+            
+            // Already bound by a previous write is fine
+            iRet = ioctl( fd, IOCTL_BUS_BIND, &stConfig );
+            if( (0 > iRet) && (EBUSY != errno) )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+               break;
+            }
+            
+            memset( &stTransfer, 0, sizeof(stTransfer) );
+            stTransfer.uiDirection = BUS_WRITE;
+            stTransfer.uiRs = 1;
+            stTransfer.uiCount = strlen( szText );
+            stTransfer.ullBuffer = (uintptr_t)szText;
+            
+            iRet = ioctl( fd, IOCTL_BUS_TRANSFER, &stTransfer );
+            if( 0 > iRet )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+            }
+            
+            break;
+         }
+         
+         case 17:
+         {
+            struct SIOPinDht stDht;
+            int iTemperature;
+            
+            memset( &stDht, 0, sizeof(stDht) );
+            
+            iRet = ioctl( fd, IOCTL_DHT_READ, &stDht );
+            if( 0 > iRet )
+            {
+               printf( "Ioctl failed: (%d) %s (%u edges)\n", errno, strerror(errno), stDht.uiEdges );
+               break;
+            }
+            
+            iTemperature = ((stDht.aucData[2] & 0x7F) << 8) | stDht.aucData[3];
+            if( stDht.aucData[2] & 0x80 )
+            {
+               iTemperature = -iTemperature;
+            }
+            printf( "Humidity=%.1f%% Temperature=%.1fC\n", ((stDht.aucData[0] << 8) | stDht.aucData[1]) / 10.0, iTemperature / 10.0 );
+            
+            break;
+         }
+         
+         case 18:
+         {
+            struct SIOPinUartConfig stConfig;
+            struct SIOPinUartStats stStats;
+            struct pollfd pfd;
+            char szText[81];
+            char achReceived[256];
+            ssize_t iReceived;
+            
+            memset( &stConfig, 0, sizeof(stConfig) );
+            printf( "Baud = " );
+            fflush( stdout );
+            scanf( "%u", &stConfig.uiBaud );
+            printf( "TX pin = " );
+            fflush( stdout );
+            scanf( "%d", &stConfig.iTxPin );
+            printf( "Text = " );
+            fflush( stdout );
+            scanf( " %80[^\n]", szText );
+            
+            // Already bound by a previous call is fine
+            iRet = ioctl( fd, IOCTL_UART_BIND, &stConfig );
+            if( (0 > iRet) && (EBUSY != errno) )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+               break;
+            }
+            
+            if( 0 > write( fd, szText, strlen( szText ) ) )
+            {
+               printf( "Write failed: (%d) %s\n", errno, strerror(errno) );
+            }
+            
+            // Whatever comes back within a second (TX wired to RX for a loopback)
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            while( 0 < poll( &pfd, 1, 1000 ) )
+            {
+               iReceived = read( fd, achReceived, sizeof(achReceived) );
+               if( 0 >= iReceived )
+               {
+                  break;
+               }
+               printf( "Received: %.*s\n", (int)iReceived, achReceived );
+            }
+            
+            if( 0 == ioctl( fd, IOCTL_UART_STATS, &stStats ) )
+            {
+               printf( "RX=%llu TX=%llu Framing=%u Late=%u Overruns=%u\n", (unsigned long long)stStats.ullRxBytes,
+                       (unsigned long long)stStats.ullTxBytes, stStats.uiFramingErrors, stStats.uiLateSamples, stStats.uiOverruns );
+            }
+            
+            break;
+         }
+         
+         case 19:
+         case 20:
+         {
+            struct SIOPinTraceRecord stRecord;
+            struct SIOPinTraceMap stMap;
+            struct SIOPinTraceStatus stStatus;
+            struct SIOPinTraceEdge astEdges[256];
+            char szFileName[256];
+            struct pollfd pfd;
+            time_t tEnd;
+            ssize_t iBytes;
+            unsigned int uiSeconds;
+            int iFrom;
+            int iTo;
+            int fdTrace;
+            int fdFile;
+            int i;
+            
+            printf( "File = " );
+            fflush( stdout );
+            scanf( "%255s", szFileName );
+            
+            fdTrace = open( "/dev/iopintrace", (19 == iOption)? O_RDONLY: O_WRONLY );
+            fdFile = (19 == iOption)? open( szFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644 ): open( szFileName, O_RDONLY );
+            if( (0 > fdTrace) || (0 > fdFile) )
+            {
+               printf( "Open failed: (%d) %s\n", errno, strerror(errno) );
+               if( 0 <= fdTrace )
+               {
+                  close( fdTrace );
+               }
+               if( 0 <= fdFile )
+               {
+                  close( fdFile );
+               }
+               break;
+            }
+            
+            if( 19 == iOption )
+            {  // The edges of the pins must be enabled on their devices
+               memset( &stRecord, 0, sizeof(stRecord) );
+               printf( "Pins to record (mask of GPIO0-31, hex) = " );
+               fflush( stdout );
+               scanf( "%x", &stRecord.auiMask[0] );
+               printf( "Seconds = " );
+               fflush( stdout );
+               scanf( "%u", &uiSeconds );
+               
+               iRet = ioctl( fdTrace, IOCTL_TRACE_RECORD, &stRecord );
+               tEnd = time( NULL ) + uiSeconds;
+               pfd.fd = fdTrace;
+               pfd.events = POLLIN;
+               while( (0 == iRet) && (time( NULL ) < tEnd) )
+               {
+                  if( (0 < poll( &pfd, 1, 100 )) && (0 < (iBytes = read( fdTrace, astEdges, sizeof(astEdges) ))) )
+                  {
+                     write( fdFile, astEdges, iBytes );
+                  }
+               }
+               
+               // Stopped, the rest of the records until the end of the file
+               memset( &stRecord, 0, sizeof(stRecord) );
+               ioctl( fdTrace, IOCTL_TRACE_RECORD, &stRecord );
+               while( 0 < (iBytes = read( fdTrace, astEdges, sizeof(astEdges) )) )
+               {
+                  write( fdFile, astEdges, iBytes );
+               }
+            }
+            else
+            {
+               for( i = 0; i < TRACE_MAX_PINS; i++ )
+               {
+                  stMap.aucOutput[i] = (54 > i)? i: TRACE_NO_OUTPUT;
+               }
+               printf( "Recorded pin to move (-1 = replay on the same pins) = " );
+               fflush( stdout );
+               scanf( "%d", &iFrom );
+               if( (0 <= iFrom) && (TRACE_MAX_PINS > iFrom) )
+               {
+                  printf( "Output = " );
+                  fflush( stdout );
+                  scanf( "%d", &iTo );
+                  stMap.aucOutput[iFrom] = iTo;
+               }
+               
+               iRet = ioctl( fdTrace, IOCTL_TRACE_MAP, &stMap );
+               while( (0 == iRet) && (0 < (iBytes = read( fdFile, astEdges, sizeof(astEdges) ))) )
+               {
+                  if( 0 > write( fdTrace, astEdges, iBytes ) )
+                  {
+                     iRet = -1;
+                  }
+               }
+            }
+            if( 0 > iRet )
+            {
+               printf( "Failed: (%d) %s\n", errno, strerror(errno) );
+            }
+            
+            if( 0 == ioctl( fdTrace, IOCTL_TRACE_STATUS, &stStatus ) )
+            {
+               printf( "Recorded=%llu Played=%llu Lost=%u Underruns=%u Pending=%u MaxLate=%uns\n", (unsigned long long)stStatus.ullRecorded,
+                       (unsigned long long)stStatus.ullPlayed, stStatus.uiLost, stStatus.uiUnderruns, stStatus.uiPlayPending, stStatus.uiMaxLateNs );
+            }
+            
+            close( fdFile );
+            close( fdTrace );
+            break;
+         }
+         
+         case 21:
+         {
+            struct SIOPinMatrixConfig stConfig;
+            struct SIOPinMatrixState stState;
+            struct SIOPinKeyEvent astKeys[16];
+            struct pollfd pfd;
+            time_t tEnd;
+            ssize_t iBytes;
+            unsigned int uiSeconds;
+            unsigned int i;
+            
+            memset( &stConfig, 0, sizeof(stConfig) );
+            printf( "Rows = " );
+            fflush( stdout );
+            scanf( "%u", &stConfig.uiRows );
+            for( i = 0; (i < stConfig.uiRows) && (MATRIX_MAX_ROWS > i); i++ )
+            {
+               printf( "Row %u pin = ", i );
+               fflush( stdout );
+               scanf( "%d", &stConfig.aiRowPins[i] );
+            }
+            printf( "Columns = " );
+            fflush( stdout );
+            scanf( "%u", &stConfig.uiColumns );
+            for( i = 0; (i < stConfig.uiColumns) && (MATRIX_MAX_COLUMNS > i); i++ )
+            {
+               printf( "Column %u pin = ", i );
+               fflush( stdout );
+               scanf( "%d", &stConfig.aiColumnPins[i] );
+            }
+            printf( "Seconds = " );
+            fflush( stdout );
+            scanf( "%u", &uiSeconds );
+            
+            // The default scan period, settle time and debounce
+            iRet = ioctl( fd, IOCTL_MATRIX_BIND, &stConfig );
+            if( 0 > iRet )
+            {
+               printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+               break;
+            }
+            
+            tEnd = time( NULL ) + uiSeconds;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            while( time( NULL ) < tEnd )
+            {
+               if( (0 < poll( &pfd, 1, 100 )) && (0 < (iBytes = read( fd, astKeys, sizeof(astKeys) ))) )
+               {
+                  for( i = 0; i < iBytes / sizeof(struct SIOPinKeyEvent); i++ )
+                  {
+                     printf( "%llu.%09llu: key %u (row %u, column %u) %s\n", astKeys[i].ullTimestampNs / 1000000000ULL,
+                             astKeys[i].ullTimestampNs % 1000000000ULL, astKeys[i].ucKey, astKeys[i].ucRow, astKeys[i].ucColumn,
+                             astKeys[i].ucPressed? "down": "up" );
+                  }
+               }
+            }
+            
+            if( 0 == ioctl( fd, IOCTL_MATRIX_STATE, &stState ) )
+            {
+               printf( "Pressed=%016llx Scans=%llu Overruns=%u\n", (unsigned long long)stState.ullPressed,
+                       (unsigned long long)stState.ullScans, stState.uiOverruns );
+            }
+            ioctl( fd, IOCTL_MATRIX_UNBIND );
+            break;
+         }
       }
    }
    
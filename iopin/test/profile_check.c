@@ -0,0 +1,95 @@
+/*
+ * Checks the trapezoidal profile of the steppers against the kinematics. Doesn't need the board
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include "iopin_profile.h"
+#include "check.h"
+
+#define  TICK_NS        10000
+
+// Time of the move (s) with ideal ramps
+static double ExpectedTime( uint32_t uiSteps, uint32_t uiMaxRate, uint32_t uiAccel )
+{
+   double dRampSteps = (double)uiMaxRate * uiMaxRate / (2.0 * uiAccel);
+   
+   if( !uiAccel )
+   {
+      return (double)uiSteps / uiMaxRate;
+   }
+   
+   if( 2 * dRampSteps >= uiSteps )
+   {  // Triangle, the maximum isn't reached
+      return 2 * sqrt( uiSteps / (double)uiAccel );
+   }
+   
+   return 2.0 * uiMaxRate / uiAccel + (uiSteps - 2 * dRampSteps) / uiMaxRate;
+}
+
+static void CheckMove( uint32_t uiSteps, uint32_t uiMaxRate, uint32_t uiAccel )
+{
+   struct SIOPinProfile stProfile;
+   uint64_t ullTicks = 0;
+   uint64_t ullLastStep = 0;
+   uint64_t ullFirstStep = 0;
+   uint64_t ullPeakQ16 = 0;
+   uint32_t uiCount = 0;
+   char szCase[64];
+   double dTime;
+   double dExpected;
+   double dSlack;
+   
+   snprintf( szCase, sizeof(szCase), "%u steps at %u/s, %u/s^2", uiSteps, uiMaxRate, uiAccel );
+   IOPinProfileStart( &stProfile, uiSteps, uiMaxRate, uiAccel, TICK_NS );
+   
+   while( stProfile.uiRemaining && (ullTicks < 100000000) )
+   {
+      ullTicks++;
+      if( IOPinProfileTick( &stProfile ) )
+      {
+         Check( ullTicks - ullLastStep >= 2, szCase, "one tick low between steps" );
+         if( 0 == uiCount )
+         {
+            ullFirstStep = ullTicks;
+         }
+         ullLastStep = ullTicks;
+         uiCount++;
+      }
+      if( stProfile.ullRateQ16 > ullPeakQ16 )
+      {
+         ullPeakQ16 = stProfile.ullRateQ16;
+      }
+   }
+   
+   Check( uiSteps == uiCount, szCase, "number of steps" );
+   Check( (ullPeakQ16 >> 16) <= uiMaxRate, szCase, "maximum rate" );
+   
+   // The move ends on its last step, up to one slow step before the ideal ramp stops
+   dTime = ullTicks * (TICK_NS / 1e9);
+   dExpected = ExpectedTime( uiSteps, uiMaxRate, uiAccel );
+   dSlack = uiAccel? sqrt( 2.0 / uiAccel ): 0;
+   Check( (dTime > dExpected * 0.98 - dSlack) && (dTime < dExpected * 1.02 + 2.0 / uiMaxRate), szCase, "duration" );
+   
+   if( uiAccel )
+   {  // From standstill the first step comes after sqrt(2 / accel)
+      dExpected = sqrt( 2.0 / uiAccel );
+      dTime = ullFirstStep * (TICK_NS / 1e9);
+      Check( (dTime > dExpected * 0.95) && (dTime < dExpected * 1.05), szCase, "first step" );
+   }
+}
+
+int main( int argc, char* argv[] )
+{
+   static const uint32_t auiSteps[] = { 1, 2, 3, 10, 100, 1000, 4000, 20000 };
+   unsigned int i;
+   
+   for( i = 0; i < sizeof(auiSteps) / sizeof(auiSteps[0]); i++ )
+   {
+      CheckMove( auiSteps[i], 20000, 50000 );
+      CheckMove( auiSteps[i], 20000, 0 );
+      CheckMove( auiSteps[i], 500, 2000 );
+   }
+   
+   return CheckResult( "Stepper profile" );
+}
@@ -0,0 +1,129 @@
+/*
+ * Checks the DHT pulse width decoder against synthetic waveforms. Doesn't need the board
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "iopin_pulse.h"
+#include "check.h"
+
+#define  MAX_EDGES      100
+
+struct SWaveform
+{
+   uint64_t aullTimestamps[MAX_EDGES];
+   uint8_t  aucLevels[MAX_EDGES];
+   unsigned int uiEdges;
+   uint64_t ullNow;
+};
+
+static void AddEdge( struct SWaveform* pstWave, uint64_t ullAfterNs, uint8_t ucLevel )
+{
+   pstWave->ullNow += ullAfterNs;
+   if( MAX_EDGES > pstWave->uiEdges )
+   {
+      pstWave->aullTimestamps[pstWave->uiEdges] = pstWave->ullNow;
+      pstWave->aucLevels[pstWave->uiEdges] = ucLevel;
+      pstWave->uiEdges++;
+   }
+}
+
+/*
+ * The answer of a sensor: the line released by the driver, 80us low and 80us high, then every bit
+ * is 50us low and 27us (0) or 70us (1) high. iJitterNs is added to the odd pulses and subtracted
+ * from the even ones
+ */
+static void Build( struct SWaveform* pstWave, const uint8_t* pucData, int iJitterNs, int iRelease )
+{
+   int64_t llJitter;
+   unsigned int i;
+   
+   memset( pstWave, 0, sizeof(*pstWave) );
+   
+   AddEdge( pstWave, 0, 1 );
+   AddEdge( pstWave, 30000, 0 );
+   AddEdge( pstWave, 80000, 1 );
+   AddEdge( pstWave, 80000, 0 );
+   for( i = 0; i < 40; i++ )
+   {
+      llJitter = (i % 2)? iJitterNs: -iJitterNs;
+      AddEdge( pstWave, 50000 - llJitter, 1 );
+      AddEdge( pstWave, ((pucData[i / 8] & (0x80 >> (i % 8)))? 70000: 27000) + llJitter, 0 );
+   }
+   if( iRelease )
+   {
+      AddEdge( pstWave, 50000, 1 );
+   }
+}
+
+static void CheckDecode( const char* szCase, const struct SWaveform* pstWave, int iExpected, const uint8_t* pucExpected )
+{
+   uint8_t aucData[DHT_BYTES];
+   int iRet = IOPinDhtDecode( pstWave->aullTimestamps, pstWave->aucLevels, pstWave->uiEdges, DHT_THRESHOLD_NS, aucData );
+   
+   Check( iExpected == iRet, szCase, "result" );
+   if( (0 == iExpected) && (0 == iRet) )
+   {
+      Check( 0 == memcmp( aucData, pucExpected, DHT_BYTES ), szCase, "data" );
+   }
+}
+
+int main( int argc, char* argv[] )
+{
+   // DHT22: 65.2% and -10.1C
+   const uint8_t aucReading[DHT_BYTES] = { 0x02, 0x8C, 0x80, 0x65, 0x73 };
+   uint8_t aucBad[DHT_BYTES];
+   struct SWaveform stWave;
+   unsigned int i;
+   
+   Build( &stWave, aucReading, 0, 0 );
+   Check( 84 == stWave.uiEdges, "nominal", "edges" );
+   CheckDecode( "nominal", &stWave, 0, aucReading );
+   
+   Build( &stWave, aucReading, 0, 1 );
+   CheckDecode( "release edge", &stWave, 0, aucReading );
+   
+   // The first edge is lost when the line was already high
+   Build( &stWave, aucReading, 0, 1 );
+   memmove( &stWave.aullTimestamps[0], &stWave.aullTimestamps[1], (stWave.uiEdges - 1) * sizeof(uint64_t) );
+   memmove( &stWave.aucLevels[0], &stWave.aucLevels[1], stWave.uiEdges - 1 );
+   stWave.uiEdges--;
+   CheckDecode( "no start edge", &stWave, 0, aucReading );
+   
+   Build( &stWave, aucReading, 8000, 1 );
+   CheckDecode( "jitter", &stWave, 0, aucReading );
+   
+   memset( aucBad, 0xFF, sizeof(aucBad) );
+   aucBad[4] = 0xFC;
+   Build( &stWave, aucBad, 0, 0 );
+   CheckDecode( "all ones", &stWave, 0, aucBad );
+   
+   // A bit lost in the middle, its two edges gone
+   Build( &stWave, aucReading, 0, 0 );
+   memmove( &stWave.aullTimestamps[40], &stWave.aullTimestamps[41], (stWave.uiEdges - 41) * sizeof(uint64_t) );
+   memmove( &stWave.aucLevels[40], &stWave.aucLevels[41], stWave.uiEdges - 41 );
+   stWave.uiEdges--;
+   CheckDecode( "missing edge", &stWave, PULSE_ERR_MISSING, NULL );
+   
+   Build( &stWave, aucReading, 0, 0 );
+   stWave.uiEdges -= 10;
+   CheckDecode( "truncated", &stWave, PULSE_ERR_MISSING, NULL );
+   
+   memcpy( aucBad, aucReading, sizeof(aucBad) );
+   aucBad[4]++;
+   Build( &stWave, aucBad, 0, 0 );
+   CheckDecode( "checksum", &stWave, PULSE_ERR_CHECKSUM, NULL );
+   
+   // A 150us high pulse isn't a bit
+   Build( &stWave, aucReading, 0, 0 );
+   for( i = 61; i < stWave.uiEdges; i++ )
+   {
+      stWave.aullTimestamps[i] += 120000;
+   }
+   CheckDecode( "long pulse", &stWave, PULSE_ERR_MISSING, NULL );
+   
+   CheckDecode( "no edges", &(struct SWaveform){ .uiEdges = 0 }, PULSE_ERR_MISSING, NULL );
+   
+   return CheckResult( "Pulse" );
+}
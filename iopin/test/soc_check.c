@@ -0,0 +1,129 @@
+/*
+ * Checks the SoC layouts of the driver against a simulated register map. Doesn't need the board
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "rpiregisters.h"
+#include "iopin_ioctl.h"
+#include "iopin_soc.h"
+#include "check.h"
+
+static struct SGpioRegistersMap g_stRegisters;
+static const char* g_szMachine;
+
+static int IsMachine( const char* szCompatible )
+{
+   return 0 == strcmp( szCompatible, g_szMachine );
+}
+
+static void Reset( void )
+{
+   memset( &g_stRegisters, 0, sizeof(g_stRegisters) );
+   g_iNumWrites = 0;
+}
+
+static void CheckRegisterMap( void )
+{
+   Check( 0x94 == offsetof(struct SGpioRegistersMap, GPPUD), "map", "GPPUD offset" );
+   Check( 0x98 == offsetof(struct SGpioRegistersMap, GPPUDCLK), "map", "GPPUDCLK offset" );
+   Check( 0xE4 == offsetof(struct SGpioRegistersMap, GPPUPPDN), "map", "GPPUPPDN offset" );
+}
+
+// Clocked sequence: GPPUD, GPPUDCLK of the bank, then both back to 0. Nothing else is touched
+static void CheckClockedPull( const struct SIOPinSocLayout* pstLayout, unsigned long ulPin, unsigned long ulPull, uint32_t uiPUD )
+{
+   size_t szClock = offsetof(struct SGpioRegistersMap, GPPUDCLK) + ((ulPin / 32) * sizeof(uint32_t));
+   
+   Reset();
+   Check( 0 == pstLayout->pfnSetPull( &g_stRegisters, ulPin, ulPull ), pstLayout->szName, "set pull" );
+   Check( 4 == g_iNumWrites, pstLayout->szName, "number of writes" );
+   if( 4 != g_iNumWrites )
+   {
+      return;
+   }
+   
+   Check( (offsetof(struct SGpioRegistersMap, GPPUD) == g_astWrites[0].szOffset) && (uiPUD == g_astWrites[0].uiValue), pstLayout->szName, "GPPUD control" );
+   Check( (szClock == g_astWrites[1].szOffset) && ((1u << (ulPin % 32)) == g_astWrites[1].uiValue), pstLayout->szName, "GPPUDCLK clock" );
+   Check( (offsetof(struct SGpioRegistersMap, GPPUD) == g_astWrites[2].szOffset) && (0 == g_astWrites[2].uiValue), pstLayout->szName, "GPPUD removed" );
+   Check( (szClock == g_astWrites[3].szOffset) && (0 == g_astWrites[3].uiValue), pstLayout->szName, "GPPUDCLK removed" );
+   Check( -1 == pstLayout->pfnGetPull( &g_stRegisters, ulPin ), pstLayout->szName, "pull can't be read back" );
+}
+
+// Direct per-pin field: one write, neighbours untouched, no GPPUD sequence
+static void CheckDirectPull( const struct SIOPinSocLayout* pstLayout )
+{
+   static const unsigned long aulPins[] = { 0, 15, 16, 31, 45, 57 };
+   unsigned int i;
+   
+   Reset();
+   memset( g_stRegisters.GPPUPPDN, 0x55, sizeof(g_stRegisters.GPPUPPDN) );    // Every pin pulled up
+   
+   for( i = 0; i < sizeof(aulPins) / sizeof(aulPins[0]); i++ )
+   {
+      unsigned long ulPin = aulPins[i];
+      uint32_t uiBefore = g_stRegisters.GPPUPPDN[ulPin / 16];
+      int iWrites = g_iNumWrites;
+      
+      Check( 0 == pstLayout->pfnSetPull( &g_stRegisters, ulPin, PIN_PULL_DOWN ), pstLayout->szName, "set pull" );
+      Check( iWrites + 1 == g_iNumWrites, pstLayout->szName, "one write per pull" );
+      Check( g_stRegisters.GPPUPPDN[ulPin / 16] == ((uiBefore & ~(3u << ((ulPin % 16) * 2))) | (GPIO_PUPPDN_DOWN << ((ulPin % 16) * 2))),
+             pstLayout->szName, "pull down field" );
+      Check( PIN_PULL_DOWN == pstLayout->pfnGetPull( &g_stRegisters, ulPin ), pstLayout->szName, "read back down" );
+      
+      pstLayout->pfnSetPull( &g_stRegisters, ulPin, PIN_PULL_OFF );
+      Check( PIN_PULL_OFF == pstLayout->pfnGetPull( &g_stRegisters, ulPin ), pstLayout->szName, "read back off" );
+      pstLayout->pfnSetPull( &g_stRegisters, ulPin, PIN_PULL_UP );
+      Check( PIN_PULL_UP == pstLayout->pfnGetPull( &g_stRegisters, ulPin ), pstLayout->szName, "read back up" );
+      Check( uiBefore == g_stRegisters.GPPUPPDN[ulPin / 16], pstLayout->szName, "other pins untouched" );
+   }
+   
+   Check( (0 == g_stRegisters.GPPUD) && (0 == g_stRegisters.GPPUDCLK[0]) && (0 == g_stRegisters.GPPUDCLK[1]), pstLayout->szName, "no clocked sequence" );
+}
+
+int main( int argc, char* argv[] )
+{
+   static const struct { const char* szMachine; const char* szLayout; } astMachines[] =
+   {
+      { "brcm,bcm2708", "BCM2835" }, { "brcm,bcm2835", "BCM2835" }, { "brcm,bcm2709", "BCM2836/BCM2837" },
+      { "brcm,bcm2837", "BCM2836/BCM2837" }, { "brcm,bcm2711", "BCM2711" }, { "unknown,board", "BCM2835" },
+   };
+   const struct SIOPinSocLayout* pstLayout;
+   unsigned int i;
+   
+   g_pvRegisters = &g_stRegisters;
+   g_pfnIOPinSocWriteHook = RecordWrite;
+   
+   CheckRegisterMap();
+   
+   for( i = 0; i < sizeof(astMachines) / sizeof(astMachines[0]); i++ )
+   {
+      g_szMachine = astMachines[i].szMachine;
+      pstLayout = IOPinFindSocLayout( IsMachine );
+      Check( 0 == strcmp( pstLayout->szName, astMachines[i].szLayout ), astMachines[i].szMachine, "detection" );
+   }
+   
+   for( i = 0; i < g_uiIOPinNumSocLayouts; i++ )
+   {
+      pstLayout = &g_astIOPinSocLayouts[i];
+      
+      Check( 0 != pstLayout->pfnSetPull( &g_stRegisters, 4, 3 ), pstLayout->szName, "invalid pull refused" );
+      
+      if( 0 == strcmp( pstLayout->szName, "BCM2711" ) )
+      {
+         Check( 58 == pstLayout->uiNumPins, pstLayout->szName, "number of pins" );
+         CheckDirectPull( pstLayout );
+      }
+      else
+      {
+         Check( 54 == pstLayout->uiNumPins, pstLayout->szName, "number of pins" );
+         CheckClockedPull( pstLayout, 4, PIN_PULL_UP, GPIO_PUD_UP );
+         CheckClockedPull( pstLayout, 17, PIN_PULL_DOWN, GPIO_PUD_DOWN );
+         CheckClockedPull( pstLayout, 40, PIN_PULL_OFF, GPIO_PUD_OFF );
+      }
+   }
+   
+   return CheckResult( "SoC layout" );
+}
@@ -1,6 +1,8 @@
 /*
  *    This file contains part of the register map for the Raspberry PI 1
  *    Taken mostly from the BCM 2835 datasheet
+ *    The Raspberry PI 2 and 3 (BCM2836/BCM2837) use the same map at another base address.
+ *    The differences of the Raspberry PI 4 (BCM2711) are marked where they apply
  *
  * Copyright
  *
@@ -27,6 +29,20 @@
 #ifndef _RPI_REGISTERS_H_
 #define _RPI_REGISTERS_H_
 
+//------[ Peripheral offsets ]-----------------------------------------------------------
+// Offsets from the start of the peripheral area. The ARM sees that area at BCM2708_PERI_BASE
+// (0x20000000 on the BCM2835), while the DMA engine sees it at PERI_BUS_BASE
+#define  PERI_BUS_BASE     0x7E000000  // Peripheral area as seen from the VideoCore bus
+#define  BCM2835_PERI_BASE 0x20000000  // Raspberry PI 1 / Zero
+#define  BCM2836_PERI_BASE 0x3F000000  // Raspberry PI 2 and 3 (BCM2836/BCM2837)
+#define  BCM2711_PERI_BASE 0xFE000000  // Raspberry PI 4 (low peripheral mode)
+#define  DMA0_OFFSET       0x007000    // DMA channels 0 to 14
+#define  CLOCK_OFFSET      0x101000    // Clock Manager
+#define  GPIO_OFFSET       0x200000    // GPIO
+#define  PCM_OFFSET        0x203000    // PCM / I2S
+#define  PWM_OFFSET        0x20C000    // PWM
+#define  DMA_CHANNEL_SIZE  0x100       // Size of the register set of each DMA channel
+
 //------[ GPIO Registers map ]-----------------------------------------------------------
 struct SGpioRegistersMap
 {
@@ -52,10 +68,22 @@ struct SGpioRegistersMap
    uint32_t Reserved10;
    uint32_t GPAFEN[2];     // [R/W] GPIO Pin Async. Falling Edge Detect
    uint32_t Reserved11;
-   uint32_t GPPUD;         // [R/W] GPIO Pin Pull-up/down Enable
-   uint32_t GPPUDCLK[2];   // [R/W] GPIO Pin Pull-up/down Enable Clock
+   uint32_t GPPUD;         // [R/W] GPIO Pin Pull-up/down Enable (not on the BCM2711)
+   uint32_t GPPUDCLK[2];   // [R/W] GPIO Pin Pull-up/down Enable Clock (not on the BCM2711)
+   uint32_t Reserved12[17];
+   uint32_t GPPUPPDN[4];   // [R/W] GPIO Pull-up / Pull-down, 2 bits per pin (BCM2711 only)
 };
 
+// GPPUD - Pull-up/down control (BCM2835 to BCM2837)
+#define  GPIO_PUD_OFF      0     // Disable pull-up/down
+#define  GPIO_PUD_DOWN     1     // Enable pull down control
+#define  GPIO_PUD_UP       2     // Enable pull up control
+
+// GPPUPPDN[] - Pull-up/down of each pin (BCM2711)
+#define  GPIO_PUPPDN_OFF   0     // No resistor is selected
+#define  GPIO_PUPPDN_UP    1     // Pull up resistor is selected
+#define  GPIO_PUPPDN_DOWN  2     // Pull down resistor is selected
+
 // GPFSEL[] - GPIO Function Select Registers Values
 #define  GPIO_INPUT        0     // Pin is an Input
 #define  GPIO_OUTPUT       1     // Pin is an output
@@ -258,6 +286,28 @@ struct SDMAControlBlock
 #define  DMA_END                             1     // DMA End Flag
 #define  DMA_ACTIVE                          0     // Activate the DMA
 
+// TI Register (also the TI word of the control block)
+#define  DMA_NO_WIDE_BURSTS                  26    // Don't Do wide writes as a 2 beat burst
+#define  DMA_WAITS                           21    // Add Wait Cycles
+#define  DMA_PERMAP                          16    // Peripheral Mapping
+#define  DMA_BURST_LENGTH                    12    // Burst Transfer Length
+#define  DMA_SRC_IGNORE                      11    // Ignore Reads
+#define  DMA_SRC_DREQ                        10    // Control Source Reads with DREQ
+#define  DMA_SRC_WIDTH                       9     // Source Transfer Width
+#define  DMA_SRC_INC                         8     // Source Address Increment
+#define  DMA_DEST_IGNORE                     7     // Ignore Writes
+#define  DMA_DEST_DREQ                       6     // Control Destination Writes with DREQ
+#define  DMA_DEST_WIDTH                      5     // Destination Transfer Width
+#define  DMA_DEST_INC                        4     // Destination Address Increment
+#define  DMA_WAIT_RESP                       3     // Wait for a Write Response
+#define  DMA_TDMODE                          1     // 2D Mode
+#define  DMA_INTEN                           0     // Interrupt Enable
+
+// PERMAP values (peripheral that paces the transfer with its DREQ)
+#define  DMA_PERMAP_PCM_TX                   2     // PCM TX FIFO
+#define  DMA_PERMAP_PCM_RX                   3     // PCM RX FIFO
+#define  DMA_PERMAP_PWM                      5     // PWM FIFO
+
 
 //------[ Clock Registers map ]----------------------------------------------------------
 // The clock map on the datasheet is not complete. It has only the GPIO clock.
@@ -278,4 +328,27 @@ struct SClockManagerRegistersMap
    uint32_t CM_PWMDIV;     // Off=0xA4 - Clock Manager PWM Clock Divisors
 };
 
+// CM_xxCTL Registers
+#define  CM_PASSWD         0x5A000000  // Every write to the clock manager must carry this password
+#define  CM_MASH           9     // MASH control
+#define  CM_FLIP           8     // Invert the clock generator output
+#define  CM_BUSY           7     // Clock generator is running
+#define  CM_KILL           5     // Kill the clock generator
+#define  CM_ENAB           4     // Enable the clock generator
+#define  CM_SRC            0     // Clock source
+
+// CM_xxDIV Registers
+#define  CM_DIVI           12    // Integer part of divisor
+#define  CM_DIVF           0     // Fractional part of divisor
+
+// Clock sources
+#define  CM_SRC_GND        0     // GND
+#define  CM_SRC_OSC        1     // Oscillator (19.2MHz, 54MHz on the BCM2711)
+#define  CM_SRC_TESTDEBUG0 2     // Testdebug0
+#define  CM_SRC_TESTDEBUG1 3     // Testdebug1
+#define  CM_SRC_PLLA       4     // PLLA per
+#define  CM_SRC_PLLC       5     // PLLC per
+#define  CM_SRC_PLLD       6     // PLLD per (500MHz)
+#define  CM_SRC_HDMI       7     // HDMI auxiliary
+
 #endif
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include "ws2812_encode.h"
+#include "ws2812_ioctl.h"
+
+struct SEncoderVector
+{
+   uint8_t  aucGRB[6];
+   size_t   szNumBytes;
+   uint32_t auiExpected[5];
+   size_t   szNumWords;
+};
+
+static const struct SEncoderVector g_astVectors[] =
+{
+   { { 0x00, 0x00, 0x00 },                   3, { 0x92492492, 0x49249249, 0x24000000 }, 3 },
+   { { 0xFF, 0xFF, 0xFF },                   3, { 0xDB6DB6DB, 0x6DB6DB6D, 0xB6000000 }, 3 },
+   { { 0x80, 0x01, 0xA5 },                   3, { 0xD2492492, 0x4926D349, 0xA6000000 }, 3 },
+   { { 0xFF, 0x00, 0x0F, 0x12, 0x34, 0x56 }, 6, { 0xDB6DB692, 0x4924924D, 0xB6926934, 0x9369A49A, 0x69B40000 }, 5 },
+};
+
+// Check the encoder output bit by bit against known patterns. Doesn't need the board
+static int CheckEncoder( void )
+{
+   uint32_t auiOut[64];
+   size_t   szWords;
+   size_t   i, j;
+   int      iFailures = 0;
+   
+   if( (23 != WS2812ResetWords( 300 )) || (26 != WS2812EncodedWords( 3, 300 )) || (9 != WS2812EncodedWords( 6, 50 )) )
+   {
+      printf( "FAIL: frame size (reset=%zu, frame=%zu, frame=%zu)\n", WS2812ResetWords( 300 ), WS2812EncodedWords( 3, 300 ), WS2812EncodedWords( 6, 50 ) );
+      iFailures++;
+   }
+   
+   for( i = 0; i < sizeof(g_astVectors) / sizeof(g_astVectors[0]); i++ )
+   {
+      const struct SEncoderVector* pstVector = &g_astVectors[i];
+      
+      memset( auiOut, 0xAA, sizeof(auiOut) );
+      szWords = WS2812Encode( pstVector->aucGRB, pstVector->szNumBytes, auiOut, 64 );
+      
+      if( szWords != pstVector->szNumWords )
+      {
+         printf( "FAIL: vector %zu used %zu words instead of %zu\n", i, szWords, pstVector->szNumWords );
+         iFailures++;
+         continue;
+      }
+      
+      for( j = 0; j < 64; j++ )
+      {
+         uint32_t uiExpected = (j < szWords)? pstVector->auiExpected[j]: 0;   // The reset gap must be zeroed
+         
+         if( auiOut[j] != uiExpected )
+         {
+            printf( "FAIL: vector %zu word %zu = 0x%08X, expected 0x%08X\n", i, j, auiOut[j], uiExpected );
+            iFailures++;
+            break;
+         }
+      }
+   }
+   
+   // An output buffer too small must not be overrun
+   memset( auiOut, 0xAA, sizeof(auiOut) );
+   szWords = WS2812Encode( g_astVectors[3].aucGRB, g_astVectors[3].szNumBytes, auiOut, 2 );
+   if( (2 != szWords) || (0xAAAAAAAA != auiOut[2]) )
+   {
+      printf( "FAIL: output buffer overrun\n" );
+      iFailures++;
+   }
+   
+   printf( "Encoder check: %s\n", iFailures? "FAILED": "OK" );
+   
+   return iFailures? -1: 0;
+}
+
+int main( int argc, char* argv[] )
+{
+   struct SWS2812Stats stStats;
+   uint8_t* pucGRB;
+   int   iNumLeds;
+   int   fd;
+   int   iRet;
+   int   i;
+   
+   if( (2 == argc) && (0 == strcmp( argv[1], "-c" )) )
+   {
+      return CheckEncoder();
+   }
+   
+   if( 3 > argc )
+   {
+      printf( "Wrong usage!\n" );
+      printf( "Use:\n" );
+      printf( "\t%s -c\t\t\t\tCheck the encoder (no device needed)\n", argv[0] );
+      printf( "\t%s <file-name> RRGGBB [RRGGBB...]\tSend one frame\n", argv[0] );
+      return -1;
+   }
+   
+   fd = open( argv[1], O_RDWR );
+   if( 0 > fd )
+   {
+      printf( "Error opening '%s': (%d) %s\n", argv[1], errno, strerror(errno) );
+      return -1;
+   }
+   
+   iNumLeds = argc - 2;
+   pucGRB = malloc( iNumLeds * WS2812_BYTES_PER_LED );
+   if( NULL == pucGRB )
+   {
+      close( fd );
+      return -1;
+   }
+   
+   for( i = 0; i < iNumLeds; i++ )
+   {
+      unsigned long ulRGB = strtoul( argv[i + 2], NULL, 16 );
+      
+      pucGRB[(i * 3) + 0] = (ulRGB >> 8) & 0xFF;     // G
+      pucGRB[(i * 3) + 1] = (ulRGB >> 16) & 0xFF;    // R
+      pucGRB[(i * 3) + 2] = ulRGB & 0xFF;            // B
+   }
+   
+   iRet = write( fd, pucGRB, iNumLeds * WS2812_BYTES_PER_LED );
+   if( 0 > iRet )
+   {
+      printf( "Write failed: (%d) %s\n", errno, strerror(errno) );
+   }
+   else if( 0 > ioctl( fd, IOCTL_WS2812_WAIT_IDLE ) )
+   {
+      printf( "Ioctl failed: (%d) %s\n", errno, strerror(errno) );
+   }
+   else if( 0 <= ioctl( fd, IOCTL_WS2812_GET_STATS, &stStats ) )
+   {
+      printf( "LEDs=%lu Queued=%lu Sent=%lu DMAErrors=%lu\n", stStats.ulLeds, stStats.ulFramesQueued, stStats.ulFramesSent, stStats.ulDMAErrors );
+   }
+   
+   free( pucGRB );
+   close( fd );
+   
+   return 0;
+}
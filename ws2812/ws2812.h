@@ -0,0 +1,45 @@
+#ifndef _WS2812_H_
+#define _WS2812_H_
+
+#define  WS2812_NUM_BUFFERS      2
+
+struct SWS2812Buffer
+{
+   struct SDMAControlBlock*   pstCB;         // Control block that streams this buffer
+   dma_addr_t                 CBBusAddr;
+   uint32_t*                  puiData;       // Encoded words
+   dma_addr_t                 DataBusAddr;
+};
+
+struct SWS2812Dev
+{
+   struct cdev          stCdev;
+   struct device*       pstDevice;
+   wait_queue_head_t    wait;
+   spinlock_t           lock;
+   struct mutex         write_lock;
+   struct hrtimer       stTimer;          // Checks for the end of the DMA transfer
+   
+   void*                pvDMAMem;         // Coherent memory shared by both buffers
+   dma_addr_t           DMAMemBusAddr;
+   size_t               szDMAMemSize;
+   size_t               szFrameWords;     // Words of each buffer (pixels + reset)
+   struct SWS2812Buffer astBuffers[WS2812_NUM_BUFFERS];
+   int                  iActive;          // Buffer being streamed (-1 if idle)
+   int                  iQueued;          // Buffer waiting for the active one to finish (-1 if none)
+   
+   struct SWS2812Stats  stStats;
+};
+
+static int SetupPWM( void );
+static int SetupPCM( void );
+static void StartDMA( struct SWS2812Dev* dev, int iBuffer );
+static enum hrtimer_restart DMAEndTimer( struct hrtimer* pstTimer );
+
+int ws2812_open(struct inode *inode, struct file *filp);
+int ws2812_release(struct inode *inode, struct file *filp);
+long ws2812_ioctl( struct file* filp, unsigned int ioctl_num, unsigned long ioctl_param );
+ssize_t ws2812_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos);
+unsigned int ws2812_poll( struct file* filp, poll_table* wait_table );
+
+#endif
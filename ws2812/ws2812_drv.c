@@ -0,0 +1,767 @@
+/*
+ *  ws2812_drv.c - WS2812/NeoPixel LED strip driver for the raspberry pi
+ *
+ *  The frame written by the user is encoded into PWM (or PCM) serializer words and
+ *  streamed by DMA, so the 800kHz timing doesn't depend on the CPU at all.
+ *  There are two buffers: while one is being streamed, the next frame can be queued
+ *  on the other one.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/err.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/delay.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/dma-mapping.h>
+#include <linux/platform_device.h>
+#include <linux/version.h>
+#include <linux/of.h>
+#include <linux/of_address.h>
+#include <linux/of_device.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "rpiregisters.h"
+#include "ws2812_encode.h"
+#include "ws2812_ioctl.h"
+#include "ws2812.h"
+
+#define  DRIVER_AUTHOR  "Bruno La Pastina <brunolap@gmail.com>"
+#define  DRIVER_DESC    "WS2812 LED strip driver for the Raspberry PI"
+#define  DEVICE_NAME    "ws2812"       // Dev name as it appears in /proc/devices
+
+MODULE_LICENSE( "GPL" );
+MODULE_AUTHOR( DRIVER_AUTHOR );
+MODULE_DESCRIPTION( DRIVER_DESC );
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 12, 0)
+MODULE_SUPPORTED_DEVICE( DEVICE_NAME );
+#endif
+
+#define  OSC_FREQ       19200000    // Frequency of the oscillator clock source
+#define  OSC_FREQ_2711  54000000    // The same on the BCM2711 (Raspberry PI 4)
+#define  DMA_LAST_FULL  6           // Channels 7 to 14 are DMA Lite, limited to 64KB per transfer
+
+//-----[ Module parameters ]------
+static int leds = 0;
+module_param( leds, int, S_IRUGO );
+MODULE_PARM_DESC( leds, "Number of LEDs on the strip" );
+
+static char* output = "pwm";
+module_param( output, charp, S_IRUGO );
+MODULE_PARM_DESC( output, "Peripheral used to generate the bit stream: pwm (default) or pcm" );
+
+static int pin = 18;
+module_param( pin, int, S_IRUGO );
+MODULE_PARM_DESC( pin, "GPIO connected to the strip: 12, 18 or 40 for pwm (default 18), 21 or 31 for pcm" );
+
+static int dma = 5;
+module_param( dma, int, S_IRUGO );
+MODULE_PARM_DESC( dma, "DMA channel used to feed the FIFO, 0 to 6 (default 5)" );
+
+static int reset_us = 300;
+module_param( reset_us, int, S_IRUGO );
+MODULE_PARM_DESC( reset_us, "Low time after each frame in us (default 300, the WS2812B needs at least 280)" );
+
+//------[ Module operations ]------
+struct file_operations g_stWS2812Fops =
+{
+   .owner            = THIS_MODULE,
+   .open             = ws2812_open,
+   .release          = ws2812_release,
+   .unlocked_ioctl   = ws2812_ioctl,
+   .write            = ws2812_write,
+   .poll             = ws2812_poll,
+};
+
+// Pins that can be connected to each peripheral and the function that does it
+struct SOutputPin
+{
+   int            iPin;
+   unsigned int   uiFunction;
+};
+
+static const struct SOutputPin g_astPWMPins[] = { { 12, GPIO_ALT0 }, { 18, GPIO_ALT5 }, { 40, GPIO_ALT0 } };
+static const struct SOutputPin g_astPCMPins[] = { { 21, GPIO_ALT0 }, { 31, GPIO_ALT2 } };
+
+//------[ Global variables ]------
+static int g_iWS2812Major;
+static int g_iUsePCM;
+static struct class* g_pobjWS2812Class = NULL;
+static struct SWS2812Dev g_stWS2812Dev;
+static struct SGpioRegistersMap* g_pstGpioRegisters = NULL;
+static struct SPWMRegistersMap* g_pstPWMRegisters = NULL;
+static struct SPCMRegistersMap* g_pstPCMRegisters = NULL;
+static struct SClockManagerRegistersMap* g_pstClockRegisters = NULL;
+static struct SDMAChannelRegistersMap* g_pstDMARegisters = NULL;
+static struct platform_device* g_pstPlatformDev = NULL;    // Owns the DMA memory
+static phys_addr_t g_PeriPhysBase;                         // Peripheral area as seen from the ARM
+static uint32_t g_uiOscFreq = OSC_FREQ;
+
+// Finds the peripheral area through the DMA controller of the device tree, and sets up a device whose
+// DMA addresses go through the dma-ranges of its bus, so they are the ones the DMA engine sees
+static int ProbePlatform( void )
+{
+   static const char* const aszCompatible[] = { "brcm,bcm2835-dma", "brcm,bcm2711-dma" };
+   struct device_node* pstNode = NULL;
+   struct resource stResource;
+   int iRet;
+   int i;
+
+   for( i = 0; (i < ARRAY_SIZE(aszCompatible)) && (NULL == pstNode); i++ )
+   {
+      pstNode = of_find_compatible_node( NULL, NULL, aszCompatible[i] );
+   }
+   if( NULL == pstNode )
+   {
+      printk( KERN_ERR "[WS2812] No DMA controller in the device tree\n" );
+      return -ENODEV;
+   }
+
+   if( of_machine_is_compatible( "brcm,bcm2711" ) || of_machine_is_compatible( "brcm,bcm2838" ) )
+   {
+      g_uiOscFreq = OSC_FREQ_2711;
+   }
+
+   iRet = of_address_to_resource( pstNode, 0, &stResource );
+   if( 0 == iRet )
+   {
+      g_PeriPhysBase = stResource.start - DMA0_OFFSET;
+
+      g_pstPlatformDev = platform_device_register_simple( DEVICE_NAME, -1, NULL, 0 );
+      if( IS_ERR( g_pstPlatformDev ) )
+      {
+         iRet = PTR_ERR( g_pstPlatformDev );
+         g_pstPlatformDev = NULL;
+      }
+   }
+   if( 0 == iRet )
+   {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 18, 0)
+      iRet = of_dma_configure( &g_pstPlatformDev->dev, pstNode, true );
+#else
+      iRet = of_dma_configure( &g_pstPlatformDev->dev, pstNode );
+#endif
+   }
+   if( 0 == iRet )
+   {
+      iRet = dma_set_coherent_mask( &g_pstPlatformDev->dev, DMA_BIT_MASK(32) );
+   }
+   of_node_put( pstNode );
+
+   if( iRet )
+   {
+      printk( KERN_ERR "[WS2812] Failed to set up the DMA device - ret=%d\n", iRet );
+      if( g_pstPlatformDev )
+      {
+         platform_device_unregister( g_pstPlatformDev );
+         g_pstPlatformDev = NULL;
+      }
+   }
+
+   return iRet;
+}
+
+static void UnmapRegisters( void )
+{
+   if( g_pstDMARegisters )    iounmap( g_pstDMARegisters );
+   if( g_pstClockRegisters )  iounmap( g_pstClockRegisters );
+   if( g_pstPCMRegisters )    iounmap( g_pstPCMRegisters );
+   if( g_pstPWMRegisters )    iounmap( g_pstPWMRegisters );
+   if( g_pstGpioRegisters )   iounmap( g_pstGpioRegisters );
+
+   g_pstDMARegisters = NULL;
+   g_pstClockRegisters = NULL;
+   g_pstPCMRegisters = NULL;
+   g_pstPWMRegisters = NULL;
+   g_pstGpioRegisters = NULL;
+}
+
+static int MapRegisters( void )
+{
+   g_pstGpioRegisters = (struct SGpioRegistersMap*) ioremap( g_PeriPhysBase + GPIO_OFFSET, sizeof(struct SGpioRegistersMap) );
+   g_pstPWMRegisters = (struct SPWMRegistersMap*) ioremap( g_PeriPhysBase + PWM_OFFSET, sizeof(struct SPWMRegistersMap) );
+   g_pstPCMRegisters = (struct SPCMRegistersMap*) ioremap( g_PeriPhysBase + PCM_OFFSET, sizeof(struct SPCMRegistersMap) );
+   g_pstClockRegisters = (struct SClockManagerRegistersMap*) ioremap( g_PeriPhysBase + CLOCK_OFFSET, sizeof(struct SClockManagerRegistersMap) );
+   g_pstDMARegisters = (struct SDMAChannelRegistersMap*) ioremap( g_PeriPhysBase + DMA0_OFFSET + (dma * DMA_CHANNEL_SIZE), sizeof(struct SDMAChannelRegistersMap) );
+
+   if( (NULL == g_pstGpioRegisters) || (NULL == g_pstPWMRegisters) || (NULL == g_pstPCMRegisters) ||
+       (NULL == g_pstClockRegisters) || (NULL == g_pstDMARegisters) )
+   {
+      UnmapRegisters();
+      return -ENOMEM;
+   }
+
+   return 0;
+}
+
+static int SelectPinFunction( void )
+{
+   const struct SOutputPin* pastPins = g_iUsePCM? g_astPCMPins: g_astPWMPins;
+   int iNumPins = g_iUsePCM? ARRAY_SIZE(g_astPCMPins): ARRAY_SIZE(g_astPWMPins);
+   unsigned int uiRegisterIndex;
+   unsigned int uiBit;
+   unsigned int uiOldValue;
+   int i;
+
+   for( i = 0; i < iNumPins; i++ )
+   {
+      if( pastPins[i].iPin == pin )
+      {
+         uiRegisterIndex = pin / 10;
+         uiBit = (pin % 10) * 3;
+         uiOldValue = ioread32( &g_pstGpioRegisters->GPFSEL[uiRegisterIndex] );
+         iowrite32( (uiOldValue & ~(0b111 << uiBit)) | (pastPins[i].uiFunction << uiBit), &g_pstGpioRegisters->GPFSEL[uiRegisterIndex] );
+         return 0;
+      }
+   }
+
+   printk( KERN_ERR "[WS2812] GPIO%d can't be driven by the %s\n", pin, output );
+   return -EINVAL;
+}
+
+// Stop the clock generator and restart it at the symbol rate, running from the oscillator.
+// 54MHz isn't a multiple of the symbol rate, so the fraction is spread with MASH 1
+static int SetupClock( uint32_t* puiCTL, uint32_t* puiDIV )
+{
+   uint32_t uiDivI = g_uiOscFreq / WS2812_SYMBOL_RATE;
+   uint32_t uiDivF = (uint32_t)div_u64( (u64)(g_uiOscFreq % WS2812_SYMBOL_RATE) * 4096, WS2812_SYMBOL_RATE );
+   uint32_t uiSource = (CM_SRC_OSC << CM_SRC) | ((uiDivF? 1: 0) << CM_MASH);
+   int iTimeout;
+
+   iowrite32( CM_PASSWD | (1 << CM_KILL), puiCTL );
+   for( iTimeout = 100; (ioread32( puiCTL ) & (1 << CM_BUSY)) && iTimeout; iTimeout-- )
+   {
+      udelay( 10 );
+   }
+
+   iowrite32( CM_PASSWD | (uiDivI << CM_DIVI) | (uiDivF << CM_DIVF), puiDIV );
+   iowrite32( CM_PASSWD | uiSource, puiCTL );
+   iowrite32( CM_PASSWD | uiSource | (1 << CM_ENAB), puiCTL );
+   for( iTimeout = 100; !(ioread32( puiCTL ) & (1 << CM_BUSY)) && iTimeout; iTimeout-- )
+   {
+      udelay( 10 );
+   }
+
+   if( 0 == iTimeout )
+   {
+      printk( KERN_ERR "[WS2812] Clock generator didn't start\n" );
+      return -EIO;
+   }
+
+   return 0;
+}
+
+static int SetupPWM( void )
+{
+   int iRet;
+
+   iowrite32( 0, &g_pstPWMRegisters->CTL );
+   udelay( 10 );
+
+   iRet = SetupClock( &g_pstClockRegisters->CM_PWMCTL, &g_pstClockRegisters->CM_PWMDIV );
+   if( iRet )
+   {
+      return iRet;
+   }
+
+   // Serializer mode, 32 bits per word, fed by DMA
+   iowrite32( 32, &g_pstPWMRegisters->RNG1 );
+   iowrite32( (1U << PWM_ENAB) | (7 << PWM_PANIC) | (3 << PWM_DREQ), &g_pstPWMRegisters->DMAC );
+   iowrite32( (1 << PWM_CLRF1), &g_pstPWMRegisters->CTL );
+   udelay( 10 );
+   iowrite32( (1 << PWM_USEF1) | (1 << PWM_MODE1) | (1 << PWM_PWEN1), &g_pstPWMRegisters->CTL );
+
+   return 0;
+}
+
+static int SetupPCM( void )
+{
+   int iRet;
+
+   iowrite32( 0, &g_pstPCMRegisters->CS_A );
+   udelay( 10 );
+
+   iRet = SetupClock( &g_pstClockRegisters->CM_PCMCTL, &g_pstClockRegisters->CM_PCMDIV );
+   if( iRet )
+   {
+      return iRet;
+   }
+
+   // One 32-bit channel per 32-bit frame, so the words go out back to back
+   iowrite32( (31 << PCM_FLEN) | (1 << PCM_FSLEN), &g_pstPCMRegisters->MODE_A );
+   iowrite32( (1U << PCM_CH1WEX) | (1 << PCM_CH1EN) | (8 << PCM_CH1WID), &g_pstPCMRegisters->TXC_A );
+   iowrite32( (0x10 << PCM_TX_PANIC) | (0x3F << PCM_TX), &g_pstPCMRegisters->DREQ_A );
+   iowrite32( (1 << PCM_EN), &g_pstPCMRegisters->CS_A );
+   iowrite32( (1 << PCM_EN) | (1 << PCM_TXCLR), &g_pstPCMRegisters->CS_A );
+   udelay( 10 );
+   iowrite32( (1 << PCM_EN) | (1 << PCM_DMAEN) | (1 << PCM_TXON), &g_pstPCMRegisters->CS_A );
+
+   return 0;
+}
+
+static void StopOutput( void )
+{
+   iowrite32( (1U << DMA_RESET), &g_pstDMARegisters->CS );
+   udelay( 10 );
+
+   if( g_iUsePCM )
+   {
+      iowrite32( 0, &g_pstPCMRegisters->CS_A );
+      iowrite32( CM_PASSWD | (1 << CM_KILL), &g_pstClockRegisters->CM_PCMCTL );
+   }
+   else
+   {
+      iowrite32( 0, &g_pstPWMRegisters->DMAC );
+      iowrite32( 0, &g_pstPWMRegisters->CTL );
+      iowrite32( CM_PASSWD | (1 << CM_KILL), &g_pstClockRegisters->CM_PWMCTL );
+   }
+}
+
+static int AllocateBuffers( struct SWS2812Dev* dev )
+{
+   size_t szBufferSize;
+   uint32_t uiTI;
+   uint32_t uiFIFOBusAddr;
+   int i;
+
+   dev->szFrameWords = WS2812EncodedWords( leds * WS2812_BYTES_PER_LED, reset_us );
+
+   // Control block + data for each buffer. Control blocks must be 256-bit aligned
+   szBufferSize = ALIGN( sizeof(struct SDMAControlBlock) + (dev->szFrameWords * sizeof(uint32_t)), 32 );
+   dev->szDMAMemSize = szBufferSize * WS2812_NUM_BUFFERS;
+
+   dev->pvDMAMem = dma_alloc_coherent( &g_pstPlatformDev->dev, dev->szDMAMemSize, &dev->DMAMemBusAddr, GFP_KERNEL );
+   if( NULL == dev->pvDMAMem )
+   {
+      return -ENOMEM;
+   }
+   memset( dev->pvDMAMem, 0, dev->szDMAMemSize );
+
+   if( g_iUsePCM )
+   {
+      uiTI = (DMA_PERMAP_PCM_TX << DMA_PERMAP);
+      uiFIFOBusAddr = PERI_BUS_BASE + PCM_OFFSET + offsetof(struct SPCMRegistersMap, FIFO_A);
+   }
+   else
+   {
+      uiTI = (DMA_PERMAP_PWM << DMA_PERMAP);
+      uiFIFOBusAddr = PERI_BUS_BASE + PWM_OFFSET + offsetof(struct SPWMRegistersMap, FIF1);
+   }
+   uiTI |= (1 << DMA_NO_WIDE_BURSTS) | (1 << DMA_WAIT_RESP) | (1 << DMA_DEST_DREQ) | (1 << DMA_SRC_INC);
+
+   for( i = 0; i < WS2812_NUM_BUFFERS; i++ )
+   {
+      struct SWS2812Buffer* pstBuffer = &dev->astBuffers[i];
+
+      pstBuffer->pstCB = (struct SDMAControlBlock*)((char*)dev->pvDMAMem + (i * szBufferSize));
+      pstBuffer->CBBusAddr = dev->DMAMemBusAddr + (i * szBufferSize);
+      pstBuffer->puiData = (uint32_t*)(pstBuffer->pstCB + 1);
+      pstBuffer->DataBusAddr = pstBuffer->CBBusAddr + sizeof(struct SDMAControlBlock);
+
+      pstBuffer->pstCB->TI = uiTI;
+      pstBuffer->pstCB->SOURCE_AD = pstBuffer->DataBusAddr;
+      pstBuffer->pstCB->DEST_AD = uiFIFOBusAddr;
+      pstBuffer->pstCB->TXFR_LEN = dev->szFrameWords * sizeof(uint32_t);
+      pstBuffer->pstCB->STRIDE = 0;
+      pstBuffer->pstCB->NEXTCONBK = 0;
+   }
+
+   dev->iActive = -1;
+   dev->iQueued = -1;
+
+   return 0;
+}
+
+static int __init ws2812_init(void)
+{
+   dev_t devno = 0;
+   struct SWS2812Dev* dev = &g_stWS2812Dev;
+   int   iRet;
+
+   printk( KERN_INFO "[WS2812] Loading module for %d LED%s on GPIO%d (%s)...\n", leds, ((1 < leds)? "s": ""), pin, output );
+
+   if( 0 >= leds )
+   {
+      printk( KERN_ERR "[WS2812] FAILED TO LOAD: Number of LEDs not specified\n" );
+      return -EINVAL;
+   }
+
+   if( (0 > dma) || (DMA_LAST_FULL < dma) || (0 > reset_us) )
+   {
+      printk( KERN_ERR "[WS2812] FAILED TO LOAD: Invalid parameters\n" );
+      return -EINVAL;
+   }
+
+   if( 0 == strcmp( output, "pcm" ) )
+   {
+      g_iUsePCM = 1;
+   }
+   else if( 0 != strcmp( output, "pwm" ) )
+   {
+      printk( KERN_ERR "[WS2812] FAILED TO LOAD: Unknown output '%s'\n", output );
+      return -EINVAL;
+   }
+
+   iRet = ProbePlatform();
+   if( iRet )
+   {
+      return iRet;
+   }
+
+   iRet = MapRegisters();
+   if( iRet )
+   {
+      printk( KERN_ERR "[WS2812] Failed to map registers\n" );
+      platform_device_unregister( g_pstPlatformDev );
+      g_pstPlatformDev = NULL;
+      return iRet;
+   }
+
+   iRet = alloc_chrdev_region( &devno, 0, 1, DEVICE_NAME );
+   if ( 0 > iRet )
+   {
+      printk( KERN_ERR "[WS2812] Error registering driver - ret=%d\n", iRet );
+      UnmapRegisters();
+      return iRet;
+   }
+   g_iWS2812Major = MAJOR(devno);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+   g_pobjWS2812Class = class_create( DEVICE_NAME );
+#else
+   g_pobjWS2812Class = class_create( THIS_MODULE, DEVICE_NAME );
+#endif
+   if ( IS_ERR( g_pobjWS2812Class ) )
+   {
+      iRet = PTR_ERR( g_pobjWS2812Class );
+      goto err_region;
+   }
+
+   memset( dev, 0, sizeof(*dev) );
+   init_waitqueue_head( &dev->wait );
+   spin_lock_init( &dev->lock );
+   mutex_init( &dev->write_lock );
+   hrtimer_init( &dev->stTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL );
+   dev->stTimer.function = DMAEndTimer;
+   dev->stStats.ulLeds = leds;
+
+   cdev_init( &dev->stCdev, &g_stWS2812Fops );
+   dev->stCdev.owner = THIS_MODULE;
+   iRet = cdev_add( &dev->stCdev, devno, 1 );
+   if( iRet )
+   {
+      printk( KERN_WARNING "[WS2812] Error %d while trying to add %s\n", iRet, DEVICE_NAME );
+      goto err_class;
+   }
+
+   dev->pstDevice = device_create( g_pobjWS2812Class, NULL, devno, NULL, DEVICE_NAME );
+   if ( IS_ERR( dev->pstDevice ) )
+   {
+      iRet = PTR_ERR( dev->pstDevice );
+      printk( KERN_WARNING "[WS2812] Error %d while trying to create %s\n", iRet, DEVICE_NAME );
+      goto err_cdev;
+   }
+
+   iRet = AllocateBuffers( dev );
+   if( iRet )
+   {
+      printk( KERN_ERR "[WS2812] Failed to allocate DMA memory\n" );
+      goto err_device;
+   }
+
+   iRet = SelectPinFunction();
+   if( 0 == iRet )
+   {
+      iRet = g_iUsePCM? SetupPCM(): SetupPWM();
+   }
+   if( iRet )
+   {
+      goto err_buffers;
+   }
+
+   printk( KERN_INFO "[WS2812] Module loaded\n" );
+
+   return 0;
+
+err_buffers:
+   StopOutput();
+   dma_free_coherent( &g_pstPlatformDev->dev, dev->szDMAMemSize, dev->pvDMAMem, dev->DMAMemBusAddr );
+err_device:
+   device_destroy( g_pobjWS2812Class, devno );
+err_cdev:
+   cdev_del( &dev->stCdev );
+err_class:
+   class_destroy( g_pobjWS2812Class );
+   g_pobjWS2812Class = NULL;
+err_region:
+   unregister_chrdev_region( devno, 1 );
+   UnmapRegisters();
+   platform_device_unregister( g_pstPlatformDev );
+   g_pstPlatformDev = NULL;
+   return iRet;
+}
+
+static void __exit ws2812_exit(void)
+{
+   struct SWS2812Dev* dev = &g_stWS2812Dev;
+
+   hrtimer_cancel( &dev->stTimer );
+   StopOutput();
+
+   dma_free_coherent( &g_pstPlatformDev->dev, dev->szDMAMemSize, dev->pvDMAMem, dev->DMAMemBusAddr );
+   device_destroy( g_pobjWS2812Class, MKDEV( g_iWS2812Major, 0 ) );
+   cdev_del( &dev->stCdev );
+   class_destroy( g_pobjWS2812Class );
+   g_pobjWS2812Class = NULL;
+   unregister_chrdev_region( MKDEV( g_iWS2812Major, 0 ), 1 );
+   UnmapRegisters();
+   platform_device_unregister( g_pstPlatformDev );
+   g_pstPlatformDev = NULL;
+
+   printk( KERN_INFO "[WS2812] Module removed\n" );
+}
+
+module_init( ws2812_init );
+module_exit( ws2812_exit );
+
+// Time needed to shift out one buffer, in ns
+static u64 FrameDuration( struct SWS2812Dev* dev )
+{
+   return div_u64( (u64)dev->szFrameWords * 32 * NSEC_PER_SEC, WS2812_SYMBOL_RATE );
+}
+
+// Must be called with dev->lock held
+static void StartDMA( struct SWS2812Dev* dev, int iBuffer )
+{
+   iowrite32( (1U << DMA_RESET), &g_pstDMARegisters->CS );
+   udelay( 1 );
+   iowrite32( (1 << DMA_INT) | (1 << DMA_END), &g_pstDMARegisters->CS );
+   iowrite32( dev->astBuffers[iBuffer].CBBusAddr, &g_pstDMARegisters->CONBLK_AD );
+   iowrite32( 7, &g_pstDMARegisters->DEBUG );    // Clear the error flags
+   iowrite32( (1 << DMA_WAIT_FOR_OUTSTANDING_WRITES) | (15 << DMA_PANIC_PRIORITY) | (15 << DMA_PRIORITY) | (1 << DMA_ACTIVE),
+              &g_pstDMARegisters->CS );
+
+   dev->iActive = iBuffer;
+   hrtimer_start( &dev->stTimer, ns_to_ktime( FrameDuration( dev ) ), HRTIMER_MODE_REL );
+}
+
+// Fires when the active buffer is expected to be done. If it is, start the queued one
+static enum hrtimer_restart DMAEndTimer( struct hrtimer* pstTimer )
+{
+   struct SWS2812Dev* dev = container_of( pstTimer, struct SWS2812Dev, stTimer );
+   unsigned long ulFlags;
+   uint32_t uiCS;
+
+   spin_lock_irqsave( &dev->lock, ulFlags );
+
+   uiCS = ioread32( &g_pstDMARegisters->CS );
+   if( uiCS & (1 << DMA_ACTIVE) )
+   {  // Not done yet (the FIFO still holds a few words), check again soon
+      spin_unlock_irqrestore( &dev->lock, ulFlags );
+      hrtimer_forward_now( pstTimer, ns_to_ktime( 10 * NSEC_PER_USEC ) );
+      return HRTIMER_RESTART;
+   }
+
+   if( uiCS & (1 << DMA_ERROR) )
+   {
+      dev->stStats.ulDMAErrors++;
+   }
+   dev->stStats.ulFramesSent++;
+   dev->iActive = -1;
+
+   if( 0 <= dev->iQueued )
+   {
+      int iBuffer = dev->iQueued;
+
+      dev->iQueued = -1;
+      StartDMA( dev, iBuffer );
+   }
+
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+
+   wake_up_interruptible( &dev->wait );
+
+   return HRTIMER_NORESTART;
+}
+
+int ws2812_open(struct inode* inode, struct file* filp)
+{
+   filp->private_data = &g_stWS2812Dev;
+
+   return 0;
+}
+
+int ws2812_release(struct inode* inode, struct file* filp)
+{
+   return 0;
+}
+
+static int IsIdle( struct SWS2812Dev* dev )
+{
+   unsigned long ulFlags;
+   int iIdle;
+
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   iIdle = (0 > dev->iActive) && (0 > dev->iQueued);
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+
+   return iIdle;
+}
+
+static int CanQueue( struct SWS2812Dev* dev )
+{
+   unsigned long ulFlags;
+   int iFree;
+
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   iFree = (0 > dev->iQueued);
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+
+   return iFree;
+}
+
+long ws2812_ioctl( struct file* filp, unsigned int ioctl_num, unsigned long ioctl_param )
+{
+   struct SWS2812Dev* dev = (struct SWS2812Dev*)filp->private_data;
+
+   switch (ioctl_num)
+   {
+      case IOCTL_WS2812_WAIT_IDLE:
+      {
+         if( wait_event_interruptible( dev->wait, IsIdle( dev ) ) )
+         {
+            return -ERESTARTSYS;
+         }
+         break;
+      }
+
+      case IOCTL_WS2812_GET_STATS:
+      {
+         struct SWS2812Stats stStats;
+         unsigned long ulFlags;
+
+         spin_lock_irqsave( &dev->lock, ulFlags );
+         stStats = dev->stStats;
+         spin_unlock_irqrestore( &dev->lock, ulFlags );
+
+         if( copy_to_user( (void __user*)ioctl_param, &stStats, sizeof(stStats) ) )
+         {
+            return -EFAULT;
+         }
+         break;
+      }
+
+      default:
+      {
+         printk( KERN_WARNING "[WS2812] Unkown ioctl %u\n", ioctl_num );
+         return -EINVAL;
+      }
+   }
+
+   return 0;
+}
+
+/*
+ * Takes a GRB buffer (3 bytes per LED). A shorter buffer updates only the first LEDs and
+ * turns the others off. Blocks while both buffers are taken, unless O_NONBLOCK is set
+ */
+ssize_t ws2812_write(struct file* filp, const char __user* buf, size_t count, loff_t* f_pos)
+{
+   struct SWS2812Dev* dev = (struct SWS2812Dev*)filp->private_data;
+   size_t szMaxBytes = leds * WS2812_BYTES_PER_LED;
+   unsigned long ulFlags;
+   uint8_t* pucPixels;
+   int iBuffer;
+
+   if( count > szMaxBytes )
+   {
+      count = szMaxBytes;
+   }
+
+   pucPixels = kzalloc( szMaxBytes, GFP_KERNEL );
+   if( NULL == pucPixels )
+   {
+      return -ENOMEM;
+   }
+
+   if( copy_from_user( pucPixels, buf, count ) )
+   {
+      kfree( pucPixels );
+      return -EFAULT;
+   }
+
+   // Only one writer at a time may own the free buffer
+   if( mutex_lock_interruptible( &dev->write_lock ) )
+   {
+      kfree( pucPixels );
+      return -ERESTARTSYS;
+   }
+
+   if( !CanQueue( dev ) )
+   {
+      if( filp->f_flags & O_NONBLOCK )
+      {
+         mutex_unlock( &dev->write_lock );
+         kfree( pucPixels );
+         return -EAGAIN;
+      }
+
+      if( wait_event_interruptible( dev->wait, CanQueue( dev ) ) )
+      {
+         mutex_unlock( &dev->write_lock );
+         kfree( pucPixels );
+         return -ERESTARTSYS;
+      }
+   }
+
+   // Nothing is queued, so the buffer that isn't streaming is free to be filled
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   iBuffer = (0 == dev->iActive)? 1: 0;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+
+   WS2812Encode( pucPixels, szMaxBytes, dev->astBuffers[iBuffer].puiData, dev->szFrameWords );
+   wmb();
+   kfree( pucPixels );
+
+   spin_lock_irqsave( &dev->lock, ulFlags );
+   if( 0 > dev->iActive )
+   {
+      StartDMA( dev, iBuffer );
+   }
+   else
+   {
+      dev->iQueued = iBuffer;
+   }
+   dev->stStats.ulFramesQueued++;
+   spin_unlock_irqrestore( &dev->lock, ulFlags );
+
+   mutex_unlock( &dev->write_lock );
+
+   return count;
+}
+
+unsigned int ws2812_poll( struct file* filp, poll_table* wait_table )
+{
+   struct SWS2812Dev* dev = (struct SWS2812Dev*)filp->private_data;
+   unsigned int mask = 0;
+
+   poll_wait( filp, &dev->wait, wait_table );
+
+   if( CanQueue( dev ) )
+   {  // A new frame can be written without blocking
+      mask |= (POLLOUT | POLLWRNORM);
+   }
+
+   return mask;
+}
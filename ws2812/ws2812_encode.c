@@ -0,0 +1,73 @@
+/*
+ *  ws2812_encode.c - Bit pattern encoder for WS2812/NeoPixel LEDs
+ *
+ *  The PWM serializer and the PCM transmitter both shift 32-bit words out MSB first,
+ *  so the same stream of words works for both of them.
+ */
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/string.h>
+#else
+#include <string.h>
+#endif
+
+#include "ws2812_encode.h"
+
+// Number of zero words needed to hold the line low for at least uiResetUs
+size_t WS2812ResetWords( unsigned int uiResetUs )
+{
+   size_t szBits = ((size_t)uiResetUs * (WS2812_SYMBOL_RATE / 1000) + 999) / 1000;
+   
+   return (szBits + 31) / 32;
+}
+
+// Number of words needed to send szNumBytes followed by the reset gap
+size_t WS2812EncodedWords( size_t szNumBytes, unsigned int uiResetUs )
+{
+   size_t szBits = szNumBytes * 8 * WS2812_SYMBOLS_PER_BIT;
+   
+   return ((szBits + 31) / 32) + WS2812ResetWords( uiResetUs );
+}
+
+// Encode the GRB buffer into serializer words. The words after the last bit are zeroed,
+// which keeps the line low for the reset gap. Returns the number of words used by the pixels
+size_t WS2812Encode( const uint8_t* pucGRB, size_t szNumBytes, uint32_t* puiOut, size_t szOutWords )
+{
+   uint64_t ullAccumulator = 0;
+   unsigned int uiBits = 0;
+   size_t   szWord = 0;
+   size_t   i;
+   int      iBit;
+   
+   for( i = 0; (i < szNumBytes) && (szWord < szOutWords); i++ )
+   {
+      uint32_t uiPattern = 0;
+      
+      // 8 bits, MSB first, become 24 symbols
+      for( iBit = 7; iBit >= 0; iBit-- )
+      {
+         uiPattern = (uiPattern << WS2812_SYMBOLS_PER_BIT) | ((pucGRB[i] & (1 << iBit))? WS2812_SYMBOL_ONE: WS2812_SYMBOL_ZERO);
+      }
+      
+      ullAccumulator = (ullAccumulator << 24) | uiPattern;
+      uiBits += 24;
+      
+      if( 32 <= uiBits )
+      {
+         uiBits -= 32;
+         puiOut[szWord++] = (uint32_t)(ullAccumulator >> uiBits);
+      }
+   }
+   
+   if( (0 < uiBits) && (szWord < szOutWords) )
+   {  // Flush the last partial word, left aligned
+      puiOut[szWord++] = (uint32_t)(ullAccumulator << (32 - uiBits));
+   }
+   
+   if( szWord < szOutWords )
+   {
+      memset( &puiOut[szWord], 0, (szOutWords - szWord) * sizeof(uint32_t) );
+   }
+   
+   return szWord;
+}
@@ -0,0 +1,27 @@
+/*
+ *  ws2812_encode.h - Bit pattern encoder for WS2812/NeoPixel LEDs
+ */
+#ifndef _WS2812_ENCODE_H_
+#define _WS2812_ENCODE_H_
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#include <stddef.h>
+#endif
+
+// Each LED bit (1.25us at 800kHz) is sent as 3 symbols of the serializer, so the
+// PWM/PCM clock must run at 2.4MHz
+#define  WS2812_BIT_RATE            800000
+#define  WS2812_SYMBOLS_PER_BIT     3
+#define  WS2812_SYMBOL_RATE         (WS2812_BIT_RATE * WS2812_SYMBOLS_PER_BIT)
+#define  WS2812_SYMBOL_ONE          0x6      // 110 - 0.83us high, 0.42us low
+#define  WS2812_SYMBOL_ZERO         0x4      // 100 - 0.42us high, 0.83us low
+#define  WS2812_BYTES_PER_LED       3        // G, R and B
+
+size_t WS2812ResetWords( unsigned int uiResetUs );
+size_t WS2812EncodedWords( size_t szNumBytes, unsigned int uiResetUs );
+size_t WS2812Encode( const uint8_t* pucGRB, size_t szNumBytes, uint32_t* puiOut, size_t szOutWords );
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _WS2812_IOCTL_H_
+#define _WS2812_IOCTL_H_
+
+#define  WS2812_IOCTL_IDENTIFIER    'W'
+
+/*
+ * Block until both buffers are free (the last queued frame has been fully sent)
+ */
+#define  IOCTL_WS2812_WAIT_IDLE     _IO( WS2812_IOCTL_IDENTIFIER, 0 )
+
+/*
+ * Get the transfer statistics
+ */
+struct SWS2812Stats
+{
+   unsigned long  ulLeds;           // Number of LEDs on the strip
+   unsigned long  ulFramesSent;     // Frames that were completely streamed
+   unsigned long  ulFramesQueued;   // Frames accepted by write()
+   unsigned long  ulDMAErrors;      // Transfers that ended with the DMA error flag set
+};
+#define  IOCTL_WS2812_GET_STATS     _IOR( WS2812_IOCTL_IDENTIFIER, 1, struct SWS2812Stats )
+
+#endif